@@ -0,0 +1,266 @@
+/**
+ * @file analyze.c
+ * @brief Implementation of stack analysis and constant folding
+ *
+ * Straight-line code needs a single forward walk to know what each word
+ * will find on the stack. Control words add edges to that walk: every
+ * jump target follows its control word (see control.c), so the forward
+ * edges are merged in index order, and only the back edges of 'until'
+ * and 'loop' can send a value to an index already visited.
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "analyze.h"
+#include "tf.h"
+#include "mem.h"
+#include "control.h"
+
+/** @brief Depth of an index that no edge reaches (yet) */
+#define DEPTH_NONE INT_MIN
+
+/** @brief Lower bound of an index that no edge reaches (yet) */
+#define BOUND_NONE INT_MAX
+
+/* ===================== Stack effects =================== */
+
+/**
+ * @brief Record a forward edge of the exact walk
+ * @return 0 if the target was already reached with another depth
+ */
+static int mergeExact(int *at, size_t target, int depth) {
+    if (at[target] == DEPTH_NONE) {
+        at[target] = depth;
+        return 1;
+    }
+    return at[target] == depth;
+}
+
+void computeStackEffect(tfobj *body, int *in, int *out) {
+    size_t len = body->list.len;
+    int *at = xmalloc(sizeof(int) * (len + 1));   // Depth on entry to each index
+    for (size_t i = 0; i <= len; i++) at[i] = DEPTH_NONE;
+
+    int need = 0;       // Deepest value reached below the entry depth
+    int depth = 0;      // Depth relative to the entry depth, exact
+    int exact = 1;      // Whether every path agrees on the depth so far
+    int branches = 0;   // Open 'if' and 'do', whose code may not run
+
+    for (size_t i = 0; i < len && exact; i++) {
+        if (at[i] != DEPTH_NONE) {
+            exact = depth == DEPTH_NONE || depth == at[i];
+            if (!exact) break;
+            depth = at[i];
+        }
+        at[i] = depth;
+
+        tfobj *o = body->list.ele[i];
+        if (objType(o) == TFOBJ_TYPE_WORD) continue;
+        if (objType(o) != TFOBJ_TYPE_SYMBOL) {
+            depth++;
+            continue;
+        }
+        // Only code that runs on every path can raise the requirement
+        if (branches == 0 && o->sym.in - depth > need) {
+            need = o->sym.in - depth;
+        }
+        if (o->sym.out == TFEFFECT_UNKNOWN) {
+            exact = 0;
+            break;
+        }
+        depth += o->sym.out - o->sym.in;
+
+        size_t target = o->sym.target;
+        switch (o->sym.control) {
+            case TFCTRL_IF:
+            case TFCTRL_DO:
+                exact = mergeExact(at, target, depth);
+                branches++;
+                break;
+            case TFCTRL_ELSE:
+                exact = mergeExact(at, target, depth);
+                depth = DEPTH_NONE;   // The next index is only reached by 'if'
+                break;
+            case TFCTRL_UNTIL:
+                // Every iteration must leave the stack as deep as the first
+                exact = at[target] == depth;
+                break;
+            case TFCTRL_LOOP:
+                exact = at[target] == depth;
+                branches--;
+                break;
+            case TFCTRL_THEN:
+                branches--;
+                break;
+        }
+    }
+    if (exact && at[len] != DEPTH_NONE) {
+        exact = depth == DEPTH_NONE || depth == at[len];
+        depth = at[len];
+    }
+    free(at);
+
+    if (!exact) {
+        *in = need;
+        *out = TFEFFECT_UNKNOWN;
+        return;
+    }
+    // A body that ends 'depth' values lower can't complete with fewer than that
+    if (-depth > need) need = -depth;
+    *in = need;
+    *out = need + depth;
+}
+
+/* ===================== Constant folding =================== */
+
+/** @brief Most values a pure primitive may consume or produce */
+#define FOLD_MAX_VALUES 8
+
+/**
+ * @brief Check whether a symbol can be evaluated at compile time
+ */
+static int isFoldable(tfobj *o) {
+    if (objType(o) != TFOBJ_TYPE_SYMBOL || o->sym.word == NULL) return 0;
+    tfobj *word = o->sym.word;
+    return word->word.fn != NULL && (word->word.flags & TFWORD_PURE) &&
+           o->sym.in <= FOLD_MAX_VALUES && o->sym.out <= FOLD_MAX_VALUES;
+}
+
+void foldConstants(tfobj *program) {
+    tfobj **ele = program->list.ele;
+    size_t out = 0;
+
+    for (size_t i = 0; i < program->list.len; i++) {
+        tfobj *o = ele[i];
+        if (objType(o) == TFOBJ_TYPE_WORD) {
+            foldConstants(o->word.body);
+        }
+
+        size_t in = isFoldable(o) ? (size_t)o->sym.in : 0;
+        int literals = isFoldable(o) && out >= in;
+        for (size_t j = 0; literals && j < in; j++) {
+            literals = isImmInt(ele[out - in + j]);
+        }
+        if (!literals) {
+            ele[out++] = o;
+            continue;
+        }
+
+        /* Run the primitive on a scratch stack. The inputs are integers
+         * and the stack is deep enough, so it can't fail. */
+        tfobj *slots[FOLD_MAX_VALUES];
+        tfctx scratch = {0};
+        scratch.stack = slots;
+        scratch.capacity = FOLD_MAX_VALUES;
+        scratch.current_object = o;
+        for (size_t j = 0; j < in; j++) {
+            slots[scratch.sp++] = ele[out - in + j];
+        }
+        o->sym.word->word.fn(&scratch);
+
+        // The literals are immediates, dropping them needs no decRef
+        out -= in;
+        for (size_t j = 0; j < scratch.sp; j++) {
+            ele[out++] = slots[j];
+        }
+        decRef(o);
+    }
+    program->list.len = out;
+    // Folded runs never contain a jump target, only the indexes moved
+    linkBranches(program);
+}
+
+/* ===================== Depth checks =================== */
+
+static void markProvenChecks(tfobj *list, int depth);
+
+/**
+ * @brief One forward pass of the lower bound walk
+ * @param list Program or body list
+ * @param lo Lower bound of the depth on entry to each index, lowered by
+ *           the edges reaching it (BOUND_NONE where none did yet)
+ * @param mark Clear the proven checks, only on the final pass
+ * @return Nonzero if a back edge lowered a loop start, another pass is needed
+ */
+static int boundPass(tfobj *list, int *lo, int mark) {
+    int depth = lo[0];
+    int changed = 0;
+
+    for (size_t i = 0; i < list->list.len; i++) {
+        if (depth < lo[i]) lo[i] = depth;
+        depth = lo[i];
+        if (depth == BOUND_NONE) continue;
+
+        tfobj *o = list->list.ele[i];
+        switch (objType(o)) {
+            case TFOBJ_TYPE_WORD:
+                if (mark) markProvenChecks(o->word.body, o->word.in);
+                continue;
+            case TFOBJ_TYPE_LIST:
+                // A quotation may run on any stack: only its own pushes count
+                if (mark) markProvenChecks(o, 0);
+                depth++;
+                continue;
+            case TFOBJ_TYPE_SYMBOL:
+                break;
+            default:
+                depth++;
+                continue;
+        }
+
+        if (depth >= o->sym.in) {
+            if (mark) o->sym.need = 0;
+        } else {
+            // The check stays; once it passes the depth is at least 'in'
+            depth = o->sym.in;
+        }
+        depth = o->sym.out == TFEFFECT_UNKNOWN ? 0 : depth + o->sym.out - o->sym.in;
+
+        size_t target = o->sym.target;
+        switch (o->sym.control) {
+            case TFCTRL_IF:
+            case TFCTRL_DO:
+                if (depth < lo[target]) lo[target] = depth;
+                break;
+            case TFCTRL_ELSE:
+                if (depth < lo[target]) lo[target] = depth;
+                depth = BOUND_NONE;
+                break;
+            case TFCTRL_UNTIL:
+            case TFCTRL_LOOP:
+                /* A loop that consumes values loses a little depth per
+                 * iteration: widen straight to 0 rather than going one
+                 * pass per value. */
+                if (depth < lo[target]) {
+                    lo[target] = 0;
+                    changed = 1;
+                }
+                break;
+        }
+    }
+    return changed;
+}
+
+/**
+ * @brief Clear the checks of one list given a known minimum entry depth
+ * @param list Program or body list
+ * @param depth Stack depth guaranteed when the list starts running
+ *
+ * Passes are repeated until the bounds at the loop starts are stable
+ * (each can only drop to 0 once), then a last one marks the checks.
+ */
+static void markProvenChecks(tfobj *list, int depth) {
+    size_t len = list->list.len;
+    int *lo = xmalloc(sizeof(int) * (len + 1));
+    for (size_t i = 0; i <= len; i++) lo[i] = BOUND_NONE;
+    lo[0] = depth;
+
+    while (boundPass(list, lo, 0)) {}
+    boundPass(list, lo, 1);
+    free(lo);
+}
+
+void analyzeStack(tfobj *program) {
+    markProvenChecks(program, 0);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file analyze.h
+ * @brief Compile-time stack analysis and constant folding
+ *
+ * Every word has a known stack effect ( in -- out ). These passes use it
+ * to evaluate literal-only expressions before the program runs, and to
+ * prove where the stack is deep enough that a word's runtime depth check
+ * can be skipped.
+ */
+
+#ifndef ANALYZE_H
+#define ANALYZE_H
+#include "tf.h"
+
+/**
+ * @brief Compute the stack effect of a resolved body
+ * @param body List of literals and resolved symbols
+ * @param in Receives the stack depth the body needs
+ * @param out Receives the number of values it leaves in place of those
+ *
+ * For ': sq dup * ;' this gives ( 1 -- 1 ). With control flow, 'in'
+ * only counts the code that runs on every path (branch bodies keep their
+ * own checks), and 'out' is TFEFFECT_UNKNOWN unless all paths change the
+ * depth by the same amount: ': f if 1 then ;' has no fixed effect.
+ */
+void computeStackEffect(tfobj *body, int *in, int *out);
+
+/**
+ * @brief Fold literal-only expressions into literals
+ * @param program List object that already went through resolveSymbols()
+ *
+ * Each pure primitive (TFWORD_PURE) whose inputs are all integer literals
+ * right before it is run at compile time, and replaced, together with
+ * those literals, by its results: '1 2 + 3 *' becomes '9'. The bodies of
+ * colon definitions are folded as well.
+ */
+void foldConstants(tfobj *program);
+
+/**
+ * @brief Remove the runtime depth checks that can be proven unnecessary
+ * @param program List object that already went through resolveSymbols()
+ *
+ * Tracks a lower bound of the stack depth through the program, starting
+ * at 0 for the top level and at word.in inside colon definitions (callers
+ * check or prove that much before the call). Symbols whose sym.in is
+ * covered by the bound get sym.need = 0, so neither VM checks them.
+ * Branches merge with the lowest bound, a loop that shrinks the stack
+ * keeps no bound at its start, and a word of unknown effect leaves 0.
+ */
+void analyzeStack(tfobj *program);
+
+#endif
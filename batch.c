@@ -0,0 +1,348 @@
+/**
+ * @file batch.c
+ * @brief Worker pool, work-stealing queues and ordered output for --batch
+ *
+ * Scripts are numbered in batch order and dealt out to the workers as
+ * contiguous ranges, one range per worker. A worker runs the scripts of
+ * its range from the front; once it is empty it steals the back half of
+ * another worker's range. Each queue is just two indexes behind a mutex,
+ * taken once per script, which is nothing next to running one.
+ *
+ * Workers share nothing mutable but those queues and the result slots:
+ * the primitives' dictionary is only read, the intern table locks itself,
+ * and every object a worker creates comes from its own thread's pool and
+ * dies in that thread. Each script prints into its own memory stream, and
+ * the main thread writes the streams out in batch order.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "tf.h"
+#include "mem.h"
+#include "dict.h"
+#include "parser.h"
+#include "vm.h"
+#include "output.h"
+
+/**
+ * @brief Scripts not taken yet by anyone, [next, end) in batch order
+ */
+typedef struct batchQueue {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+} batchQueue;
+
+/**
+ * @brief Output of one script, filled in by the worker that ran it
+ */
+typedef struct batchResult {
+    char *text;        /**< Everything the script printed, and its error */
+    size_t len;        /**< Length of the text in bytes */
+    int failed;        /**< Set if the script stopped on an error */
+    int done;          /**< Set once text is complete (under batchRun.lock) */
+} batchResult;
+
+/**
+ * @brief State shared by the workers of a batch
+ */
+typedef struct batchRun {
+    char **scripts;          /**< Paths of the scripts, in batch order */
+    size_t count;            /**< Number of scripts */
+    tfdict *dict;            /**< Primitives, shared read-only */
+    const runOptions *opt;   /**< Options for every script */
+    batchQueue *queues;      /**< One per worker */
+    int jobs;                /**< Number of workers */
+    batchResult *results;    /**< One per script */
+    pthread_mutex_t lock;    /**< Guards results[].done */
+    pthread_cond_t done;     /**< Signalled when a result is done */
+} batchRun;
+
+/**
+ * @brief A worker thread and the queue it owns
+ */
+typedef struct batchWorker {
+    batchRun *run;
+    int id;                  /**< Index of its queue */
+    pthread_t thread;
+} batchWorker;
+
+/* ===================== Scripts =================== */
+
+/**
+ * @brief Append a script path to a growing array
+ */
+static void addScript(char ***scripts, size_t *count, size_t *capacity, char *path) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *scripts = xrealloc(*scripts, sizeof(char *) * *capacity);
+    }
+    (*scripts)[(*count)++] = path;
+}
+
+/**
+ * @brief scandir() filter for the .tf files of a directory
+ */
+static int isScript(const struct dirent *e) {
+    size_t len = strlen(e->d_name);
+    return len > 3 && strcmp(e->d_name + len - 3, ".tf") == 0;
+}
+
+/**
+ * @brief List the scripts of a batch
+ * @param path Directory or manifest
+ * @param scripts Receives the paths (each one and the array freed by the caller)
+ * @param count Receives the number of scripts
+ * @return 0 on success, -1 if the batch can't be read
+ *
+ * A directory gives its *.tf files sorted by name. A manifest has one
+ * path per line, run in that order; blank lines and lines starting with
+ * '#' are skipped.
+ */
+static int listScripts(const char *path, char ***scripts, size_t *count) {
+    size_t capacity = 0;
+    *scripts = NULL;
+    *count = 0;
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        struct dirent **entries;
+        int n = scandir(path, &entries, isScript, alphasort);
+        if (n < 0) {
+            return -1;
+        }
+        size_t dir_len = strlen(path);
+        int slash = dir_len > 0 && path[dir_len - 1] == '/';
+        for (int i = 0; i < n; i++) {
+            size_t len = dir_len + !slash + strlen(entries[i]->d_name) + 1;
+            char *script = xmalloc(len);
+            snprintf(script, len, "%s%s%s", path, slash ? "" : "/", entries[i]->d_name);
+            addScript(scripts, count, &capacity, script);
+            free(entries[i]);
+        }
+        free(entries);
+        return 0;
+    }
+
+    FILE *manifest = fopen(path, "r");
+    if (manifest == NULL) {
+        return -1;
+    }
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, manifest)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') continue;
+        char *script = xmalloc(len + 1);
+        memcpy(script, line, len + 1);
+        addScript(scripts, count, &capacity, script);
+    }
+    free(line);
+    fclose(manifest);
+    return 0;
+}
+
+/* ===================== Queues =================== */
+
+/**
+ * @brief Get the next script for a worker, stealing if its queue is empty
+ * @param run The batch
+ * @param id The worker
+ * @param index Receives the script to run
+ * @return 0 once every queue is empty
+ *
+ * A thief takes the back half of the first non-empty queue after its
+ * own, keeps the first script of it and puts the rest in its queue.
+ * Scripts are never added, so a pass that finds every queue empty means
+ * the batch is done (scripts being stolen are run by the thief).
+ */
+static int takeScript(batchRun *run, int id, size_t *index) {
+    batchQueue *own = &run->queues[id];
+    pthread_mutex_lock(&own->lock);
+    if (own->next < own->end) {
+        *index = own->next++;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for (int k = 1; k < run->jobs; k++) {
+        batchQueue *victim = &run->queues[(id + k) % run->jobs];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->end - victim->next;
+        if (left == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        size_t from = victim->end - (left + 1) / 2;
+        size_t to = victim->end;
+        victim->end = from;
+        pthread_mutex_unlock(&victim->lock);
+
+        *index = from;
+        pthread_mutex_lock(&own->lock);
+        own->next = from + 1;
+        own->end = to;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    return 0;
+}
+
+/* ===================== Workers =================== */
+
+/**
+ * @brief Run one script and publish its output
+ *
+ * Errors jump back here through the thread's error trap, with their
+ * message written to the script's output. resetContext() then releases
+ * the values left on the stack, except the operands of the word that
+ * failed: those leak, and only their pool cells come back with
+ * poolRelease() when the worker ends.
+ */
+static void runScript(batchRun *run, size_t index) {
+    batchResult *r = &run->results[index];
+    const char *name = run->scripts[index];
+    FILE *out = open_memstream(&r->text, &r->len);
+    if (out == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    sourceFile src;
+    if (loadFile(name, &src) != 0) {
+        fprintf(out, "%s: File not found\n", name);
+        r->failed = 1;
+    } else {
+        tferrortrap trap;
+        trap.out = out;
+        trap.name = name;
+        tferrortrap *old = setErrorTrap(&trap);
+        tfctx *ctx = createChildContext(run->dict);
+        setOutputStream(&ctx->out, out);
+        ctx->out.policy = TFFLUSH_EXIT;   // It all goes to memory anyway
+        tfobj *volatile program = NULL;
+        if (setjmp(trap.jump) == 0) {
+            program = compile(src.text, src.len);
+            runProgram(ctx, program, run->opt);
+        } else {
+            r->failed = 1;
+            resetContext(ctx);
+        }
+        setErrorTrap(old);
+        freeContext(ctx);
+        if (program) {
+            decRef(program);
+        }
+        unloadFile(&src);
+    }
+    fclose(out);
+
+    pthread_mutex_lock(&run->lock);
+    r->done = 1;
+    pthread_cond_broadcast(&run->done);
+    pthread_mutex_unlock(&run->lock);
+}
+
+/**
+ * @brief Worker thread: run scripts until every queue is empty
+ */
+static void *batchWorkerMain(void *arg) {
+    batchWorker *w = arg;
+    size_t index;
+    while (takeScript(w->run, w->id, &index)) {
+        runScript(w->run, index);
+    }
+    poolRelease();
+    return NULL;
+}
+
+/* ===================== Interface =================== */
+
+int runBatch(const char *path, int jobs, const runOptions *opt) {
+    batchRun run;
+    if (listScripts(path, &run.scripts, &run.count) != 0) {
+        return -1;
+    }
+    if (jobs <= 0) {
+        long cpus = -1;
+#ifdef _SC_NPROCESSORS_ONLN   // Not POSIX: hidden by _POSIX_C_SOURCE on macOS
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        jobs = cpus > 0 ? (int)cpus : 1;
+    }
+    if ((size_t)jobs > run.count) {
+        jobs = run.count > 0 ? (int)run.count : 1;
+    }
+    run.dict = createDict();   // Interns every primitive before any worker starts
+    run.opt = opt;
+    run.jobs = jobs;
+    run.queues = xmalloc(sizeof(batchQueue) * jobs);
+    run.results = xmalloc(sizeof(batchResult) * (run.count ? run.count : 1));
+    memset(run.results, 0, sizeof(batchResult) * run.count);
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.done, NULL);
+
+    batchWorker *workers = xmalloc(sizeof(batchWorker) * jobs);
+    for (int i = 0; i < jobs; i++) {
+        pthread_mutex_init(&run.queues[i].lock, NULL);
+        run.queues[i].next = run.count * i / jobs;
+        run.queues[i].end = run.count * (i + 1) / jobs;
+    }
+    for (int i = 0; i < jobs; i++) {
+        workers[i].run = &run;
+        workers[i].id = i;
+        if (pthread_create(&workers[i].thread, NULL, batchWorkerMain, &workers[i]) != 0) {
+            fprintf(stderr, "Cannot start worker threads\n");
+            exit(1);
+        }
+    }
+
+    // Write each script's output as soon as everything before it is out
+    int failed = 0;
+    for (size_t i = 0; i < run.count; i++) {
+        batchResult *r = &run.results[i];
+        pthread_mutex_lock(&run.lock);
+        while (!r->done) {
+            pthread_cond_wait(&run.done, &run.lock);
+        }
+        pthread_mutex_unlock(&run.lock);
+        fwrite(r->text, 1, r->len, stdout);
+        free(r->text);
+        failed += r->failed;
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    for (int i = 0; i < jobs; i++) {
+        pthread_mutex_destroy(&run.queues[i].lock);
+    }
+    pthread_cond_destroy(&run.done);
+    pthread_mutex_destroy(&run.lock);
+    free(workers);
+    free(run.queues);
+    free(run.results);
+    freeDict(run.dict);
+    for (size_t i = 0; i < run.count; i++) {
+        free(run.scripts[i]);
+    }
+    free(run.scripts);
+    return failed;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file batch.h
+ * @brief Running many scripts in parallel (--batch)
+ *
+ * A batch is a directory of .tf files or a manifest listing one script
+ * per line. The scripts run on a pool of worker threads, each with its
+ * own context and pool allocator, against one dictionary of primitives
+ * built up front and shared read-only. Every script starts from a fresh
+ * dictionary on top of it, so definitions never leak between scripts.
+ *
+ * The output of each script (what it prints and its error, if any) is
+ * buffered and written in the order of the scripts, so the output of a
+ * batch is the same whatever the number of threads and the order they
+ * happen to finish in.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+#include "vm.h"
+
+/**
+ * @brief Run every script of a batch
+ * @param path Directory (every *.tf in it, by name) or manifest file
+ * @param jobs Number of worker threads, 0 for one per online CPU (or one
+ *             thread where the system can't count them)
+ * @param opt Options selecting the passes and the VM, for every script
+ * @return Number of scripts that failed (errors, missing files), or -1
+ *         if the batch itself can't be read
+ *
+ * Workers take scripts from their own queue and steal half of another
+ * worker's queue when theirs runs dry, so a few slow scripts don't keep
+ * the other threads idle. Output is written to stdout as soon as all the
+ * scripts before it are done.
+ */
+int runBatch(const char *path, int jobs, const runOptions *opt);
+
+#endif
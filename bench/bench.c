@@ -0,0 +1,405 @@
+/**
+ * @file bench.c
+ * @brief Benchmark harness for the ToyForth compiler and VM
+ *
+ * Generates a fixed set of workloads in memory and times each phase of
+ * running them separately:
+ * - parse: compile(), text to object list
+ * - link: resolveSymbols() and the optimization passes, down to bytecode
+ * - exec: execCode() on the threaded interpreter
+ *
+ * Every workload is run a few times to warm up caches and the pool
+ * allocator, then measured over several repetitions. The results are
+ * written as JSON (one benchmark per line, so two runs diff cleanly) and
+ * can be compared against an earlier result file to flag regressions.
+ *
+ * Usage: toyforth-bench [-n reps] [-w warmup] [-o results.json]
+ *                       [--baseline old.json] [--threshold percent]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tf.h"
+#include "mem.h"
+#include "parser.h"
+#include "dict.h"
+#include "bytecode.h"
+#include "fuse.h"
+#include "analyze.h"
+#include "intern.h"
+
+/** @brief Most benchmarks a baseline file may hold */
+#define BENCH_MAX 32
+
+/** @brief Timings below this are too noisy to call a regression (ns) */
+#define BENCH_NOISE_FLOOR_NS 500000
+
+/* ===================== Workload generation =================== */
+
+/**
+ * @brief Growable text buffer the workloads are generated into
+ */
+typedef struct benchText {
+    char *buf;
+    size_t len;
+    size_t capacity;
+} benchText;
+
+/**
+ * @brief Append formatted text to a buffer
+ */
+static void textAppend(benchText *t, const char *fmt, ...) {
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(t->buf + t->len, t->capacity - t->len, fmt, ap);
+        va_end(ap);
+        if ((size_t)n < t->capacity - t->len) {
+            t->len += n;
+            return;
+        }
+        t->capacity = t->capacity ? t->capacity * 2 : 4096;
+        t->buf = xrealloc(t->buf, t->capacity);
+    }
+}
+
+/**
+ * @brief Deep arithmetic chain: one huge definition run many times
+ *
+ * The chain starts from a value on the stack, so constant folding can't
+ * evaluate it away; it nets out to zero so values never overflow.
+ */
+static void genArith(benchText *t) {
+    textAppend(t, ": chain");
+    for (int i = 0; i < 50000; i++) {
+        textAppend(t, " 5 + 3 - 2 -");
+    }
+    textAppend(t, " ;\n");
+    for (int i = 0; i < 20; i++) {
+        textAppend(t, "0 chain drop\n");
+    }
+}
+
+/**
+ * @brief A million-token flat program, dominated by parsing and linking
+ *
+ * 'zero' is a colon definition, so nothing after it is a known constant
+ * and the statements survive folding.
+ */
+static void genTokens(benchText *t) {
+    textAppend(t, ": zero 0 ;\n");
+    for (int i = 0; i < 250000; i++) {
+        textAppend(t, "zero 1 + drop\n");
+    }
+}
+
+/**
+ * @brief Stack churn: shuffling words, and a stack grown to 100k values
+ */
+static void genStack(benchText *t) {
+    textAppend(t, ": zero 0 ;\n: churn");
+    for (int i = 0; i < 1000; i++) {
+        textAppend(t, " 1 swap dup drop swap drop");
+    }
+    textAppend(t, " ;\n");
+    for (int i = 0; i < 200; i++) {
+        textAppend(t, "zero churn drop\n");
+    }
+    textAppend(t, "zero");
+    for (int i = 0; i < 100000; i++) {
+        textAppend(t, " dup");
+    }
+    for (int i = 0; i <= 100000; i++) {
+        textAppend(t, " drop");
+    }
+    textAppend(t, "\n");
+}
+
+/**
+ * @brief Dictionary-heavy code: 10k definitions calling each other
+ *
+ * Word i calls word i/2, so every call goes about 14 definitions deep.
+ */
+static void genDict(benchText *t) {
+    textAppend(t, ": w0 1 + 1 - ;\n");
+    for (int i = 1; i < 10000; i++) {
+        textAppend(t, ": w%d w%d 1 + 1 - ;\n", i, i / 2);
+    }
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 10000; i += 3) {
+            textAppend(t, "0 w%d drop\n", i);
+        }
+    }
+}
+
+/**
+ * @brief Bulk vector words on million-element vectors
+ *
+ * Few dispatches, so this measures the vector kernels rather than the
+ * interpreter.
+ */
+static void genVector(benchText *t) {
+    textAppend(t, ": big 1000000 iota ;\n");
+    for (int i = 0; i < 20; i++) {
+        textAppend(t, "big dup vadd vsum drop big dup vdot drop big vmax drop\n");
+    }
+}
+
+/**
+ * @brief A named workload
+ */
+typedef struct benchWorkload {
+    const char *name;
+    void (*generate)(benchText *t);
+} benchWorkload;
+
+static const benchWorkload workloads[] = {
+    {"arith", genArith},
+    {"tokens", genTokens},
+    {"stack", genStack},
+    {"dict", genDict},
+    {"vector", genVector},
+    {NULL, NULL}
+};
+
+/* ===================== Measurement =================== */
+
+/**
+ * @brief Timings of one benchmark, in nanoseconds
+ */
+typedef struct benchResult {
+    char name[32];
+    size_t tokens;
+    long long parse_ns;          /* Best of all repetitions */
+    long long link_ns;
+    long long exec_ns;
+    long long parse_median_ns;
+    long long link_median_ns;
+    long long exec_median_ns;
+} benchResult;
+
+static long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compareNs(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Count whitespace-separated tokens in a workload
+ */
+static size_t countTokens(const char *s, size_t len) {
+    size_t n = 0;
+    int in_token = 0;
+    for (size_t i = 0; i < len; i++) {
+        int space = (s[i] == ' ' || s[i] == '\n');
+        n += !space && !in_token;
+        in_token = !space;
+    }
+    return n;
+}
+
+/**
+ * @brief Run a program once, the same way main.c does, timing each phase
+ * @param times Where to store the parse, link and exec times
+ */
+static void runOnce(benchText *t, long long times[3]) {
+    tfctx *ctx = createContext();
+
+    long long t0 = nowNs();
+    tfobj *program = compile(t->buf, t->len);
+    long long t1 = nowNs();
+    resolveSymbols(ctx->dict, program);
+    foldConstants(program);
+    fuseProgram(program);
+    analyzeStack(program);
+    tfcell *code = compileCode(program);
+    long long t2 = nowNs();
+    execCode(ctx, code);
+    long long t3 = nowNs();
+
+    free(code);
+    decRef(program);
+    freeContext(ctx);
+    times[0] = t1 - t0;
+    times[1] = t2 - t1;
+    times[2] = t3 - t2;
+}
+
+/**
+ * @brief Warm up, then measure a workload over several repetitions
+ */
+static void runWorkload(const benchWorkload *w, int warmup, int reps, benchResult *r) {
+    benchText t = {0};
+    w->generate(&t);
+
+    long long *samples[3];
+    for (int p = 0; p < 3; p++) {
+        samples[p] = xmalloc(sizeof(long long) * reps);
+    }
+    long long times[3];
+    for (int i = 0; i < warmup; i++) {
+        runOnce(&t, times);
+    }
+    for (int i = 0; i < reps; i++) {
+        runOnce(&t, times);
+        for (int p = 0; p < 3; p++) {
+            samples[p][i] = times[p];
+        }
+    }
+
+    long long best[3], median[3];
+    for (int p = 0; p < 3; p++) {
+        qsort(samples[p], reps, sizeof(long long), compareNs);
+        best[p] = samples[p][0];
+        median[p] = samples[p][reps / 2];
+        free(samples[p]);
+    }
+    snprintf(r->name, sizeof(r->name), "%s", w->name);
+    r->tokens = countTokens(t.buf, t.len);
+    r->parse_ns = best[0];
+    r->link_ns = best[1];
+    r->exec_ns = best[2];
+    r->parse_median_ns = median[0];
+    r->link_median_ns = median[1];
+    r->exec_median_ns = median[2];
+    free(t.buf);
+}
+
+/* ===================== Results =================== */
+
+static void writeJson(FILE *f, const benchResult *results, size_t n, int reps) {
+    fprintf(f, "{\n  \"reps\": %d,\n  \"benchmarks\": [\n", reps);
+    for (size_t i = 0; i < n; i++) {
+        const benchResult *r = &results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"tokens\": %zu, "
+                   "\"parse_ns\": %lld, \"link_ns\": %lld, \"exec_ns\": %lld, "
+                   "\"parse_median_ns\": %lld, \"link_median_ns\": %lld, "
+                   "\"exec_median_ns\": %lld}%s\n",
+                r->name, r->tokens, r->parse_ns, r->link_ns, r->exec_ns,
+                r->parse_median_ns, r->link_median_ns, r->exec_median_ns,
+                i + 1 < n ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+/**
+ * @brief Load the results of an earlier run
+ * @return Number of benchmarks read
+ *
+ * Only understands the format writeJson() produces: one benchmark object
+ * per line with the keys in that order.
+ */
+static size_t readJson(const char *filename, benchResult *results) {
+    FILE *f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot open baseline '%s'\n", filename);
+        exit(1);
+    }
+    char line[512];
+    size_t n = 0;
+    while (n < BENCH_MAX && fgets(line, sizeof(line), f)) {
+        benchResult *r = &results[n];
+        if (sscanf(line, " {\"name\": \"%31[^\"]\", \"tokens\": %zu, "
+                         "\"parse_ns\": %lld, \"link_ns\": %lld, \"exec_ns\": %lld",
+                   r->name, &r->tokens, &r->parse_ns, &r->link_ns, &r->exec_ns) == 5) {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+/**
+ * @brief Print one phase of a benchmark, compared with the baseline
+ * @return 1 if it got slower by more than the threshold
+ */
+static int comparePhase(const char *phase, long long now, long long before,
+                        double threshold) {
+    double change = before > 0 ? 100.0 * (now - before) / before : 0.0;
+    int regressed = change > threshold && now - before > BENCH_NOISE_FLOOR_NS;
+    printf("  %-6s %10.3f ms  (was %10.3f ms, %+6.1f%%)%s\n", phase, now / 1e6,
+           before / 1e6, change, regressed ? "  REGRESSION" : "");
+    return regressed;
+}
+
+/* ===================== Main Entry Point =================== */
+
+int main(int argc, char **argv) {
+    int reps = 5, warmup = 1;
+    const char *output = NULL, *baseline = NULL;
+    double threshold = 15.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-n reps] [-w warmup] [-o results.json] "
+                            "[--baseline old.json] [--threshold percent]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (reps < 1) reps = 1;
+
+    benchResult results[BENCH_MAX];
+    size_t n = 0;
+    for (size_t i = 0; workloads[i].name != NULL; i++) {
+        runWorkload(&workloads[i], warmup, reps, &results[n++]);
+    }
+
+    benchResult old[BENCH_MAX];
+    size_t n_old = baseline ? readJson(baseline, old) : 0;
+    int regressions = 0;
+    for (size_t i = 0; i < n; i++) {
+        const benchResult *r = &results[i];
+        const benchResult *b = NULL;
+        for (size_t j = 0; j < n_old; j++) {
+            if (strcmp(old[j].name, r->name) == 0) b = &old[j];
+        }
+        printf("%s (%zu tokens, best of %d)\n", r->name, r->tokens, reps);
+        if (b) {
+            regressions += comparePhase("parse", r->parse_ns, b->parse_ns, threshold);
+            regressions += comparePhase("link", r->link_ns, b->link_ns, threshold);
+            regressions += comparePhase("exec", r->exec_ns, b->exec_ns, threshold);
+        } else {
+            printf("  parse  %10.3f ms\n  link   %10.3f ms\n  exec   %10.3f ms\n",
+                   r->parse_ns / 1e6, r->link_ns / 1e6, r->exec_ns / 1e6);
+        }
+    }
+
+    if (output) {
+        FILE *f = fopen(output, "w");
+        if (f == NULL) {
+            fprintf(stderr, "Cannot write '%s'\n", output);
+            return 1;
+        }
+        writeJson(f, results, n, reps);
+        fclose(f);
+    }
+    freeInternTable();
+
+    if (regressions) {
+        printf("%d phase(s) slower than the baseline by more than %.1f%%\n",
+               regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
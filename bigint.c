@@ -0,0 +1,703 @@
+/**
+ * @file bigint.c
+ * @brief Implementation of arbitrary-precision integer arithmetic
+ *
+ * Numbers are a sign and a magnitude. The mag*() helpers work on bare
+ * magnitudes (arrays of 32-bit limbs, least significant first), so all
+ * the carries fit in a uint64_t. INT operands are viewed as magnitudes
+ * of at most two limbs, which lets mixed INT/BIGINT operations share the
+ * same code.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bigint.h"
+#include "tf.h"
+#include "mem.h"
+#include "output.h"
+
+/** @brief Largest power of ten that fits in a limb */
+#define BIG_DECIMAL_BASE 1000000000u
+
+/** @brief Number of decimal digits in BIG_DECIMAL_BASE */
+#define BIG_DECIMAL_DIGITS 9
+
+/**
+ * @brief An INT or BIGINT operand seen as sign and magnitude
+ *
+ * For an INT the limbs point into 'small', so a view must not be copied.
+ */
+typedef struct bigView {
+    const uint32_t *limbs;
+    size_t len;             /**< 0 for zero */
+    int neg;
+    uint32_t small[2];
+} bigView;
+
+static void viewNumber(const tfobj *o, bigView *v) {
+    if (objType(o) == TFOBJ_TYPE_BIGINT) {
+        v->limbs = o->big.limbs;
+        v->len = o->big.len;
+        v->neg = o->big.neg;
+        return;
+    }
+    int64_t i = objInt(o);
+    uint64_t m = i < 0 ? -(uint64_t)i : (uint64_t)i;
+    v->small[0] = (uint32_t)m;
+    v->small[1] = (uint32_t)(m >> 32);
+    v->len = v->small[1] ? 2 : (v->small[0] ? 1 : 0);
+    v->neg = i < 0;
+    v->limbs = v->small;
+}
+
+/**
+ * @brief Turn a computed magnitude into an object
+ * @param limbs Result from xmalloc(), possibly with leading zero limbs
+ *              (ownership is transferred)
+ *
+ * Values that fit in an int64_t become INTs and free the limbs.
+ */
+static tfobj *makeNumber(uint32_t *limbs, size_t len, int neg) {
+    while (len > 0 && limbs[len - 1] == 0) len--;
+    if (len <= 2) {
+        uint64_t m = len == 0 ? 0 : limbs[0];
+        if (len == 2) m |= (uint64_t)limbs[1] << 32;
+        if (m <= (uint64_t)INT64_MAX || (neg && m == (uint64_t)INT64_MAX + 1)) {
+            free(limbs);
+            // -m computed in unsigned arithmetic, so INT64_MIN is fine
+            return createIntObject(neg ? (int64_t)(0 - m) : (int64_t)m);
+        }
+    }
+    return createBigIntObject(limbs, len, neg);
+}
+
+/* ===================== Magnitudes =================== */
+
+static int magCmp(const uint32_t *a, size_t alen, const uint32_t *b, size_t blen) {
+    if (alen != blen) return alen < blen ? -1 : 1;
+    for (size_t i = alen; i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief r = a + b, with alen >= blen; r has room for alen + 1 limbs
+ */
+static void magAdd(uint32_t *r, const uint32_t *a, size_t alen,
+                   const uint32_t *b, size_t blen) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < alen; i++) {
+        carry += (uint64_t)a[i] + (i < blen ? b[i] : 0);
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    r[alen] = (uint32_t)carry;
+}
+
+/**
+ * @brief r = a - b, with a >= b; r has room for alen limbs
+ */
+static void magSub(uint32_t *r, const uint32_t *a, size_t alen,
+                   const uint32_t *b, size_t blen) {
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < alen; i++) {
+        uint64_t d = (uint64_t)a[i] - (i < blen ? b[i] : 0) - borrow;
+        r[i] = (uint32_t)d;
+        borrow = (d >> 32) & 1;
+    }
+}
+
+/**
+ * @brief r += x in place; r has rlen limbs and the sum fits in them
+ */
+static void magAccumulate(uint32_t *r, size_t rlen, const uint32_t *x, size_t xlen) {
+    uint64_t carry = 0;
+    size_t i;
+    for (i = 0; i < xlen; i++) {
+        carry += (uint64_t)r[i] + x[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    for (; carry && i < rlen; i++) {
+        carry += r[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+/**
+ * @brief r -= x in place, with r >= x; r has rlen limbs
+ */
+static void magDecrease(uint32_t *r, size_t rlen, const uint32_t *x, size_t xlen) {
+    uint64_t borrow = 0;
+    size_t i;
+    for (i = 0; i < xlen; i++) {
+        uint64_t d = (uint64_t)r[i] - x[i] - borrow;
+        r[i] = (uint32_t)d;
+        borrow = (d >> 32) & 1;
+    }
+    for (; borrow && i < rlen; i++) {
+        uint64_t d = (uint64_t)r[i] - borrow;
+        r[i] = (uint32_t)d;
+        borrow = (d >> 32) & 1;
+    }
+}
+
+/**
+ * @brief Length of a magnitude without its leading zero limbs
+ */
+static size_t magTrim(const uint32_t *a, size_t len) {
+    while (len > 0 && a[len - 1] == 0) len--;
+    return len;
+}
+
+/**
+ * @brief a = a * m + add in place; a has room for len + 1 limbs
+ * @return The new length
+ */
+static size_t magMulAddSmall(uint32_t *a, size_t len, uint32_t m, uint32_t add) {
+    uint64_t carry = add;
+    for (size_t i = 0; i < len; i++) {
+        carry += (uint64_t)a[i] * m;
+        a[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry) a[len++] = (uint32_t)carry;
+    return len;
+}
+
+/**
+ * @brief a = a / d in place
+ * @return The remainder
+ */
+static uint32_t magDivSmall(uint32_t *a, size_t len, uint32_t d) {
+    uint64_t rem = 0;
+    for (size_t i = len; i-- > 0;) {
+        uint64_t cur = rem << 32 | a[i];
+        a[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    return (uint32_t)rem;
+}
+
+/* ===================== Multiplication =================== */
+
+static void magMul(uint32_t *r, const uint32_t *a, size_t alen,
+                   const uint32_t *b, size_t blen);
+
+/**
+ * @brief r = a * b by the schoolbook method, O(alen * blen)
+ */
+static void magMulSchoolbook(uint32_t *r, const uint32_t *a, size_t alen,
+                             const uint32_t *b, size_t blen) {
+    memset(r, 0, sizeof(uint32_t) * (alen + blen));
+    for (size_t i = 0; i < alen; i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < blen; j++) {
+            carry += (uint64_t)a[i] * b[j] + r[i + j];
+            r[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        r[i + blen] = (uint32_t)carry;
+    }
+}
+
+/**
+ * @brief r = a * b with Karatsuba's method, for blen > h
+ * @param h Split point: a = a1 * B^h + a0, b = b1 * B^h + b0
+ *
+ * Three half-size products instead of four:
+ * a * b = z2 * B^2h + (z1 - z2 - z0) * B^h + z0, with z0 = a0 * b0,
+ * z2 = a1 * b1 and z1 = (a0 + a1) * (b0 + b1). O(n^1.58) overall.
+ */
+static void magMulKaratsuba(uint32_t *r, const uint32_t *a, size_t alen,
+                            const uint32_t *b, size_t blen, size_t h) {
+    size_t n = alen + blen;
+    // z0 and z2 go straight to their place in r, they don't overlap
+    magMul(r, a, h, b, h);
+    magMul(r + 2 * h, a + h, alen - h, b + h, blen - h);
+
+    uint32_t *sa = xmalloc(sizeof(uint32_t) * (h + 1));
+    uint32_t *sb = xmalloc(sizeof(uint32_t) * (h + 1));
+    uint32_t *z1 = xmalloc(sizeof(uint32_t) * (2 * h + 2));
+    magAdd(sa, a, h, a + h, alen - h);
+    magAdd(sb, b, h, b + h, blen - h);
+    magMul(z1, sa, h + 1, sb, h + 1);
+    magDecrease(z1, 2 * h + 2, r, 2 * h);
+    magDecrease(z1, 2 * h + 2, r + 2 * h, n - 2 * h);
+    // What remains of z1 is a0 * b1 + a1 * b0, less than B^(n - h)
+    magAccumulate(r + h, n - h, z1, magTrim(z1, 2 * h + 2));
+    free(z1);
+    free(sb);
+    free(sa);
+}
+
+/**
+ * @brief r = a * b for a much longer than b
+ *
+ * Multiplies b by blen-limb slices of a, so that every product is
+ * balanced enough for Karatsuba.
+ */
+static void magMulUnbalanced(uint32_t *r, const uint32_t *a, size_t alen,
+                             const uint32_t *b, size_t blen) {
+    uint32_t *t = xmalloc(sizeof(uint32_t) * 2 * blen);
+    memset(r, 0, sizeof(uint32_t) * (alen + blen));
+    for (size_t i = 0; i < alen; i += blen) {
+        size_t n = alen - i < blen ? alen - i : blen;
+        magMul(t, a + i, n, b, blen);
+        magAccumulate(r + i, alen + blen - i, t, n + blen);
+    }
+    free(t);
+}
+
+/**
+ * @brief r = a * b; r has room for alen + blen limbs
+ *
+ * Schoolbook below BIGINT_KARATSUBA_THRESHOLD limbs, where its low
+ * overhead wins, Karatsuba above.
+ */
+static void magMul(uint32_t *r, const uint32_t *a, size_t alen,
+                   const uint32_t *b, size_t blen) {
+    if (alen < blen) {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        size_t tlen = alen;
+        alen = blen;
+        blen = tlen;
+    }
+    if (blen < BIGINT_KARATSUBA_THRESHOLD) {
+        magMulSchoolbook(r, a, alen, b, blen);
+        return;
+    }
+    size_t h = (alen + 1) / 2;
+    if (blen <= h) {
+        magMulUnbalanced(r, a, alen, b, blen);
+    } else {
+        magMulKaratsuba(r, a, alen, b, blen, h);
+    }
+}
+
+/**
+ * @brief Multiply into a new array
+ * @param rlen Set to the length of the product, without leading zeros
+ */
+static uint32_t *magProduct(const uint32_t *a, size_t alen,
+                            const uint32_t *b, size_t blen, size_t *rlen) {
+    uint32_t *r = xmalloc(sizeof(uint32_t) * (alen + blen + 1));
+    magMul(r, a, alen, b, blen);
+    *rlen = magTrim(r, alen + blen);
+    return r;
+}
+
+/* ===================== Division =================== */
+
+/*
+ * Division by a big number p of L limbs uses Barrett's method: with the
+ * reciprocal mu = floor(B^2L / p) computed once, the quotient of any
+ * m < B^2L is estimated with two multiplications and is off by at most 2.
+ * The reciprocal itself comes from Newton's iteration on a reciprocal of
+ * the top half of p, so everything costs a few multiplications.
+ */
+
+/** @brief Below this many limbs reciprocals are computed bit by bit */
+#define RECIPROCAL_BASE_LIMBS 4
+
+static const uint32_t magOne[1] = {1};
+
+/**
+ * @brief Compare a with B^n
+ */
+static int magCmpPow(const uint32_t *a, size_t len, size_t n) {
+    len = magTrim(a, len);
+    if (len != n + 1) return len < n + 1 ? -1 : 1;
+    if (a[n] != 1) return 1;
+    return magTrim(a, n) ? 1 : 0;
+}
+
+/**
+ * @brief r = floor(B^2L / p) by binary long division, for small L
+ * @param r Room for 2L + 2 limbs, zeroed
+ */
+static void magReciprocalBase(uint32_t *r, const uint32_t *p, size_t L) {
+    uint32_t rem[RECIPROCAL_BASE_LIMBS + 1] = {0};
+    for (size_t bit = 64 * L + 1; bit-- > 0;) {
+        // rem = rem * 2 + next bit of B^2L (only its top bit is set)
+        uint32_t in = (bit == 64 * L);
+        for (size_t i = 0; i <= L; i++) {
+            uint32_t out = rem[i] >> 31;
+            rem[i] = rem[i] << 1 | in;
+            in = out;
+        }
+        if (magCmp(rem, magTrim(rem, L + 1), p, L) >= 0) {
+            magDecrease(rem, L + 1, p, L);
+            r[bit / 32] |= (uint32_t)1 << (bit % 32);
+        }
+    }
+}
+
+/**
+ * @brief Compute floor(B^2L / p)
+ * @param p Divisor of L limbs, the top one nonzero
+ * @param rlen Set to the length of the result
+ * @return The reciprocal (at most L + 2 limbs), from xmalloc()
+ */
+static uint32_t *magReciprocal(const uint32_t *p, size_t L, size_t *rlen) {
+    size_t cap = L < RECIPROCAL_BASE_LIMBS + 1 ? 2 * L + 2 : L + 3;
+    uint32_t *x = xmalloc(sizeof(uint32_t) * cap);
+    memset(x, 0, sizeof(uint32_t) * cap);
+    if (L <= RECIPROCAL_BASE_LIMBS) {
+        magReciprocalBase(x, p, L);
+        *rlen = magTrim(x, cap);
+        return x;
+    }
+
+    /* Start from the reciprocal of the top h limbs of p, scaled to L
+     * limbs. Its relative error is below B^(1-h), and one Newton step,
+     * x += x * (B^2L - p * x) / B^2L, squares it: with 2h >= L + 3 the
+     * result is within a few units of mu. */
+    size_t h = (L + 4) / 2;
+    size_t hlen;
+    uint32_t *xh = magReciprocal(p + (L - h), h, &hlen);
+    memcpy(x + (L - h), xh, sizeof(uint32_t) * hlen);
+    free(xh);
+    size_t xlen = magTrim(x, cap);
+
+    size_t tlen, elen;
+    uint32_t *t = magProduct(p, L, x, xlen, &tlen);
+    int over = magCmpPow(t, tlen, 2 * L) >= 0;
+    uint32_t *d;
+    if (over) {
+        d = t;        // d = p * x - B^2L
+        magDecrease(d + 2 * L, tlen - 2 * L, magOne, 1);
+    } else {
+        d = xmalloc(sizeof(uint32_t) * (2 * L + 1));
+        memset(d, 0, sizeof(uint32_t) * 2 * L);
+        d[2 * L] = 1; // d = B^2L - p * x
+        magDecrease(d, 2 * L + 1, t, tlen);
+        free(t);
+        tlen = 2 * L + 1;
+    }
+    uint32_t *e = magProduct(x, xlen, d, magTrim(d, tlen), &elen);
+    if (elen > 2 * L) {
+        if (over) {
+            magDecrease(x, cap, e + 2 * L, elen - 2 * L);
+        } else {
+            magAccumulate(x, cap, e + 2 * L, elen - 2 * L);
+        }
+    }
+    free(e);
+    free(d);
+
+    // Final correction to the exact floor: p * x <= B^2L < p * (x + 1)
+    t = magProduct(p, L, x, magTrim(x, cap), &tlen);
+    while (magCmpPow(t, tlen, 2 * L) > 0) {
+        magDecrease(x, cap, magOne, 1);
+        magDecrease(t, tlen, p, L);
+    }
+    uint32_t *rem = xmalloc(sizeof(uint32_t) * (2 * L + 1));
+    memset(rem, 0, sizeof(uint32_t) * 2 * L);
+    rem[2 * L] = 1;
+    magDecrease(rem, 2 * L + 1, t, magTrim(t, tlen));
+    while (magCmp(rem, magTrim(rem, 2 * L + 1), p, L) >= 0) {
+        magDecrease(rem, 2 * L + 1, p, L);
+        magAccumulate(x, cap, magOne, 1);
+    }
+    free(rem);
+    free(t);
+    *rlen = magTrim(x, cap);
+    return x;
+}
+
+/**
+ * @brief Divide m by p, given mu = floor(B^2L / p)
+ * @param m Dividend, less than B^2L
+ * @param q Set to the quotient (from xmalloc())
+ * @param r Set to the remainder (from xmalloc())
+ */
+static void magDivMod(const uint32_t *m, size_t mlen, const uint32_t *p, size_t L,
+                      const uint32_t *mu, size_t mulen,
+                      uint32_t **q, size_t *qlen, uint32_t **r, size_t *rlen) {
+    size_t qcap = mlen >= L ? mlen - L + 2 : 1;
+    *q = xmalloc(sizeof(uint32_t) * qcap);
+    memset(*q, 0, sizeof(uint32_t) * qcap);
+    *r = xmalloc(sizeof(uint32_t) * (mlen + 1));
+    memcpy(*r, m, sizeof(uint32_t) * mlen);
+    *rlen = mlen;
+    if (mlen >= L) {
+        // q = floor(floor(m / B^(L-1)) * mu / B^(L+1)), at most 2 too small
+        size_t plen, qplen;
+        uint32_t *prod = magProduct(m + (L - 1), mlen - (L - 1), mu, mulen, &plen);
+        if (plen > L + 1) {
+            memcpy(*q, prod + L + 1, sizeof(uint32_t) * (plen - L - 1));
+            uint32_t *qp = magProduct(*q, plen - L - 1, p, L, &qplen);
+            magDecrease(*r, mlen, qp, qplen);
+            free(qp);
+        }
+        free(prod);
+        *rlen = magTrim(*r, mlen);
+        while (magCmp(*r, *rlen, p, L) >= 0) {
+            magDecrease(*r, *rlen, p, L);
+            magAccumulate(*q, qcap, magOne, 1);
+            *rlen = magTrim(*r, *rlen);
+        }
+    }
+    *qlen = magTrim(*q, qcap);
+}
+
+/* ===================== Arithmetic =================== */
+
+/**
+ * @brief Signed addition on views (subtraction flips b's sign first)
+ */
+static tfobj *addViews(const bigView *a, const bigView *b) {
+    size_t n = a->len > b->len ? a->len : b->len;
+    uint32_t *r = xmalloc(sizeof(uint32_t) * (n + 1));
+    if (a->neg == b->neg) {
+        if (a->len >= b->len) {
+            magAdd(r, a->limbs, a->len, b->limbs, b->len);
+        } else {
+            magAdd(r, b->limbs, b->len, a->limbs, a->len);
+        }
+        return makeNumber(r, n + 1, a->neg);
+    }
+    // Opposite signs: subtract the smaller magnitude from the larger
+    if (magCmp(a->limbs, a->len, b->limbs, b->len) >= 0) {
+        magSub(r, a->limbs, a->len, b->limbs, b->len);
+        return makeNumber(r, n, a->neg);
+    }
+    magSub(r, b->limbs, b->len, a->limbs, a->len);
+    return makeNumber(r, n, b->neg);
+}
+
+tfobj *numberAdd(const tfobj *a, const tfobj *b) {
+    int64_t r;
+    if (objType(a) == TFOBJ_TYPE_INT && objType(b) == TFOBJ_TYPE_INT &&
+        !addOverflow(objInt(a), objInt(b), &r)) {
+        return createIntObject(r);
+    }
+    bigView va, vb;
+    viewNumber(a, &va);
+    viewNumber(b, &vb);
+    return addViews(&va, &vb);
+}
+
+tfobj *numberSub(const tfobj *a, const tfobj *b) {
+    int64_t r;
+    if (objType(a) == TFOBJ_TYPE_INT && objType(b) == TFOBJ_TYPE_INT &&
+        !subOverflow(objInt(a), objInt(b), &r)) {
+        return createIntObject(r);
+    }
+    bigView va, vb;
+    viewNumber(a, &va);
+    viewNumber(b, &vb);
+    vb.neg = !vb.neg;
+    return addViews(&va, &vb);
+}
+
+tfobj *numberMul(const tfobj *a, const tfobj *b) {
+    int64_t r;
+    if (objType(a) == TFOBJ_TYPE_INT && objType(b) == TFOBJ_TYPE_INT &&
+        !mulOverflow(objInt(a), objInt(b), &r)) {
+        return createIntObject(r);
+    }
+    bigView va, vb;
+    viewNumber(a, &va);
+    viewNumber(b, &vb);
+    // Overflow means neither operand is zero, so both lengths are >= 1
+    uint32_t *p = xmalloc(sizeof(uint32_t) * (va.len + vb.len));
+    magMul(p, va.limbs, va.len, vb.limbs, vb.len);
+    return makeNumber(p, va.len + vb.len, va.neg != vb.neg);
+}
+
+int numberCompare(const tfobj *a, const tfobj *b) {
+    if (objType(a) == TFOBJ_TYPE_INT && objType(b) == TFOBJ_TYPE_INT) {
+        int64_t x = objInt(a), y = objInt(b);
+        return (x > y) - (x < y);
+    }
+    bigView va, vb;
+    viewNumber(a, &va);
+    viewNumber(b, &vb);
+    if (va.neg != vb.neg) return va.neg ? -1 : 1;
+    int c = magCmp(va.limbs, va.len, vb.limbs, vb.len);
+    return va.neg ? -c : c;
+}
+
+/* ===================== Decimal conversion =================== */
+
+/*
+ * Small numbers are converted digit group by digit group, which is
+ * quadratic. Past BIGINT_DECIMAL_THRESHOLD limbs both directions split
+ * the number around a power 10^(9 * 2^k) instead, so the work is a few
+ * big multiplications (and Barrett divisions) per level of recursion.
+ */
+
+/**
+ * @brief The powers P[k] = 10^(9 * 2^k), with their reciprocals
+ *
+ * Each one is the square of the previous; they are computed on demand
+ * and shared by every step of one conversion.
+ */
+typedef struct decimalPowers {
+    uint32_t *p[64];
+    size_t len[64];
+    uint32_t *mu[64];    /**< floor(B^2L / P[k]), or NULL until needed */
+    size_t mulen[64];
+    int count;
+} decimalPowers;
+
+/**
+ * @brief Make sure P[0] .. P[k] are computed
+ */
+static void decimalPower(decimalPowers *pw, int k) {
+    if (pw->count == 0) {
+        pw->p[0] = xmalloc(sizeof(uint32_t));
+        pw->p[0][0] = BIG_DECIMAL_BASE;
+        pw->len[0] = 1;
+        pw->mu[0] = NULL;
+        pw->count = 1;
+    }
+    while (pw->count <= k) {
+        int i = pw->count++;
+        pw->p[i] = magProduct(pw->p[i - 1], pw->len[i - 1], pw->p[i - 1],
+                              pw->len[i - 1], &pw->len[i]);
+        pw->mu[i] = NULL;
+    }
+}
+
+static void freeDecimalPowers(decimalPowers *pw) {
+    for (int i = 0; i < pw->count; i++) {
+        free(pw->p[i]);
+        free(pw->mu[i]);
+    }
+}
+
+/**
+ * @brief Magnitude of a run of decimal digits
+ * @param a Receives the value; room for len / 9 + 2 limbs
+ * @return Its length
+ */
+static size_t magFromDecimal(uint32_t *a, const char *s, size_t len, decimalPowers *pw) {
+    if (len <= (size_t)BIG_DECIMAL_DIGITS * BIGINT_DECIMAL_THRESHOLD) {
+        // Consume the digits in groups of 9, the first group being the short one
+        size_t n = 0;
+        size_t group = len % BIG_DECIMAL_DIGITS;
+        if (group == 0) group = BIG_DECIMAL_DIGITS;
+        while (len > 0) {
+            uint32_t chunk = 0, scale = 1;
+            for (size_t i = 0; i < group; i++) {
+                chunk = chunk * 10 + (uint32_t)(s[i] - '0');
+                scale *= 10;
+            }
+            n = magMulAddSmall(a, n, scale, chunk);
+            s += group;
+            len -= group;
+            group = BIG_DECIMAL_DIGITS;
+        }
+        return n;
+    }
+
+    // value = high * P[k] + low, low being the last 9 * 2^k digits
+    int k = 0;
+    while (((size_t)BIG_DECIMAL_DIGITS << (k + 1)) < len) k++;
+    size_t low_digits = (size_t)BIG_DECIMAL_DIGITS << k;
+    decimalPower(pw, k);
+
+    uint32_t *high = xmalloc(sizeof(uint32_t) * ((len - low_digits) / BIG_DECIMAL_DIGITS + 2));
+    size_t hlen = magFromDecimal(high, s, len - low_digits, pw);
+    size_t llen = magFromDecimal(a, s + len - low_digits, low_digits, pw);
+    size_t cap = len / BIG_DECIMAL_DIGITS + 2;
+    memset(a + llen, 0, sizeof(uint32_t) * (cap - llen));
+    if (hlen > 0) {
+        size_t plen;
+        uint32_t *prod = magProduct(high, hlen, pw->p[k], pw->len[k], &plen);
+        magAccumulate(a, cap, prod, plen);
+        free(prod);
+    }
+    free(high);
+    return magTrim(a, cap);
+}
+
+tfobj *numberFromDecimal(const char *s, size_t len) {
+    int neg = (len > 0 && *s == '-');
+    if (neg) {
+        s++;
+        len--;
+    }
+    // Each limb holds more than 9 digits, plus one for the final carry
+    uint32_t *limbs = xmalloc(sizeof(uint32_t) * (len / BIG_DECIMAL_DIGITS + 2));
+    decimalPowers pw = {0};
+    size_t n = magFromDecimal(limbs, s, len, &pw);
+    freeDecimalPowers(&pw);
+    return makeNumber(limbs, n, neg);
+}
+
+/**
+ * @brief Write a magnitude as exactly 'width' decimal digits
+ * @param a Value, less than 10^width (consumed: freed or reused)
+ * @param k Level: width is 9 * 2^(k+1), and a < P[k]^2
+ * @param buf Receives the digits, zero padded on the left
+ */
+static void magToDecimal(uint32_t *a, size_t len, int k, char *buf, size_t width,
+                         decimalPowers *pw) {
+    if (len <= BIGINT_DECIMAL_THRESHOLD) {
+        // The remainders by 10^9 are the digit groups, last one first
+        size_t pos = width;
+        while (len > 0) {
+            uint32_t group = magDivSmall(a, len, BIG_DECIMAL_BASE);
+            len = magTrim(a, len);
+            for (int i = 0; i < BIG_DECIMAL_DIGITS; i++) {
+                buf[--pos] = (char)('0' + group % 10);
+                group /= 10;
+            }
+        }
+        memset(buf, '0', pos);
+        free(a);
+        return;
+    }
+
+    // a = q * P[k] + r: q gives the high half of the digits, r the low one
+    if (pw->mu[k] == NULL) {
+        pw->mu[k] = magReciprocal(pw->p[k], pw->len[k], &pw->mulen[k]);
+    }
+    uint32_t *q, *r;
+    size_t qlen, rlen;
+    magDivMod(a, len, pw->p[k], pw->len[k], pw->mu[k], pw->mulen[k], &q, &qlen, &r, &rlen);
+    free(a);
+    magToDecimal(q, qlen, k - 1, buf, width / 2, pw);
+    magToDecimal(r, rlen, k - 1, buf + width / 2, width / 2, pw);
+}
+
+void printNumber(const tfobj *o, tfoutput *out) {
+    if (objType(o) != TFOBJ_TYPE_BIGINT) {
+        outputInt(out, objInt(o));
+        return;
+    }
+    size_t len = o->big.len;
+
+    // Find the level k with value < P[k]^2
+    decimalPowers pw = {0};
+    int k = 0;
+    decimalPower(&pw, 1);
+    while (magCmp(o->big.limbs, len, pw.p[k + 1], pw.len[k + 1]) >= 0) {
+        k++;
+        decimalPower(&pw, k + 1);
+    }
+
+    size_t width = (size_t)BIG_DECIMAL_DIGITS << (k + 1);
+    char *buf = xmalloc(width + 1);
+    uint32_t *a = xmalloc(sizeof(uint32_t) * len);
+    memcpy(a, o->big.limbs, sizeof(uint32_t) * len);
+    magToDecimal(a, len, k, buf, width, &pw);
+    buf[width] = '\0';
+
+    const char *digits = buf;
+    while (*digits == '0') digits++;   // Never zero, it would be an INT
+    if (o->big.neg) outputChar(out, '-');
+    outputText(out, digits, buf + width - digits);
+    free(buf);
+    freeDecimalPowers(&pw);
+}
@@ -0,0 +1,115 @@
+/**
+ * @file bigint.h
+ * @brief Integer arithmetic with overflow promotion to big integers
+ *
+ * Integers are int64_t (TFOBJ_TYPE_INT, usually immediates). An operation
+ * whose result doesn't fit in 64 bits produces a TFOBJ_TYPE_BIGINT
+ * instead, an arbitrary-precision number stored as an array of 32-bit
+ * limbs. Results are always normalized: a value that fits in an int64_t
+ * is never a BIGINT, so two equal numbers have the same type.
+ *
+ * Big products use Karatsuba's method and decimal conversion splits the
+ * number recursively (with Barrett division for printing), so both are
+ * subquadratic; the thresholds are in tf.h.
+ *
+ * The primitives handle the common case (two immediates, no overflow)
+ * inline and only call the number*() functions below on the slow path.
+ */
+
+#ifndef BIGINT_H
+#define BIGINT_H
+#include <stdint.h>
+#include <stdio.h>
+#include "tf.h"
+
+/**
+ * @brief Check whether an object is an integer (INT or BIGINT)
+ */
+static inline int isNumber(const tfobj *o) {
+  int t = objType(o);
+  return t == TFOBJ_TYPE_INT || t == TFOBJ_TYPE_BIGINT;
+}
+
+/*
+ * Overflow-checked int64_t arithmetic: store a op b in *r and return 0,
+ * or return 1 (leaving *r unspecified) if the result doesn't fit. GCC and
+ * Clang compile the builtins to the operation plus a jump on the
+ * overflow flag.
+ */
+
+static inline int addOverflow(int64_t a, int64_t b, int64_t *r) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_add_overflow(a, b, r);
+#else
+  if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) return 1;
+  *r = a + b;
+  return 0;
+#endif
+}
+
+static inline int subOverflow(int64_t a, int64_t b, int64_t *r) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_sub_overflow(a, b, r);
+#else
+  if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b)) return 1;
+  *r = a - b;
+  return 0;
+#endif
+}
+
+static inline int mulOverflow(int64_t a, int64_t b, int64_t *r) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_mul_overflow(a, b, r);
+#else
+  if (a > 0) {
+    if (b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a) return 1;
+  } else if (a < 0) {
+    if (b > 0 ? a < INT64_MIN / b : b < INT64_MAX / a) return 1;
+  }
+  *r = a * b;
+  return 0;
+#endif
+}
+
+/**
+ * @brief Add two integers of any size
+ * @param a First operand (INT or BIGINT, checked by the caller)
+ * @param b Second operand
+ * @return a + b, normalized; a new reference owned by the caller
+ */
+tfobj *numberAdd(const tfobj *a, const tfobj *b);
+
+/**
+ * @brief Subtract two integers of any size
+ * @return a - b, normalized; a new reference owned by the caller
+ */
+tfobj *numberSub(const tfobj *a, const tfobj *b);
+
+/**
+ * @brief Multiply two integers of any size
+ * @return a * b, normalized; a new reference owned by the caller
+ */
+tfobj *numberMul(const tfobj *a, const tfobj *b);
+
+/**
+ * @brief Compare two integers of any size
+ * @return Negative if a < b, 0 if a == b, positive if a > b
+ */
+int numberCompare(const tfobj *a, const tfobj *b);
+
+/**
+ * @brief Build an integer from its decimal digits
+ * @param s Optional '-' followed by one or more digits
+ * @param len Length of the text
+ * @return The value, normalized (a BIGINT only if it needs one)
+ */
+tfobj *numberFromDecimal(const char *s, size_t len);
+
+/**
+ * @brief Print an integer of any size in decimal, without a newline
+ * @param o INT or BIGINT object
+ * @param out Output to print to
+ */
+void printNumber(const tfobj *o, tfoutput *out);
+
+#endif
@@ -0,0 +1,334 @@
+/**
+ * @file bytecode.c
+ * @brief Implementation of the bytecode compiler and threaded interpreter
+ *
+ * The compiler walks a resolved program list once and emits one
+ * instruction per object. The interpreter uses GCC/Clang computed goto
+ * (labels as values) so every instruction jumps straight to the next
+ * handler; other compilers get a portable switch loop instead.
+ */
+
+#include <stdlib.h>
+
+#include "bytecode.h"
+#include "tf.h"
+#include "mem.h"
+#include "stack.h"
+#include "control.h"
+
+#if defined(__GNUC__) && !defined(TF_NO_THREADED)
+#define TF_THREADED 1
+#endif
+
+/* ===================== Interpreter =================== */
+
+/**
+ * @brief The dispatch loop shared by execCode() and the compiler
+ * @param ctx Execution context
+ * @param ip First instruction to run
+ * @param labels If not NULL, receives the handler table and nothing runs
+ *
+ * With direct threading the handler addresses only exist inside this
+ * function, so the compiler calls it once with 'labels' set to learn them.
+ */
+static void runCode(tfctx *ctx, const tfcell *ip, const void *const **labels) {
+#ifdef TF_THREADED
+  static const void *const handlers[TFOP_COUNT] = {
+    [TFOP_END] = &&op_end,
+    [TFOP_LIT] = &&op_lit,
+    [TFOP_PUSH] = &&op_push,
+    [TFOP_PRIM] = &&op_prim,
+    [TFOP_CALL] = &&op_call,
+    [TFOP_CHECK] = &&op_check,
+    [TFOP_JUMP] = &&op_jump,
+    [TFOP_JUMPF] = &&op_jumpf,
+    [TFOP_DO] = &&op_do,
+    [TFOP_LOOP] = &&op_loop,
+    [TFOP_TAILCALL] = &&op_tailcall,
+  };
+  if (labels) {
+    *labels = handlers;
+    return;
+  }
+#define VM_START() goto *(ip++)->label;
+#define VM_OP(op, name) name:
+#define VM_NEXT() goto *(ip++)->label
+#define VM_FINISH()
+#else
+  if (labels) {
+    *labels = NULL;
+    return;
+  }
+#define VM_START() for (;;) switch ((ip++)->op) {
+#define VM_OP(op, name) case op:
+#define VM_NEXT() continue
+#define VM_FINISH() }
+#endif
+
+  size_t base = ctx->rsp;   // Frames below belong to whoever called us
+
+  VM_START()
+
+  VM_OP(TFOP_LIT, op_lit) {
+    // Immediates need no refcount, push inline unless the stack must grow
+    tfobj *o = (ip++)->obj;
+    if (ctx->sp < ctx->capacity) {
+      ctx->stack[ctx->sp++] = o;
+      stackTrackDepth(ctx);
+    } else {
+      stackPush(ctx, o);
+    }
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_PUSH, op_push) {
+    stackPush(ctx, (ip++)->obj);
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_PRIM, op_prim) {
+    WordFn fn = ip[0].fn;
+    ctx->current_object = ip[1].obj;
+    ip += 2;
+    fn(ctx);
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_CALL, op_call) {
+    tfobj *word = ip[0].obj;
+    ctx->current_object = ip[1].obj;
+    returnPush(ctx)->ip = ip + 2;
+    ip = word->word.code;
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_TAILCALL, op_tailcall) {
+    tfobj *word = ip[0].obj;
+    ctx->current_object = ip[1].obj;
+    ip = word->word.code;
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_CHECK, op_check) {
+    tfobj *sym = (ip++)->obj;
+    if (ctx->sp < (size_t)sym->sym.need) {
+      stackUnderflowError(ctx, sym);
+    }
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_JUMP, op_jump) {
+    ip = ip[0].jump;
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_JUMPF, op_jumpf) {
+    ctx->current_object = ip[1].obj;
+    ip = popCondition(ctx) ? ip + 2 : ip[0].jump;
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_DO, op_do) {
+    ctx->current_object = ip[1].obj;
+    ip = enterLoop(ctx) ? ip + 2 : ip[0].jump;
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_LOOP, op_loop) {
+    ip = nextLoop(ctx) ? ip[0].jump : ip + 1;
+    VM_NEXT();
+  }
+
+  VM_OP(TFOP_END, op_end) {
+    if (ctx->rsp == base) {
+      return;
+    }
+    ip = ctx->rstack[--ctx->rsp].ip;
+    VM_NEXT();
+  }
+
+  VM_FINISH()
+
+#undef VM_START
+#undef VM_OP
+#undef VM_NEXT
+#undef VM_FINISH
+}
+
+void execCode(tfctx *ctx, const tfcell *code) {
+  runCode(ctx, code, NULL);
+}
+
+/* ===================== Compiler =================== */
+
+/**
+ * @brief Growable buffer of cells used while compiling
+ */
+typedef struct codeBuffer {
+  tfcell *cells;
+  size_t len;
+  size_t capacity;
+  const void *const *labels;   /**< Handler table, NULL for switch dispatch */
+} codeBuffer;
+
+/**
+ * @brief Append one cell to the buffer
+ */
+static void emitCell(codeBuffer *b, tfcell c) {
+  if (b->len >= b->capacity) {
+    b->capacity = b->capacity * 2;
+    b->cells = xrealloc(b->cells, sizeof(tfcell) * b->capacity);
+  }
+  b->cells[b->len++] = c;
+}
+
+/**
+ * @brief Append an opcode cell, in the form the interpreter dispatches on
+ */
+static void emitOp(codeBuffer *b, int op) {
+  tfcell c;
+  if (b->labels) {
+    c.label = b->labels[op];
+  } else {
+    c.op = op;
+  }
+  emitCell(b, c);
+}
+
+/**
+ * @brief Append an object operand cell
+ */
+static void emitObj(codeBuffer *b, tfobj *o) {
+  tfcell c;
+  c.obj = o;
+  emitCell(b, c);
+}
+
+/**
+ * @brief Append a primitive operand cell
+ */
+static void emitFn(codeBuffer *b, WordFn fn) {
+  tfcell c;
+  c.fn = fn;
+  emitCell(b, c);
+}
+
+/**
+ * @brief Append a jump operand cell, to be patched once the code is complete
+ * @param patch Receives the operand's cell index
+ */
+static void emitJump(codeBuffer *b, size_t *patch) {
+  tfcell c;
+  c.jump = NULL;
+  *patch = b->len;
+  emitCell(b, c);
+}
+
+/**
+ * @brief Emit the instruction of a control symbol
+ * @param patch Receives the cell index of its jump operand, if any
+ */
+static void emitControl(codeBuffer *b, tfobj *o, size_t *patch) {
+  switch (o->sym.control) {
+    case TFCTRL_IF:
+    case TFCTRL_UNTIL:
+      emitOp(b, TFOP_JUMPF);
+      emitJump(b, patch);
+      emitObj(b, o);
+      break;
+    case TFCTRL_ELSE:
+      emitOp(b, TFOP_JUMP);
+      emitJump(b, patch);
+      break;
+    case TFCTRL_DO:
+      emitOp(b, TFOP_DO);
+      emitJump(b, patch);
+      emitObj(b, o);
+      break;
+    case TFCTRL_LOOP:
+      emitOp(b, TFOP_LOOP);
+      emitJump(b, patch);
+      break;
+    default:
+      break;   // then, begin: only jump targets
+  }
+}
+
+/**
+ * @brief Lower one list into bytecode
+ * @param self Word whose body this is, or NULL for a program: 'recurse'
+ *             calls it before its code exists, so it is not compiled again
+ */
+static tfcell *compileList(tfobj *program, tfobj *self) {
+  size_t len = program->list.len;
+  codeBuffer b;
+  b.len = 0;
+  b.capacity = len * 2 + 1;
+  b.cells = xmalloc(sizeof(tfcell) * b.capacity);
+  runCode(NULL, NULL, &b.labels);
+
+  /* Jump targets are list indexes: remember where each object's code
+   * starts, and which cells hold a jump, then patch them at the end
+   * (the buffer may move while it grows). */
+  size_t *pos = xmalloc(sizeof(size_t) * (len + 1));
+  size_t *patch = xmalloc(sizeof(size_t) * (len + 1));
+
+  for (size_t i = 0; i < len; i++) {
+    tfobj *o = program->list.ele[i];
+    pos[i] = b.len;
+    patch[i] = 0;   // Cell 0 is always an opcode, never a jump operand
+    switch (objType(o)) {
+      case TFOBJ_TYPE_SYMBOL: {
+        tfobj *word = o->sym.word;
+        if (o->sym.need > 0) {
+          emitOp(&b, TFOP_CHECK);
+          emitObj(&b, o);
+        }
+        if (o->sym.control) {
+          emitControl(&b, o, &patch[i]);
+          break;
+        }
+        if (o->sym.fn) {
+          emitOp(&b, TFOP_PRIM);
+          emitFn(&b, o->sym.fn);
+        } else {
+          if (word != self && word->word.code == NULL) {
+            word->word.code = compileList(word->word.body, word);
+          }
+          emitOp(&b, o->sym.tail ? TFOP_TAILCALL : TFOP_CALL);
+          emitObj(&b, word);
+        }
+        emitObj(&b, o);
+        break;
+      }
+      case TFOBJ_TYPE_WORD:
+        // Installed in the dictionary by the linker, nothing to run
+        break;
+      default:
+        emitOp(&b, isImmediate(o) ? TFOP_LIT : TFOP_PUSH);
+        emitObj(&b, o);
+        break;
+    }
+  }
+  pos[len] = b.len;
+  emitOp(&b, TFOP_END);
+
+  for (size_t i = 0; i < len; i++) {
+    if (patch[i] == 0) continue;
+    b.cells[patch[i]].jump = b.cells + pos[program->list.ele[i]->sym.target];
+  }
+  free(pos);
+  free(patch);
+  return b.cells;
+}
+
+tfcell *compileCode(tfobj *program) {
+  return compileList(program, NULL);
+}
+
+void execQuotation(tfctx *ctx, tfobj *quot) {
+  if (quot->list.code == NULL) {
+    quot->list.code = compileCode(quot);
+  }
+  execCode(ctx, quot->list.code);
+}
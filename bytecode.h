@@ -0,0 +1,94 @@
+/**
+ * @file bytecode.h
+ * @brief Bytecode compiler and threaded interpreter
+ *
+ * Lowers a resolved program list into a flat stream of tfcell instructions
+ * with inline operands, and runs it with a direct-threaded dispatch loop
+ * (computed goto). This is the default execution engine; the list-walking
+ * exec() in main.c is kept as a reference implementation.
+ */
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+#include "tf.h"
+
+/* ===================== Instruction set =================== */
+
+/** @brief Return to the caller, or leave execCode() at the top level ( -- ) */
+#define TFOP_END 0
+
+/** @brief Push an immediate literal: [LIT obj] */
+#define TFOP_LIT 1
+
+/** @brief Push a heap object literal: [PUSH obj] */
+#define TFOP_PUSH 2
+
+/** @brief Call a primitive: [PRIM fn symbol] */
+#define TFOP_PRIM 3
+
+/** @brief Call a colon definition: [CALL word symbol] */
+#define TFOP_CALL 4
+
+/** @brief Check the stack depth for the next word: [CHECK symbol] */
+#define TFOP_CHECK 5
+
+/** @brief Jump unconditionally ('else'): [JUMP target] */
+#define TFOP_JUMP 6
+
+/** @brief Pop a flag, jump if it is false ('if', 'until'): [JUMPF target symbol] */
+#define TFOP_JUMPF 7
+
+/** @brief Enter a counted loop or jump past it ('do'): [DO target symbol] */
+#define TFOP_DO 8
+
+/** @brief Next iteration, jump back while the loop runs ('loop'): [LOOP target] */
+#define TFOP_LOOP 9
+
+/** @brief Call a colon definition in place of the current one: [TAILCALL word symbol] */
+#define TFOP_TAILCALL 10
+
+/** @brief Number of opcodes */
+#define TFOP_COUNT 11
+
+/* ===================== Compile & run =================== */
+
+/**
+ * @brief Lower a resolved program list into bytecode
+ * @param program List object that already went through resolveSymbols()
+ * @return Newly allocated code stream, terminated by TFOP_END; the caller
+ *         must free() it
+ *
+ * Operands point at objects owned by 'program' (and by the dictionary),
+ * so the code must not outlive them. A CHECK is only emitted in front of
+ * the words whose depth check analyzeStack() could not remove. Colon
+ * definitions called from the program are lowered too, once, into their
+ * word.code. Control words become jumps to code addresses ('then' and
+ * 'begin' emit nothing).
+ */
+tfcell *compileCode(tfobj *program);
+
+/**
+ * @brief Run a code stream until its TFOP_END
+ * @param ctx Execution context (contains the stack)
+ * @param code Code stream returned by compileCode()
+ *
+ * Like exec(), the symbol being executed is tracked in ctx->current_object
+ * for error reporting, and calls to colon definitions don't nest C calls:
+ * CALL pushes the return address on ctx->rstack and jumps to the word's
+ * code, END pops it, and TAILCALL (a call right before the end of a body)
+ * just jumps.
+ */
+void execCode(tfctx *ctx, const tfcell *code);
+
+/**
+ * @brief Run a quotation on the bytecode VM, the ctx->run_quotation of
+ *        execCode()
+ * @param ctx Execution context
+ * @param quot Linked quotation (see callQuotation())
+ *
+ * The code is compiled on the first call and kept in quot->list.code
+ * until the list changes.
+ */
+void execQuotation(tfctx *ctx, tfobj *quot);
+
+#endif
@@ -0,0 +1,199 @@
+/**
+ * @file control.c
+ * @brief Implementation of the control flow words
+ *
+ * Branch targets are list indexes. linkBranches() pairs the words with
+ * a stack of the ones still open, like matching parentheses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "control.h"
+#include "tf.h"
+#include "mem.h"
+#include "intern.h"
+#include "stack.h"
+
+/**
+ * @brief Stack effect of each control word, indexed by TFCTRL_*
+ */
+static const struct {
+    int in;
+    int out;
+} controlEffects[] = {
+    {0, 0},   // Not a control word
+    {1, 0},   // if
+    {0, 0},   // else
+    {0, 0},   // then
+    {0, 0},   // begin
+    {1, 0},   // until
+    {2, 0},   // do
+    {0, 0},   // loop
+};
+
+/* ===================== Compile time =================== */
+
+void markControl(tfobj *o) {
+    if (objType(o) != TFOBJ_TYPE_SYMBOL || o->sym.id < TFSYM_IF || o->sym.id > TFSYM_LOOP) {
+        return;
+    }
+    // The words are interned in TFCTRL_* order, see intern.h
+    int kind = (int)(o->sym.id - TFSYM_IF) + TFCTRL_IF;
+    o->sym.control = kind;
+    o->sym.in = controlEffects[kind].in;
+    o->sym.out = controlEffects[kind].out;
+    o->sym.need = o->sym.in;
+}
+
+/**
+ * @brief Report a control word with no matching opening word
+ */
+static void unmatchedError(tfobj *o, const char *opener) {
+    char error_msg[256];
+    snprintf(error_msg, sizeof(error_msg), "'%s' without a matching '%s'",
+             o->sym.ptr, opener);
+    compileError(o, error_msg);
+}
+
+/**
+ * @brief Set sym.tail on the words after which the list is done
+ *
+ * That is, when the rest of the list is only jumps to its end ('else')
+ * and words that do nothing ('then'). Walking backwards, every index a
+ * word can go on to is already known.
+ */
+static void markTailCalls(tfobj *list) {
+    size_t len = list->list.len;
+    char *done = xmalloc(len + 1);   // Whether reaching index i ends the list
+    done[len] = 1;
+    for (size_t i = len; i-- > 0;) {
+        tfobj *o = list->list.ele[i];
+        int control = objType(o) == TFOBJ_TYPE_SYMBOL ? o->sym.control : -1;
+        if (control == TFCTRL_THEN || control == TFCTRL_BEGIN) {
+            done[i] = done[i + 1];
+        } else if (control == TFCTRL_ELSE) {
+            done[i] = done[o->sym.target];
+        } else {
+            done[i] = 0;
+        }
+        if (control == 0) o->sym.tail = done[i + 1];
+    }
+    free(done);
+}
+
+void linkBranches(tfobj *list) {
+    tfobj **ele = list->list.ele;
+    size_t *open = NULL;     // Indexes of the words waiting for their match
+    size_t depth = 0, capacity = 0;
+
+    for (size_t i = 0; i < list->list.len; i++) {
+        tfobj *o = ele[i];
+        if (objType(o) != TFOBJ_TYPE_SYMBOL || o->sym.control == 0) continue;
+
+        int kind = o->sym.control;
+        tfobj *top = depth > 0 ? ele[open[depth - 1]] : NULL;
+        int top_kind = top ? top->sym.control : 0;
+        o->sym.target = i + 1;
+
+        switch (kind) {
+            case TFCTRL_ELSE:
+                if (top_kind != TFCTRL_IF) unmatchedError(o, "if");
+                top->sym.target = i + 1;
+                open[depth - 1] = i;     // 'then' now closes the 'else'
+                continue;
+            case TFCTRL_THEN:
+                if (top_kind != TFCTRL_IF && top_kind != TFCTRL_ELSE) unmatchedError(o, "if");
+                top->sym.target = i + 1;
+                depth--;
+                continue;
+            case TFCTRL_UNTIL:
+                if (top_kind != TFCTRL_BEGIN) unmatchedError(o, "begin");
+                o->sym.target = open[depth - 1] + 1;
+                top->sym.target = i + 1;
+                depth--;
+                continue;
+            case TFCTRL_LOOP:
+                if (top_kind != TFCTRL_DO) unmatchedError(o, "do");
+                o->sym.target = open[depth - 1] + 1;
+                top->sym.target = i + 1;
+                depth--;
+                continue;
+            default:
+                // if, begin, do: wait for the closing word
+                if (depth == capacity) {
+                    capacity = capacity ? capacity * 2 : 16;
+                    open = xrealloc(open, sizeof(size_t) * capacity);
+                }
+                open[depth++] = i;
+                continue;
+        }
+    }
+
+    if (depth > 0) {
+        static const char *const closers[] = {
+            NULL, "then", "then", NULL, "until", NULL, "loop"
+        };
+        tfobj *o = ele[open[depth - 1]];
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "Unterminated '%s', missing '%s'",
+                 o->sym.ptr, closers[o->sym.control]);
+        compileError(o, error_msg);
+    }
+    free(open);
+    markTailCalls(list);
+    list->list.linked = 1;
+}
+
+/* ===================== Run time =================== */
+
+int popConditionSlow(tfctx *ctx) {
+    tfobj *c = stackPeek(ctx, 0);
+    if (objType(c) != TFOBJ_TYPE_BIGINT) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg),
+                 "'%s' requires a boolean or an integer", ctx->current_object->sym.ptr);
+        runtimeError(ctx, error_msg);
+    }
+    // Big integers are never zero
+    stackDrop(ctx, 1);
+    return 1;
+}
+
+int enterLoop(tfctx *ctx) {
+    tfobj *start = ctx->stack[ctx->sp - 1];
+    tfobj *limit = ctx->stack[ctx->sp - 2];
+    if (objType(start) != TFOBJ_TYPE_INT || objType(limit) != TFOBJ_TYPE_INT) {
+        runtimeError(ctx, "'do' requires two integers ( limit start -- )");
+    }
+    int64_t i = objInt(start);
+    int64_t n = objInt(limit);
+    stackDrop(ctx, 2);
+    if (i >= n) {
+        return 0;
+    }
+    if (ctx->loop_sp == ctx->loop_capacity) {
+        ctx->loops = xrealloc(ctx->loops, sizeof(tfloop) * ctx->loop_capacity * 2);
+        ctx->loop_capacity *= 2;
+    }
+    ctx->loops[ctx->loop_sp].index = i;
+    ctx->loops[ctx->loop_sp].limit = n;
+    ctx->loop_sp++;
+    return 1;
+}
+
+size_t runControl(tfctx *ctx, tfobj *o, size_t next) {
+    switch (o->sym.control) {
+        case TFCTRL_IF:
+        case TFCTRL_UNTIL:
+            return popCondition(ctx) ? next : o->sym.target;
+        case TFCTRL_ELSE:
+            return o->sym.target;
+        case TFCTRL_DO:
+            return enterLoop(ctx) ? next : o->sym.target;
+        case TFCTRL_LOOP:
+            return nextLoop(ctx) ? o->sym.target : next;
+        default:
+            return next;   // then, begin
+    }
+}
@@ -0,0 +1,115 @@
+/**
+ * @file control.h
+ * @brief Control flow words: if/else/then, begin/until, do/loop
+ *
+ * The parser turns these words into control symbols (sym.control set,
+ * no dictionary entry) and linkBranches() stores in each one the list
+ * index it jumps to. Running them is an index or code pointer assignment,
+ * no VM ever searches for the matching word at run time.
+ *
+ *   c if A else B then   runs A if c is true (nonzero), B otherwise
+ *   begin A c until      runs A until c is true
+ *   n m do A loop        runs A with i = m, m+1, ... n-1 (not at all if m >= n)
+ *
+ * Control words are the only places where execution doesn't just go on
+ * with the next object, so the compile-time passes treat them as barriers:
+ * nothing is folded or fused across one, and the stack analysis follows
+ * their branches.
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+#include "tf.h"
+
+/* ===================== Control words =================== */
+
+/** @brief 'if' ( flag -- ): jumps past 'else' (or 'then') if flag is false */
+#define TFCTRL_IF 1
+
+/** @brief 'else' ( -- ): end of the true branch, jumps past 'then' */
+#define TFCTRL_ELSE 2
+
+/** @brief 'then' ( -- ): end of the conditional, does nothing */
+#define TFCTRL_THEN 3
+
+/** @brief 'begin' ( -- ): start of a loop, does nothing; target is the exit */
+#define TFCTRL_BEGIN 4
+
+/** @brief 'until' ( flag -- ): jumps back after 'begin' if flag is false */
+#define TFCTRL_UNTIL 5
+
+/** @brief 'do' ( limit start -- ): enters the loop, or jumps past 'loop' */
+#define TFCTRL_DO 6
+
+/** @brief 'loop' ( -- ): next index, jumps back after 'do' until the limit */
+#define TFCTRL_LOOP 7
+
+/**
+ * @brief Turn a symbol into a control symbol if it names a control word
+ * @param o Newly parsed object (anything)
+ *
+ * Sets sym.control and the stack effect (sym.in, sym.out, sym.need).
+ * Other objects are left alone.
+ */
+void markControl(tfobj *o);
+
+/**
+ * @brief Match the control words of a list and set their jump targets
+ * @param list Program or body list (not its nested definitions)
+ *
+ * Reports unmatched words with compileError(). The passes that remove
+ * objects from a list call it again, since the indexes move. Also sets
+ * sym.tail on the words that end the list, which the VMs run as tail
+ * calls.
+ */
+void linkBranches(tfobj *list);
+
+/* ===================== Run time =================== */
+
+/**
+ * @brief Pop the flag of 'if' or 'until', slow path of popCondition()
+ */
+int popConditionSlow(tfctx *ctx);
+
+/**
+ * @brief Pop a flag: booleans, or integers with 0 meaning false
+ * @param ctx Execution context, current_object being the control word
+ * @return Nonzero if the flag is true
+ */
+static inline int popCondition(tfctx *ctx) {
+  tfobj *c = ctx->stack[ctx->sp - 1];
+  if (isImmediate(c)) {
+    ctx->sp--;
+    return objInt(c) != 0;
+  }
+  return popConditionSlow(ctx);
+}
+
+/**
+ * @brief Run 'do': pop the limit and start, and push a loop frame
+ * @return Nonzero if the loop runs, 0 if it must be skipped (start >= limit)
+ */
+int enterLoop(tfctx *ctx);
+
+/**
+ * @brief Run 'loop': advance the innermost loop
+ * @return Nonzero to run the body again; 0 once it is done (frame popped)
+ */
+static inline int nextLoop(tfctx *ctx) {
+  tfloop *l = &ctx->loops[ctx->loop_sp - 1];
+  if (++l->index < l->limit) {
+    return 1;
+  }
+  ctx->loop_sp--;
+  return 0;
+}
+
+/**
+ * @brief Run a control symbol in a list-walking VM
+ * @param o The control symbol (its depth was already checked)
+ * @param next Index of the object after it
+ * @return Index of the object to run next
+ */
+size_t runControl(tfctx *ctx, tfobj *o, size_t next);
+
+#endif
@@ -1,53 +1,323 @@
 /**
  * @file dict.c
- * @brief Implementation of the primitive dictionary
+ * @brief Implementation of the word dictionary
  *
- * Maps symbol names to their C implementation functions. Uses a simple
- * linear search table, which is efficient enough for the small number
- * of primitives typically defined.
+ * The dictionary is an array of word objects indexed by the intern id of
+ * their name (see intern.h), so no string comparison happens here. It is
+ * seeded from the static primitive table and grows with colon definitions
+ * at link time. Child dictionaries hash the ids instead (see tfdict).
  */
 
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "dict.h"
+#include "mem.h"
 #include "primitives.h"
+#include "analyze.h"
+#include "intern.h"
 
-/* ===================== Primitive Dictionary =================== */
+/* ===================== Primitive table =================== */
 
 /**
  * @brief Internal structure mapping a name to a function
  *
  * Each entry in the primitive table maps a symbol name (like "+")
- * to its implementation function.
+ * to its implementation function, along with its stack effect
+ * ( in -- out ) and TFWORD_* flags.
  */
 typedef struct PrimitiveEntry {
     const char *name;
     WordFn fn;
+    int in;
+    int out;
+    int flags;
 } PrimitiveEntry;
 
 /**
  * @brief Table of all built-in primitives
  *
- * This table maps symbol names to their implementation functions.
+ * This table maps symbol names to their implementation functions and is
+ * loaded into every new dictionary by createDict().
  * To add a new primitive: add an entry here, implement the function
  * in primitives.c, and declare it in primitives.h.
  *
+ * The stack effect must be exact: the VM checks 'in' before the call
+ * (primitives don't check depth themselves), and the static analysis
+ * relies on both numbers. Mark a word TFWORD_PURE only if it has no side
+ * effects, so that constant folding may run it at compile time.
+ *
  * The table is terminated with a {NULL, NULL} sentinel.
  */
 static const PrimitiveEntry primitiveMappings[] = {
-{"+", primitiveAdd},
-{"-", primitiveSub},
-{"*", primitiveMul},
-{".", primitivePrint},
-{"dup", primitiveDuplicate},
-{"drop", primitiveDrop},
-{"swap", primitiveSwap},
-{NULL, NULL} // Sentinel marking end of table
+{"+", primitiveAdd, 2, 1, TFWORD_PURE},
+{"-", primitiveSub, 2, 1, TFWORD_PURE},
+{"*", primitiveMul, 2, 1, TFWORD_PURE},
+{".", primitivePrint, 1, 0, 0},
+{"dup", primitiveDuplicate, 1, 2, TFWORD_PURE},
+{"drop", primitiveDrop, 1, 0, TFWORD_PURE},
+{"swap", primitiveSwap, 2, 2, TFWORD_PURE},
+{"over", primitiveOver, 2, 3, TFWORD_PURE},
+{"rot", primitiveRot, 3, 3, TFWORD_PURE},
+{"-rot", primitiveMinusRot, 3, 3, TFWORD_PURE},
+{"nip", primitiveNip, 2, 1, TFWORD_PURE},
+{"tuck", primitiveTuck, 2, 3, TFWORD_PURE},
+{"2dup", primitiveTwoDup, 2, 4, TFWORD_PURE},
+{"pick", primitivePick, 1, 1, 0},   // Also reads u values below, see primitivePick()
+{"roll", primitiveRoll, 1, 0, 0},
+{".stats", primitiveStats, 0, 0, 0},
+{"flush", primitiveFlush, 0, 0, 0},
+{"cr", primitiveCr, 0, 0, 0},
+{"emit", primitiveEmit, 1, 0, 0},
+{"type", primitiveType, 1, 0, 0},
+{"=", primitiveEqual, 2, 1, TFWORD_PURE},
+{"<>", primitiveNotEqual, 2, 1, TFWORD_PURE},
+{"<", primitiveLess, 2, 1, TFWORD_PURE},
+{">", primitiveGreater, 2, 1, TFWORD_PURE},
+{"<=", primitiveLessEqual, 2, 1, TFWORD_PURE},
+{">=", primitiveGreaterEqual, 2, 1, TFWORD_PURE},
+{"i", primitiveLoopIndex, 0, 1, 0},   // Reads the loop stack, see control.h
+{"map", primitiveMap, 2, 1, 0},
+{"filter", primitiveFilter, 2, 1, 0},
+{"fold", primitiveFold, 3, 1, 0},
+{"each", primitiveEach, 2, TFEFFECT_UNKNOWN, 0},   // Whatever the quotation does
+{"len", primitiveLength, 1, 1, 0},
+{"nth", primitiveNth, 2, 1, 0},
+{"concat", primitiveConcat, 2, 1, 0},
+{"iota", primitiveIota, 1, 1, 0},
+{">vec", primitiveToVector, 1, 1, 0},
+{"vsum", primitiveVectorSum, 1, 1, 0},
+{"vdot", primitiveVectorDot, 2, 1, 0},
+{"vadd", primitiveVectorAdd, 2, 1, 0},
+{"vmul", primitiveVectorMul, 2, 1, 0},
+{"vscale", primitiveVectorScale, 2, 1, 0},
+{"vmin", primitiveVectorMin, 1, 1, 0},
+{"vmax", primitiveVectorMax, 1, 1, 0},
+{NULL, NULL, 0, 0, 0} // Sentinel marking end of table
 };
 
-WordFn lookupPrimitive(const char *name) {
+/* ===================== Slots =================== */
+
+/**
+ * @brief Make sure the dictionary has a slot for a symbol id
+ *
+ * Slots grow by doubling, so defining n words costs O(n) overall.
+ */
+static void dictReserve(tfdict *dict, uint32_t id) {
+    if (id < dict->capacity) {
+        return;
+    }
+    size_t capacity = dict->capacity;
+    while (capacity <= id) {
+        capacity *= 2;
+    }
+    dict->slots = xrealloc(dict->slots, sizeof(tfobj *) * capacity);
+    memset(dict->slots + dict->capacity, 0,
+           sizeof(tfobj *) * (capacity - dict->capacity));
+    dict->capacity = capacity;
+}
+
+/**
+ * @brief Find the slot of a symbol id in a child dictionary
+ * @return Its index, or that of the empty slot where it belongs
+ */
+static size_t findChildSlot(const tfdict *dict, uint32_t id) {
+    size_t mask = dict->capacity - 1;
+    uint32_t h = id * 0x9E3779B9u;
+    size_t i = (h ^ (h >> 16)) & mask;
+    while (dict->slots[i] != NULL && dict->ids[i] != id) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/**
+ * @brief Double the hash table of a child dictionary and rehash its words
+ */
+static void growChild(tfdict *dict) {
+    tfobj **old_slots = dict->slots;
+    uint32_t *old_ids = dict->ids;
+    size_t old_capacity = dict->capacity;
+
+    dict->capacity *= 2;
+    dict->slots = xmalloc(sizeof(tfobj *) * dict->capacity);
+    memset(dict->slots, 0, sizeof(tfobj *) * dict->capacity);
+    dict->ids = xmalloc(sizeof(uint32_t) * dict->capacity);
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i] == NULL) continue;
+        size_t j = findChildSlot(dict, old_ids[i]);
+        dict->slots[j] = old_slots[i];
+        dict->ids[j] = old_ids[i];
+    }
+    free(old_slots);
+    free(old_ids);
+}
+
+/**
+ * @brief Get the slot a symbol id is stored in, making room for it
+ */
+static tfobj **dictSlot(tfdict *dict, uint32_t id) {
+    if (dict->ids == NULL) {
+        dictReserve(dict, id);
+        return &dict->slots[id];
+    }
+    if ((dict->count + 1) * 4 > dict->capacity * 3) {
+        growChild(dict);
+    }
+    size_t i = findChildSlot(dict, id);
+    dict->ids[i] = id;
+    return &dict->slots[i];
+}
+
+/* ===================== Dictionary =================== */
+
+/**
+ * @brief Allocate an empty dictionary
+ * @param capacity Initial number of slots
+ * @param hashed Whether slots are a hash table (child dictionaries)
+ */
+static tfdict *allocDict(size_t capacity, int hashed) {
+    tfdict *dict = xmalloc(sizeof(tfdict));
+    dict->capacity = capacity;
+    dict->count = 0;
+    dict->slots = xmalloc(sizeof(tfobj *) * dict->capacity);
+    memset(dict->slots, 0, sizeof(tfobj *) * dict->capacity);
+    dict->ids = hashed ? xmalloc(sizeof(uint32_t) * dict->capacity) : NULL;
+    dict->base = NULL;
+    return dict;
+}
+
+tfdict *createChildDict(const tfdict *base) {
+    tfdict *dict = allocDict(CHILD_DICT_CAPACITY, 1);
+    dict->base = base;
+    return dict;
+}
+
+tfdict *createDict(void) {
+    tfdict *dict = allocDict(INITIAL_DICT_CAPACITY, 0);
     for (size_t i = 0; primitiveMappings[i].name != NULL; i++) {
-        if (strcmp(name, primitiveMappings[i].name) == 0) return primitiveMappings[i].fn;
+        const char *s = primitiveMappings[i].name;
+        tfobj *name = createSymbolObject(s, strlen(s));
+        tfobj *word = createWordObject(name, primitiveMappings[i].fn, NULL);
+        word->word.in = primitiveMappings[i].in;
+        word->word.out = primitiveMappings[i].out;
+        word->word.flags = primitiveMappings[i].flags;
+        dictDefine(dict, word);
+        decRef(word);
+        decRef(name);
+    }
+    return dict;
+}
+
+void freeDict(tfdict *dict) {
+    for (size_t i = 0; i < dict->capacity; i++) {
+        decRef(dict->slots[i]);
+    }
+    free(dict->slots);
+    free(dict->ids);
+    free(dict);
+}
+
+tfobj *dictLookup(const tfdict *dict, uint32_t id) {
+    tfobj *word = NULL;
+    if (dict->ids != NULL) {
+        word = dict->slots[findChildSlot(dict, id)];
+    } else if (id < dict->capacity) {
+        word = dict->slots[id];
+    }
+    if (word) {
+        return word;
+    }
+    return dict->base ? dictLookup(dict->base, id) : NULL;
+}
+
+void dictDefine(tfdict *dict, tfobj *word) {
+    tfobj **slot = dictSlot(dict, word->word.name->sym.id);
+
+    incRef(word);
+    if (*slot == NULL) {
+        dict->count++;
+    } else {
+        // The new word takes over the dictionary's reference to the old one
+        decRef(word->word.prev);
+        word->word.prev = *slot;
+    }
+    *slot = word;
+}
+
+/* ===================== Linking =================== */
+
+/**
+ * @brief Give the 'recurse' calls of a word its computed stack effect
+ *
+ * They count as needing no values while the body's effect is computed,
+ * and as changing the depth by an unknown amount (a recursive word's
+ * effect depends on how deep it recurses), so the word itself gets
+ * TFEFFECT_UNKNOWN if any path recurses. Each call then checks the
+ * depth the word needs, like any other call.
+ */
+static void bindRecursion(tfobj *word, tfobj *list) {
+    for (size_t i = 0; i < list->list.len; i++) {
+        tfobj *o = list->list.ele[i];
+        if (objType(o) == TFOBJ_TYPE_LIST) {
+            bindRecursion(word, o);   // Quotations in the body
+        } else if (objType(o) == TFOBJ_TYPE_SYMBOL && o->sym.id == TFSYM_RECURSE) {
+            o->sym.in = word->word.in;
+            o->sym.need = word->word.in;
+        }
+    }
+}
+
+/**
+ * @brief Bind the symbols of one list
+ * @param self Word whose body this is (the target of 'recurse'), or NULL
+ */
+static void resolveList(tfdict *dict, tfobj *program, tfobj *self) {
+    for (size_t i = 0; i < program->list.len; i++) {
+        tfobj *o = program->list.ele[i];
+
+        if (objType(o) == TFOBJ_TYPE_WORD) {
+            // Resolve the body first: the word can't see itself yet
+            resolveList(dict, o->word.body, o);
+            computeStackEffect(o->word.body, &o->word.in, &o->word.out);
+            bindRecursion(o, o->word.body);
+            dictDefine(dict, o);
+            continue;
+        }
+        if (objType(o) == TFOBJ_TYPE_LIST) {
+            // A quotation's words are bound where it's written
+            resolveList(dict, o, self);
+            continue;
+        }
+        // Control symbols run in the VM, the parser already linked them
+        if (objType(o) != TFOBJ_TYPE_SYMBOL || o->sym.control) continue;
+
+        if (o->sym.id == TFSYM_RECURSE) {
+            if (self == NULL) {
+                compileError(o, "'recurse' outside of a definition");
+            }
+            // The effect is only known once the body is: see bindRecursion()
+            o->sym.word = self;
+            o->sym.out = TFEFFECT_UNKNOWN;
+            continue;
+        }
+
+        tfobj *word = dictLookup(dict, o->sym.id);
+        if (word == NULL) {
+            char error_msg[256];
+            snprintf(error_msg, sizeof(error_msg), "Unknown word '%s'", o->sym.ptr);
+            compileError(o, error_msg);
+        }
+        o->sym.word = word;
+        o->sym.fn = word->word.fn;
+        o->sym.in = word->word.in;
+        o->sym.out = word->word.out;
+        o->sym.need = word->word.in;
     }
-    return NULL;
-}
\ No newline at end of file
+}
+
+void resolveSymbols(tfdict *dict, tfobj *program) {
+    resolveList(dict, program, NULL);
+}
@@ -1,33 +1,87 @@
 /**
  * @file dict.h
- * @brief Primitive word dictionary and lookup
+ * @brief Word dictionary, lookup and linking
  *
- * Maps symbol names to their corresponding C implementation functions.
- * All primitives have a uniform signature for easy dispatch.
+ * Maps symbol names to word objects. A word is either a primitive (a C
+ * function with a uniform signature) or a colon definition (a compiled
+ * body list). Names are interned, and the dictionary is indexed by their
+ * id, so lookup is a single array access no matter how many words a
+ * program defines (a short probe in a child dictionary).
  */
 
 #ifndef DICT_H
 #define DICT_H
+#include <stddef.h>
+#include <stdint.h>
 #include "tf.h"
 
 /**
- * @brief Function pointer type for primitive word implementations
+ * @brief Create a dictionary pre-populated with all primitives
+ * @return New dictionary, to be freed with freeDict()
+ */
+tfdict *createDict(void);
+
+/**
+ * @brief Create an empty dictionary on top of another one
+ * @param base Dictionary to fall back to, e.g. one from createDict()
+ * @return New dictionary, to be freed with freeDict()
+ *
+ * Lookups that miss find the words of 'base', which is never modified
+ * (not even its reference counts), so any number of threads can share
+ * it. A definition that shadows a word of 'base' does not chain to it
+ * in word.prev. The base must outlive the new dictionary.
+ */
+tfdict *createChildDict(const tfdict *base);
+
+/**
+ * @brief Free a dictionary and every word it holds
+ * @param dict Dictionary to free
  *
- * All primitive words are C functions with this signature. They receive
- * the execution context and can manipulate the stack, create objects, etc.
- * Primitives are responsible for type checking and error handling.
+ * Shadowed definitions are released too, since each word owns a
+ * reference to the definition it replaced. The base dictionary, if
+ * any, is left alone.
  */
-typedef void (*WordFn)(tfctx *ctx);
+void freeDict(tfdict *dict);
 
 /**
- * @brief Look up a primitive word by name
- * @param name Symbol name to look up (null-terminated string)
- * @return Function pointer to the primitive, or NULL if not found
+ * @brief Look up the current definition of a word
+ * @param dict Dictionary to search
+ * @param id Intern id of the name (see internSymbol())
+ * @return The latest word object with that name (in the dictionary or
+ *         its base), or NULL if not found
+ */
+tfobj *dictLookup(const tfdict *dict, uint32_t id);
+
+/**
+ * @brief Add a word to the dictionary
+ * @param dict Dictionary to update
+ * @param word Word object to add (the dictionary takes a reference)
+ *
+ * If the name is already defined, the new word shadows the old one:
+ * later lookups find the new word, while code already resolved against
+ * the old word keeps calling it.
+ */
+void dictDefine(tfdict *dict, tfobj *word);
+
+/**
+ * @brief Bind every symbol of a compiled program to its word
+ * @param dict Dictionary to resolve against
+ * @param program List object returned by compile()
+ *
+ * This is the link pass that runs once between compile() and exec(). It
+ * walks the program in order: each symbol gets its word cached in
+ * o->sym.word (and, for primitives, the WordFn in o->sym.fn) along with
+ * its stack effect, and each colon definition has its body resolved and
+ * its stack effect computed, and is then added to the dictionary. Every
+ * symbol starts out with a runtime depth check (sym.need = sym.in), which
+ * analyzeStack() may later remove. A definition is therefore not visible
+ * inside its own body (except through 'recurse', which calls the word
+ * being defined), and redefining a word only affects code that comes
+ * after it.
  *
- * Performs a linear search through the primitive table. This is O(n) but
- * acceptable for small numbers of primitives (dozens). Returns NULL if
- * the word is not defined.
+ * Unknown words are reported here, before any code runs, with the source
+ * location of the offending symbol (exits via compileError()).
  */
-WordFn lookupPrimitive(const char *name);
+void resolveSymbols(tfdict *dict, tfobj *program);
 
-#endif 
\ No newline at end of file
+#endif
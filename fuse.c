@@ -0,0 +1,252 @@
+/**
+ * @file fuse.c
+ * @brief Implementation of superinstruction fusion and pair profiling
+ *
+ * The fusion rules live in a static table, like the primitive table in
+ * dict.c. To tune them for a workload, run it with --pairs, look at the
+ * most frequent pairs, and add a fused primitive plus a rule for them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuse.h"
+#include "tf.h"
+#include "mem.h"
+#include "list.h"
+#include "primitives.h"
+#include "control.h"
+
+/* ===================== Fusion =================== */
+
+/**
+ * @brief A two-word sequence and the primitive replacing it
+ *
+ * A NULL 'first' matches any integer literal, which then becomes the
+ * fused symbol's sym.arg. 'in' and 'out' are the stack effect of the
+ * whole sequence, which is also the effect of the fused primitive.
+ */
+typedef struct FusionRule {
+    WordFn first;
+    WordFn second;
+    WordFn fused;
+    int in;
+    int out;
+} FusionRule;
+
+/**
+ * @brief Table of all fusion rules, terminated by a {NULL, NULL, NULL}
+ */
+static const FusionRule fusionRules[] = {
+{NULL, primitiveAdd, primitiveAddLit, 1, 1},
+{NULL, primitiveSub, primitiveSubLit, 1, 1},
+{NULL, primitiveMul, primitiveMulLit, 1, 1},
+{primitiveDuplicate, primitiveMul, primitiveDupMul, 1, 1},
+{primitiveDuplicate, primitiveAdd, primitiveDupAdd, 1, 1},
+{primitiveSwap, primitiveSub, primitiveSwapSub, 2, 1},
+{primitiveSwap, primitiveDrop, primitiveSwapDrop, 2, 1},
+{primitiveDrop, primitiveDrop, primitiveDropDrop, 2, 0},
+{NULL, NULL, NULL, 0, 0} // Sentinel marking end of table
+};
+
+/**
+ * @brief Check whether an object is a symbol bound to a primitive
+ */
+static int isPrimitive(tfobj *o, WordFn fn) {
+    return objType(o) == TFOBJ_TYPE_SYMBOL && o->sym.fn == fn;
+}
+
+/**
+ * @brief Find the rule matching the objects a, b
+ * @return Matching rule, or NULL
+ */
+static const FusionRule *findRule(tfobj *a, tfobj *b) {
+    for (size_t i = 0; fusionRules[i].fused != NULL; i++) {
+        const FusionRule *r = &fusionRules[i];
+        if (!isPrimitive(b, r->second)) continue;
+        if (r->first == NULL ? isImmInt(a) : isPrimitive(a, r->first)) return r;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Build the symbol that replaces the sequence a, b
+ *
+ * It has the name and location of b, where the errors of the slow paths
+ * come from, and takes over the reference to a (the literal, or the
+ * first word) in sym.arg, so that a failed depth check can report the
+ * word that would have failed first (see stackUnderflowError()).
+ */
+static tfobj *createFusedSymbol(const FusionRule *r, tfobj *a, tfobj *b) {
+    tfobj *fused = createSymbolObject(b->sym.ptr, b->sym.len);
+    fused->sym.fn = r->fused;
+    fused->sym.in = r->in;
+    fused->sym.out = r->out;
+    fused->sym.need = r->in;
+    fused->sym.arg = a;
+    fused->src_line = b->src_line;
+    fused->src_column = b->src_column;
+    return fused;
+}
+
+void fuseProgram(tfobj *program) {
+    size_t out = 0;
+    size_t len = program->list.len;
+    tfobj **ele = program->list.ele;
+
+    for (size_t i = 0; i < len; i++) {
+        tfobj *o = ele[i];
+        if (objType(o) == TFOBJ_TYPE_WORD) {
+            fuseProgram(o->word.body);
+        }
+
+        const FusionRule *r = i + 1 < len ? findRule(o, ele[i + 1]) : NULL;
+        if (r) {
+            tfobj *fused = createFusedSymbol(r, o, ele[i + 1]);
+            decRef(ele[i + 1]);
+            o = fused;   // Takes over the list's reference (a's is in sym.arg)
+            i++;
+        }
+        ele[out++] = o;
+    }
+    program->list.len = out;
+    // A pair never straddles a jump target (targets follow control words)
+    linkBranches(program);
+}
+
+/* ===================== Pair profiling =================== */
+
+/**
+ * @brief One counted pair; a NULL word stands for an integer literal
+ */
+typedef struct pairEntry {
+    tfobj *first;
+    tfobj *second;
+    unsigned long count;
+} pairEntry;
+
+/**
+ * @brief Pair profile - open-addressing hash table of pair counters
+ */
+typedef struct tfpairs {
+    pairEntry *slots;
+    size_t capacity;    /**< Always a power of two */
+    size_t count;
+    tfobj *last;        /**< Word of the previous object (NULL: literal) */
+    int has_last;       /**< Whether 'last' is valid yet */
+} tfpairs;
+
+/**
+ * @brief Hash a pair of word pointers
+ */
+static size_t hashPair(tfobj *a, tfobj *b) {
+    uint64_t h = (uint64_t)(uintptr_t)a * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)(uintptr_t)b + 0x7F4A7C15ULL + (h << 6) + (h >> 2);
+    return (size_t)(h ^ (h >> 29));
+}
+
+/**
+ * @brief Find the entry for a pair, or the empty slot where it belongs
+ */
+static pairEntry *findPair(tfpairs *pairs, tfobj *a, tfobj *b) {
+    size_t mask = pairs->capacity - 1;
+    size_t i = hashPair(a, b) & mask;
+    while (pairs->slots[i].count != 0 &&
+           (pairs->slots[i].first != a || pairs->slots[i].second != b)) {
+        i = (i + 1) & mask;
+    }
+    return &pairs->slots[i];
+}
+
+/**
+ * @brief Double the table size and rehash every pair
+ */
+static void growPairs(tfpairs *pairs) {
+    pairEntry *old = pairs->slots;
+    size_t old_capacity = pairs->capacity;
+
+    pairs->capacity *= 2;
+    pairs->slots = xmalloc(sizeof(pairEntry) * pairs->capacity);
+    memset(pairs->slots, 0, sizeof(pairEntry) * pairs->capacity);
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].count == 0) continue;
+        *findPair(pairs, old[i].first, old[i].second) = old[i];
+    }
+    free(old);
+}
+
+tfpairs *createPairProfile(void) {
+    tfpairs *pairs = xmalloc(sizeof(tfpairs));
+    pairs->capacity = 64;
+    pairs->count = 0;
+    pairs->slots = xmalloc(sizeof(pairEntry) * pairs->capacity);
+    memset(pairs->slots, 0, sizeof(pairEntry) * pairs->capacity);
+    pairs->last = NULL;
+    pairs->has_last = 0;
+    return pairs;
+}
+
+void pairProfileObserve(tfpairs *pairs, tfobj *o) {
+    tfobj *word = NULL;
+    if (objType(o) == TFOBJ_TYPE_SYMBOL && o->sym.control) {
+        pairs->has_last = 0;   // Jumps break the sequence
+        return;
+    } else if (objType(o) == TFOBJ_TYPE_SYMBOL) {
+        word = o->sym.word;
+    } else if (!isImmInt(o)) {
+        pairs->has_last = 0;   // Other data breaks the sequence
+        return;
+    }
+
+    if (pairs->has_last) {
+        if ((pairs->count + 1) * 4 > pairs->capacity * 3) {
+            growPairs(pairs);
+        }
+        pairEntry *e = findPair(pairs, pairs->last, word);
+        if (e->count == 0) {
+            e->first = pairs->last;
+            e->second = word;
+            pairs->count++;
+        }
+        e->count++;
+    }
+    pairs->last = word;
+    pairs->has_last = 1;
+}
+
+/**
+ * @brief qsort comparator: higher counts first
+ */
+static int comparePairs(const void *a, const void *b) {
+    unsigned long ca = ((const pairEntry *)a)->count;
+    unsigned long cb = ((const pairEntry *)b)->count;
+    return (ca < cb) - (ca > cb);
+}
+
+/**
+ * @brief Name of a profiled word, '<lit>' for literals
+ */
+static const char *pairName(tfobj *word) {
+    return word ? word->word.name->sym.ptr : "<lit>";
+}
+
+void printPairProfile(tfpairs *pairs, FILE *out) {
+    pairEntry *sorted = xmalloc(sizeof(pairEntry) * (pairs->count + 1));
+    size_t n = 0;
+    for (size_t i = 0; i < pairs->capacity; i++) {
+        if (pairs->slots[i].count != 0) sorted[n++] = pairs->slots[i];
+    }
+    qsort(sorted, n, sizeof(pairEntry), comparePairs);
+
+    fprintf(out, "%12s  %s\n", "count", "pair");
+    for (size_t i = 0; i < n; i++) {
+        fprintf(out, "%12lu  %s %s\n", sorted[i].count,
+                pairName(sorted[i].first), pairName(sorted[i].second));
+    }
+    free(sorted);
+}
+
+void freePairProfile(tfpairs *pairs) {
+    free(pairs->slots);
+    free(pairs);
+}
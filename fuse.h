@@ -0,0 +1,58 @@
+/**
+ * @file fuse.h
+ * @brief Superinstruction fusion and word pair profiling
+ *
+ * A peephole pass that replaces frequent two-word sequences in a resolved
+ * program (like 'dup *' or '1 +') with a single fused primitive, plus the
+ * profiler used to find out which sequences are worth fusing.
+ */
+
+#ifndef FUSE_H
+#define FUSE_H
+#include <stdio.h>
+#include "tf.h"
+
+/**
+ * @brief Fuse common word sequences in a resolved program
+ * @param program List object that already went through resolveSymbols()
+ *
+ * Rewrites the list in place, and the bodies of the colon definitions it
+ * contains. Sequences are matched on the primitives the symbols are bound
+ * to, so a user redefinition of 'dup' is never fused. Every fused symbol
+ * keeps the source location of the sequence for error reporting.
+ */
+void fuseProgram(tfobj *program);
+
+/**
+ * @brief Create an empty word pair profile
+ * @return New profile, to be freed with freePairProfile()
+ *
+ * Store it in ctx->pairs to have the reference VM (exec) record every
+ * pair of consecutively executed words.
+ */
+struct tfpairs *createPairProfile(void);
+
+/**
+ * @brief Record the execution of one program object
+ * @param pairs Profile to update
+ * @param o Object about to be executed (literal or symbol)
+ *
+ * Counts the pair formed with the previously observed object. All integer
+ * literals count as the same pseudo word, shown as '<lit>'.
+ */
+void pairProfileObserve(struct tfpairs *pairs, tfobj *o);
+
+/**
+ * @brief Print the recorded pairs, most frequent first
+ * @param pairs Profile to print
+ * @param out Stream to print to
+ */
+void printPairProfile(struct tfpairs *pairs, FILE *out);
+
+/**
+ * @brief Free a pair profile
+ * @param pairs Profile to free
+ */
+void freePairProfile(struct tfpairs *pairs);
+
+#endif
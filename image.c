@@ -0,0 +1,440 @@
+/**
+ * @file image.c
+ * @brief Saving and loading compiled program images
+ *
+ * Layout of an image (native byte order, every section 8-byte aligned):
+ *
+ *   imageHeader
+ *   imageObject[object_count]   the tree in preorder, see imageObject
+ *   uint32_t[limb_count]        limbs of the big integers, in order
+ *   imageName[name_count]       where each distinct symbol name is
+ *   name bytes                  the names, back to back
+ *
+ * The loader interns each distinct name once, then builds the objects
+ * with the same constructors the parser uses, straight from the mapped
+ * file, so no pointer in it needs fixing up.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "image.h"
+#include "tf.h"
+#include "mem.h"
+#include "list.h"
+#include "intern.h"
+#include "control.h"
+
+/** @brief First bytes of every image */
+#define IMAGE_MAGIC "TFIMAGE"
+
+/** @brief Format version, bumped whenever the layout or the parser output changes */
+#define IMAGE_VERSION 1
+
+/** @brief Written as is, reads differently on a machine of the other byte order */
+#define IMAGE_ENDIAN 0x01020304u
+
+/**
+ * @brief Start of an image file
+ *
+ * Offsets are from the start of the file.
+ */
+typedef struct imageHeader {
+    char magic[8];             /**< IMAGE_MAGIC */
+    uint32_t version;          /**< IMAGE_VERSION */
+    uint32_t endian;           /**< IMAGE_ENDIAN */
+    uint64_t source_hash;      /**< hashSource() of the source text */
+    uint64_t size;             /**< Size of the whole file, to catch truncation */
+    uint64_t objects_offset;
+    uint64_t object_count;
+    uint64_t limbs_offset;
+    uint64_t limb_count;
+    uint64_t names_offset;
+    uint64_t name_count;
+} imageHeader;
+
+/**
+ * @brief One object of the tree
+ *
+ * What follows a record depends on its type:
+ * - INT, BOOL: nothing, the value is in 'value'
+ * - BIGINT: nothing, its 'count' limbs are the next ones in the limbs
+ *   section and 'value' is its sign
+ * - SYMBOL: nothing, 'count' is the index of its name
+ * - LIST: its 'count' elements
+ * - WORD: the symbol naming it, then the list of its body
+ */
+typedef struct imageObject {
+    int32_t type;              /**< TFOBJ_TYPE_* */
+    int32_t line;              /**< Source location, 0 if none */
+    int32_t column;
+    uint32_t count;
+    int64_t value;
+} imageObject;
+
+/**
+ * @brief Where a symbol name is in the file
+ */
+typedef struct imageName {
+    uint64_t offset;
+    uint64_t len;
+} imageName;
+
+/* ===================== Hashing =================== */
+
+uint64_t hashSource(const char *text, size_t len) {
+    // Eight bytes per step: the hash must cost little next to parsing
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, text + i, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    uint64_t w = 0;
+    memcpy(&w, text + i, len - i);
+    h = (h ^ w) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* ===================== Saving =================== */
+
+/**
+ * @brief The sections of an image being built in memory
+ */
+typedef struct imageWriter {
+    imageObject *objects;
+    size_t object_count, object_capacity;
+    uint32_t *limbs;
+    size_t limb_count, limb_capacity;
+    const tfobj **names;       /**< A symbol for each distinct name */
+    size_t name_count, name_capacity;
+    uint32_t *name_of_id;      /**< Name index + 1 by intern id, 0 if none yet */
+    size_t id_capacity;
+} imageWriter;
+
+/**
+ * @brief Make room for 'need' elements in a growable array
+ */
+static void *reserve(void *array, size_t *capacity, size_t need, size_t size) {
+    if (need <= *capacity) {
+        return array;
+    }
+    size_t n = *capacity ? *capacity : 64;
+    while (n < need) n *= 2;
+    array = xrealloc(array, n * size);
+    *capacity = n;
+    return array;
+}
+
+/**
+ * @brief Get the index of a symbol's name, adding it the first time
+ */
+static uint32_t nameIndex(imageWriter *w, const tfobj *sym) {
+    uint32_t id = sym->sym.id;
+    if (id >= w->id_capacity) {
+        size_t old = w->id_capacity;
+        w->name_of_id = reserve(w->name_of_id, &w->id_capacity, (size_t)id + 1,
+                                sizeof(uint32_t));
+        memset(w->name_of_id + old, 0, sizeof(uint32_t) * (w->id_capacity - old));
+    }
+    if (w->name_of_id[id] == 0) {
+        w->names = reserve(w->names, &w->name_capacity, w->name_count + 1,
+                           sizeof(tfobj *));
+        w->names[w->name_count++] = sym;
+        w->name_of_id[id] = w->name_count;
+    }
+    return w->name_of_id[id] - 1;
+}
+
+/**
+ * @brief Append the record of an object and those of its children
+ * @return 0, or -1 for an object the parser can't produce
+ */
+static int writeObject(imageWriter *w, const tfobj *o) {
+    w->objects = reserve(w->objects, &w->object_capacity, w->object_count + 1,
+                         sizeof(imageObject));
+    size_t self = w->object_count++;
+    imageObject rec = {objType(o), 0, 0, 0, 0};
+    if (!isImmediate(o)) {
+        rec.line = o->src_line;
+        rec.column = o->src_column;
+    }
+
+    switch (rec.type) {
+        case TFOBJ_TYPE_INT:
+        case TFOBJ_TYPE_BOOL:
+            rec.value = objInt(o);
+            break;
+        case TFOBJ_TYPE_BIGINT:
+            if (o->big.len > UINT32_MAX) return -1;
+            rec.count = o->big.len;
+            rec.value = o->big.neg;
+            w->limbs = reserve(w->limbs, &w->limb_capacity, w->limb_count + o->big.len,
+                               sizeof(uint32_t));
+            memcpy(w->limbs + w->limb_count, o->big.limbs, sizeof(uint32_t) * o->big.len);
+            w->limb_count += o->big.len;
+            break;
+        case TFOBJ_TYPE_SYMBOL:
+            rec.count = nameIndex(w, o);
+            break;
+        case TFOBJ_TYPE_LIST:
+            if (o->list.len > UINT32_MAX) return -1;
+            rec.count = o->list.len;
+            for (size_t i = 0; i < o->list.len; i++) {
+                if (writeObject(w, o->list.ele[i]) != 0) return -1;
+            }
+            break;
+        case TFOBJ_TYPE_WORD:
+            if (writeObject(w, o->word.name) != 0 || writeObject(w, o->word.body) != 0) {
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+    }
+    // Children were appended after it, and may have moved the array
+    w->objects[self] = rec;
+    return 0;
+}
+
+/**
+ * @brief Round an offset up to the next multiple of 8
+ */
+static uint64_t align8(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+/**
+ * @brief Write bytes and then zeros up to the next multiple of 8
+ * @return 0 on success
+ */
+static int writePadded(FILE *f, const void *data, size_t len) {
+    static const char zeros[8] = {0};
+    if (len > 0 && fwrite(data, 1, len, f) != len) return -1;
+    size_t pad = align8(len) - len;
+    return pad > 0 && fwrite(zeros, 1, pad, f) != pad ? -1 : 0;
+}
+
+int saveImage(const char *path, tfobj *program, uint64_t source_hash) {
+    imageWriter w = {0};
+    int result = -1;
+    FILE *f = NULL;
+    size_t tmp_len = strlen(path) + 32;
+    char *tmp = xmalloc(tmp_len);
+    snprintf(tmp, tmp_len, "%s.%ld.tmp", path, (long)getpid());
+
+    if (writeObject(&w, program) != 0) goto done;
+
+    imageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    h.version = IMAGE_VERSION;
+    h.endian = IMAGE_ENDIAN;
+    h.source_hash = source_hash;
+    h.objects_offset = sizeof(imageHeader);
+    h.object_count = w.object_count;
+    h.limbs_offset = h.objects_offset + sizeof(imageObject) * w.object_count;
+    h.limb_count = w.limb_count;
+    h.names_offset = align8(h.limbs_offset + sizeof(uint32_t) * w.limb_count);
+    h.name_count = w.name_count;
+
+    imageName *names = xmalloc(sizeof(imageName) * (w.name_count + 1));
+    uint64_t offset = h.names_offset + sizeof(imageName) * w.name_count;
+    for (size_t i = 0; i < w.name_count; i++) {
+        names[i].offset = offset;
+        names[i].len = w.names[i]->sym.len;
+        offset += names[i].len;
+    }
+    h.size = offset;
+
+    f = fopen(tmp, "wb");
+    int ok = f != NULL &&
+        fwrite(&h, sizeof(h), 1, f) == 1 &&
+        writePadded(f, w.objects, sizeof(imageObject) * w.object_count) == 0 &&
+        writePadded(f, w.limbs, sizeof(uint32_t) * w.limb_count) == 0 &&
+        writePadded(f, names, sizeof(imageName) * w.name_count) == 0;
+    for (size_t i = 0; ok && i < w.name_count; i++) {
+        ok = fwrite(w.names[i]->sym.ptr, 1, names[i].len, f) == names[i].len;
+    }
+    free(names);
+    if (f != NULL && fclose(f) != 0) ok = 0;
+    if (ok && rename(tmp, path) == 0) {
+        result = 0;
+    } else if (f != NULL) {
+        remove(tmp);
+    }
+
+done:
+    free(w.objects);
+    free(w.limbs);
+    free(w.names);
+    free(w.name_of_id);
+    free(tmp);
+    return result;
+}
+
+/* ===================== Loading =================== */
+
+/**
+ * @brief A mapped image being turned back into objects
+ */
+typedef struct imageReader {
+    const imageObject *objects;
+    size_t object_count;
+    size_t next;               /**< Next record to read */
+    const uint32_t *limbs;
+    size_t limb_count;
+    size_t next_limb;
+    uint32_t *ids;             /**< Intern id of each name */
+    const char **names;        /**< Interned copy of each name */
+    const imageName *name_table;
+    size_t name_count;
+} imageReader;
+
+/**
+ * @brief Check that a section of 'count' elements lies within the file
+ */
+static int inFile(uint64_t offset, uint64_t count, size_t size, uint64_t file_size) {
+    return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+/**
+ * @brief Build the object of the next record, and its children
+ * @return New object, or NULL if the image is damaged
+ */
+static tfobj *readObject(imageReader *r) {
+    if (r->next == r->object_count) return NULL;
+    const imageObject *rec = &r->objects[r->next++];
+    tfobj *o;
+
+    switch (rec->type) {
+        case TFOBJ_TYPE_INT:
+            o = createIntObject(rec->value);
+            break;
+        case TFOBJ_TYPE_BOOL:
+            o = createBoolObject(rec->value != 0);
+            break;
+        case TFOBJ_TYPE_BIGINT: {
+            size_t len = rec->count;
+            if (len == 0 || len > r->limb_count - r->next_limb ||
+                r->limbs[r->next_limb + len - 1] == 0) {
+                return NULL;
+            }
+            uint32_t *limbs = xmalloc(sizeof(uint32_t) * len);
+            memcpy(limbs, r->limbs + r->next_limb, sizeof(uint32_t) * len);
+            r->next_limb += len;
+            o = createBigIntObject(limbs, len, rec->value != 0);
+            break;
+        }
+        case TFOBJ_TYPE_SYMBOL:
+            if (rec->count >= r->name_count) return NULL;
+            o = createInternedSymbolObject(r->ids[rec->count], r->names[rec->count],
+                                           r->name_table[rec->count].len);
+            markControl(o);
+            break;
+        case TFOBJ_TYPE_LIST:
+            if (rec->count > r->object_count - r->next) return NULL;
+            o = createListObject(rec->count > 0 ? rec->count : 1);
+            for (uint32_t i = 0; i < rec->count; i++) {
+                tfobj *e = readObject(r);
+                if (e == NULL) {
+                    decRef(o);
+                    return NULL;
+                }
+                listAppendObject(o, e);
+                decRef(e);
+            }
+            linkBranches(o);
+            break;
+        case TFOBJ_TYPE_WORD: {
+            tfobj *name = readObject(r);
+            tfobj *body = name ? readObject(r) : NULL;
+            if (body == NULL || objType(name) != TFOBJ_TYPE_SYMBOL ||
+                objType(body) != TFOBJ_TYPE_LIST) {
+                decRef(name);
+                decRef(body);
+                return NULL;
+            }
+            o = createWordObject(name, NULL, body);
+            decRef(name);
+            decRef(body);
+            break;
+        }
+        default:
+            return NULL;
+    }
+    if (!isImmediate(o)) {
+        o->src_line = rec->line;
+        o->src_column = rec->column;
+    }
+    return o;
+}
+
+tfobj *loadImage(const char *path, uint64_t source_hash) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(imageHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    const char *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    tfobj *program = NULL;
+    const imageHeader *h = (const imageHeader *)base;
+    if (memcmp(h->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ||
+        h->version != IMAGE_VERSION || h->endian != IMAGE_ENDIAN ||
+        h->source_hash != source_hash || h->size != size ||
+        h->objects_offset % 8 || h->limbs_offset % 8 || h->names_offset % 8 ||
+        !inFile(h->objects_offset, h->object_count, sizeof(imageObject), size) ||
+        !inFile(h->limbs_offset, h->limb_count, sizeof(uint32_t), size) ||
+        !inFile(h->names_offset, h->name_count, sizeof(imageName), size) ||
+        h->object_count == 0) {
+        munmap((void *)base, size);
+        return NULL;
+    }
+
+    imageReader r;
+    r.objects = (const imageObject *)(base + h->objects_offset);
+    r.object_count = h->object_count;
+    r.next = 0;
+    r.limbs = (const uint32_t *)(base + h->limbs_offset);
+    r.limb_count = h->limb_count;
+    r.next_limb = 0;
+    r.name_table = (const imageName *)(base + h->names_offset);
+    r.name_count = h->name_count;
+    r.ids = xmalloc(sizeof(uint32_t) * (r.name_count + 1));
+    r.names = xmalloc(sizeof(char *) * (r.name_count + 1));
+
+    // Each distinct name is hashed once, however many symbols use it
+    size_t i;
+    for (i = 0; i < r.name_count; i++) {
+        const imageName *n = &r.name_table[i];
+        if (n->len == 0 || !inFile(n->offset, n->len, 1, size)) break;
+        r.ids[i] = internSymbol(base + n->offset, n->len, &r.names[i]);
+    }
+    if (i == r.name_count && r.objects[0].type == TFOBJ_TYPE_LIST) {
+        program = readObject(&r);
+        if (program && r.next != r.object_count) {
+            decRef(program);
+            program = NULL;
+        }
+    }
+    free(r.ids);
+    free(r.names);
+    munmap((void *)base, size);
+    return program;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file image.h
+ * @brief Compiled program images (--image)
+ *
+ * An image is the output of the parser saved to a file: the program's
+ * object tree with its literals, symbols, definitions and source
+ * locations. Loading one rebuilds the same tree as compile() would,
+ * without tokenizing, parsing numbers or hashing every token, so the
+ * error messages and everything after parsing are unchanged. Linking is
+ * still done on every run, since it binds to the primitives of this
+ * process.
+ *
+ * The file holds no pointers: objects refer to each other by position
+ * and to their names by index, so it is mapped and read in place. The
+ * header records a hash of the source text, and an image made from any
+ * other text (or by another format version) is ignored.
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+#include <stddef.h>
+#include <stdint.h>
+#include "tf.h"
+
+/**
+ * @brief Hash a source text, to tell which source an image was made from
+ * @param text Source text
+ * @param len Length of the text in bytes
+ * @return 64-bit hash of the contents
+ */
+uint64_t hashSource(const char *text, size_t len);
+
+/**
+ * @brief Write a compiled program to an image file
+ * @param path File to create or replace
+ * @param program List returned by compile(), before resolveSymbols()
+ *                and the optimization passes change it
+ * @param source_hash hashSource() of the text it was compiled from
+ * @return 0 on success, -1 if the file can't be written
+ *
+ * The image is written next to 'path' and renamed over it, so another
+ * process never maps a half-written file.
+ */
+int saveImage(const char *path, tfobj *program, uint64_t source_hash);
+
+/**
+ * @brief Load a compiled program from an image file
+ * @param path Image file
+ * @param source_hash hashSource() of the current source text
+ * @return The program, as compile() would have returned it, or NULL if
+ *         the file is missing, was made from another source or by
+ *         another version, or is damaged
+ */
+tfobj *loadImage(const char *path, uint64_t source_hash);
+
+#endif
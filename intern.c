@@ -0,0 +1,304 @@
+/**
+ * @file intern.c
+ * @brief Implementation of the symbol intern table
+ *
+ * An open-addressing hash table (linear probing, FNV-1a hashing) maps a
+ * name to its id, and an array indexed by id holds the names. The names
+ * themselves are packed one after the other into large chunks, so even
+ * the first occurrence of a name costs no allocation of its own.
+ *
+ * The table is shared by every thread (batch workers parse concurrently),
+ * so a mutex guards it. Taking it for every token would slow parsing down
+ * by a third, so each thread also keeps a private cache of the names it
+ * has seen, which answers repeats without the lock. Names never move once
+ * stored, so the pointers in the caches stay valid. A thread's cache is
+ * freed when the thread exits.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "tf.h"
+#include "mem.h"
+
+/** @brief Marks an unused hash slot */
+#define INTERN_EMPTY UINT32_MAX
+
+/**
+ * @brief An interned name, stored at its id in internEntries
+ */
+typedef struct internEntry {
+    const char *name;
+    size_t len;
+    uint64_t hash;
+} internEntry;
+
+/**
+ * @brief A block of name storage; chunks are chained for freeing
+ */
+typedef struct internChunk {
+    struct internChunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+} internChunk;
+
+static uint32_t *internSlots = NULL;     // Ids, or INTERN_EMPTY
+static size_t internCapacity = 0;        // Number of slots (power of two)
+static internEntry *internEntries = NULL;
+static size_t internCount = 0;           // Also the next id
+static size_t internEntriesCapacity = 0;
+static internChunk *internChunks = NULL;
+static pthread_mutex_t internLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief A name the current thread has interned, in its private cache
+ */
+typedef struct internCacheEntry {
+    const char *name;   // Shared storage; NULL marks an empty slot
+    size_t len;
+    uint64_t hash;
+    uint32_t id;
+} internCacheEntry;
+
+static _Thread_local internCacheEntry *internCache = NULL;
+static _Thread_local size_t internCacheCapacity = 0;   // Power of two
+static _Thread_local size_t internCacheCount = 0;
+
+/** @brief Frees the cache of a thread when it exits */
+static pthread_key_t internCacheKey;
+static pthread_once_t internCacheKeyOnce = PTHREAD_ONCE_INIT;
+
+/* ===================== Hash table =================== */
+
+/**
+ * @brief xrealloc() for use with internLock held
+ *
+ * Running out of memory may longjmp() to the thread's error trap, so the
+ * lock is released before reporting it.
+ */
+static void *internAlloc(void *ptr, size_t size) {
+    void *p = realloc(ptr, size);
+    if (p == NULL) {
+        pthread_mutex_unlock(&internLock);
+        memoryError(size);
+    }
+    return p;
+}
+
+/**
+ * @brief Hash a name with 64-bit FNV-1a
+ * @param s Name bytes
+ * @param len Length of the name
+ * @return Hash value
+ */
+static uint64_t hashName(const char *s, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @brief Find the slot holding a name, or the empty slot where it belongs
+ * @return Index into internSlots
+ *
+ * The table is never more than half full, so the probe always terminates.
+ */
+static size_t internFindSlot(const char *s, size_t len, uint64_t hash) {
+    size_t mask = internCapacity - 1;
+    size_t i = hash & mask;
+    for (;;) {
+        if (internSlots[i] == INTERN_EMPTY) {
+            return i;
+        }
+        internEntry *e = &internEntries[internSlots[i]];
+        if (e->hash == hash && e->len == len && memcmp(e->name, s, len) == 0) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * @brief Double the number of slots (or create the table) and rehash
+ */
+static void internGrow(void) {
+    size_t capacity = internCapacity ? internCapacity * 2 : INITIAL_INTERN_CAPACITY;
+    uint32_t *slots = internAlloc(NULL, sizeof(uint32_t) * capacity);
+    free(internSlots);
+    internSlots = slots;
+    internCapacity = capacity;
+    for (size_t i = 0; i < internCapacity; i++) {
+        internSlots[i] = INTERN_EMPTY;
+    }
+    for (size_t id = 0; id < internCount; id++) {
+        internEntry *e = &internEntries[id];
+        internSlots[internFindSlot(e->name, e->len, e->hash)] = id;
+    }
+}
+
+/* ===================== Thread cache =================== */
+
+/**
+ * @brief Find a name in the thread's cache, or the empty slot for it
+ */
+static internCacheEntry *internCacheFind(const char *s, size_t len, uint64_t hash) {
+    size_t mask = internCacheCapacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        internCacheEntry *e = &internCache[i];
+        if (e->name == NULL ||
+            (e->hash == hash && e->len == len && memcmp(e->name, s, len) == 0)) {
+            return e;
+        }
+    }
+}
+
+/**
+ * @brief Create internCacheKey, whose destructor frees a thread's cache
+ */
+static void internCacheKeyCreate(void) {
+    pthread_key_create(&internCacheKey, free);
+}
+
+/**
+ * @brief Double the thread's cache (or create it) and rehash
+ */
+static void internCacheGrow(void) {
+    internCacheEntry *old = internCache;
+    size_t old_capacity = internCacheCapacity;
+    size_t capacity = old_capacity ? old_capacity * 2 : INITIAL_INTERN_CAPACITY;
+    internCache = xmalloc(sizeof(internCacheEntry) * capacity);
+    internCacheCapacity = capacity;
+    memset(internCache, 0, sizeof(internCacheEntry) * internCacheCapacity);
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].name) {
+            *internCacheFind(old[i].name, old[i].len, old[i].hash) = old[i];
+        }
+    }
+    free(old);
+    pthread_once(&internCacheKeyOnce, internCacheKeyCreate);
+    pthread_setspecific(internCacheKey, internCache);
+}
+
+/* ===================== Name storage =================== */
+
+/**
+ * @brief Copy a name into chunk storage
+ * @return Null-terminated copy, valid until freeInternTable()
+ *
+ * Names longer than a chunk get a chunk of their own.
+ */
+static const char *internStore(const char *s, size_t len) {
+    internChunk *c = internChunks;
+    if (c == NULL || c->size - c->used < len + 1) {
+        size_t size = len + 1 > INTERN_CHUNK_SIZE ? len + 1 : INTERN_CHUNK_SIZE;
+        c = internAlloc(NULL, sizeof(internChunk) + size);
+        c->used = 0;
+        c->size = size;
+        c->next = internChunks;
+        internChunks = c;
+    }
+    char *name = c->data + c->used;
+    memcpy(name, s, len);
+    name[len] = '\0';
+    c->used += len + 1;
+    return name;
+}
+
+/* ===================== Interface =================== */
+
+/**
+ * @brief internSymbol() with internLock held
+ */
+static uint32_t internLocked(const char *s, size_t len) {
+    if (internCapacity == 0) {
+        // The first names get the fixed ids the parser relies on
+        static const char *const fixed[] = {
+            ":", ";", "if", "else", "then", "begin", "until", "do", "loop",
+            "recurse", "[", "]"
+        };
+        internGrow();
+        for (size_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+            internLocked(fixed[i], strlen(fixed[i]));
+        }
+    }
+    if ((internCount + 1) * 2 > internCapacity) {
+        internGrow();
+    }
+    uint64_t hash = hashName(s, len);
+    size_t i = internFindSlot(s, len, hash);
+    if (internSlots[i] != INTERN_EMPTY) {
+        return internSlots[i];
+    }
+
+    if (internCount == internEntriesCapacity) {
+        size_t capacity = internEntriesCapacity ? internEntriesCapacity * 2 : 64;
+        internEntries = internAlloc(internEntries, sizeof(internEntry) * capacity);
+        internEntriesCapacity = capacity;
+    }
+    internEntry *e = &internEntries[internCount];
+    e->name = internStore(s, len);
+    e->len = len;
+    e->hash = hash;
+    internSlots[i] = internCount;
+    return internCount++;
+}
+
+uint32_t internSymbol(const char *s, size_t len, const char **name) {
+    if ((internCacheCount + 1) * 2 > internCacheCapacity) {
+        internCacheGrow();
+    }
+    uint64_t hash = hashName(s, len);
+    internCacheEntry *e = internCacheFind(s, len, hash);
+    if (e->name == NULL) {
+        pthread_mutex_lock(&internLock);
+        e->id = internLocked(s, len);
+        e->name = internEntries[e->id].name;
+        pthread_mutex_unlock(&internLock);
+        e->len = len;
+        e->hash = hash;
+        internCacheCount++;
+    }
+    if (name) *name = e->name;
+    return e->id;
+}
+
+const char *internString(uint32_t id) {
+    // The entries array moves when another thread adds a name
+    pthread_mutex_lock(&internLock);
+    const char *name = internEntries[id].name;
+    pthread_mutex_unlock(&internLock);
+    return name;
+}
+
+void internReleaseThread(void) {
+    if (internCache) {
+        pthread_setspecific(internCacheKey, NULL);
+    }
+    free(internCache);
+    internCache = NULL;
+    internCacheCapacity = 0;
+    internCacheCount = 0;
+}
+
+void freeInternTable(void) {
+    internReleaseThread();
+    while (internChunks) {
+        internChunk *next = internChunks->next;
+        free(internChunks);
+        internChunks = next;
+    }
+    free(internSlots);
+    free(internEntries);
+    internSlots = NULL;
+    internEntries = NULL;
+    internCapacity = 0;
+    internCount = 0;
+    internEntriesCapacity = 0;
+}
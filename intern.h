@@ -0,0 +1,87 @@
+/**
+ * @file intern.h
+ * @brief Intern table for symbol names
+ *
+ * Every distinct symbol name is stored exactly once, however many times
+ * it appears in the source, and gets a small stable id. Symbol objects
+ * carry the id and point into this table instead of owning a copy of
+ * their name, so parsing a token costs no string allocation, two symbols
+ * are equal exactly when their ids are, and the dictionary is indexed by
+ * id rather than hashed by name.
+ *
+ * The table is process-wide and thread-safe: ids are the same in every
+ * thread, which lets batch workers share one dictionary of primitives.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Id of the ':' symbol (always interned first) */
+#define TFSYM_COLON 0
+
+/** @brief Id of the ';' symbol */
+#define TFSYM_SEMICOLON 1
+
+/*
+ * The control flow words follow, in this order (see control.h). Their
+ * ids are fixed so the parser can recognize them without a lookup.
+ */
+
+/** @brief Id of 'if', the first control flow word */
+#define TFSYM_IF 2
+
+/** @brief Id of 'loop', the last control flow word */
+#define TFSYM_LOOP 8
+
+/** @brief Id of 'recurse', which calls the word being defined */
+#define TFSYM_RECURSE 9
+
+/** @brief Id of '[', which opens a quotation */
+#define TFSYM_LBRACKET 10
+
+/** @brief Id of ']', which closes a quotation */
+#define TFSYM_RBRACKET 11
+
+/**
+ * @brief Find or add a name in the intern table
+ * @param s Name bytes (need not be null-terminated, not retained)
+ * @param len Length of the name in bytes
+ * @param name If not NULL, receives the interned copy (null-terminated)
+ * @return The id of the name
+ *
+ * Ids are dense (0, 1, 2, ... in order of first appearance) and never
+ * change. Only the first occurrence of a name copies it; later calls
+ * with the same bytes just return its id, from the calling thread's
+ * cache without taking the table's lock.
+ */
+uint32_t internSymbol(const char *s, size_t len, const char **name);
+
+/**
+ * @brief Get the interned name for an id
+ * @param id Id returned by internSymbol()
+ * @return Null-terminated name, valid until freeInternTable()
+ */
+const char *internString(uint32_t id);
+
+/**
+ * @brief Free the calling thread's cache of names
+ *
+ * Threads free their cache when they exit, so this is only needed for
+ * a thread that goes on without interning names (and the main thread,
+ * whose exit runs no destructors: freeInternTable() does it for the
+ * thread that calls it).
+ */
+void internReleaseThread(void);
+
+/**
+ * @brief Release every interned name
+ *
+ * Call once at exit, after the last symbol object has been freed and
+ * every other thread has finished. Ids handed out before are invalid
+ * afterwards.
+ */
+void freeInternTable(void);
+
+#endif
@@ -3,21 +3,76 @@
  * @brief Implementation of dynamic list operations
  *
  * Provides functions for manipulating list objects, including appending
- * elements and automatic capacity management.
+ * elements and automatic capacity management, and for running them as
+ * quotations.
  */
 
+#include <stdlib.h>
+
 #include "list.h"
 #include "tf.h"
 #include "mem.h"
+#include "control.h"
 
 /* ===================== List Manipulation =================== */
 
 void listAppendObject(tfobj *list, tfobj *o) {
     if (list->list.len >= list->list.capacity) {
-        list->list.capacity = list->list.capacity * 2;
-        list->list.ele = xrealloc(list->list.ele, sizeof(tfobj *) * list->list.capacity);
+        // The list stays valid if the allocation fails into an error trap
+        size_t capacity = list->list.capacity * 2;
+        list->list.ele = xrealloc(list->list.ele, sizeof(tfobj *) * capacity);
+        list->list.capacity = capacity;
     }
     incRef(o);
     list->list.ele[list->list.len] = o;
     list->list.len++;
-}
\ No newline at end of file
+}
+
+void listReserve(tfobj *list, size_t n) {
+    if (n > list->list.capacity) {
+        list->list.ele = xrealloc(list->list.ele, sizeof(tfobj *) * n);
+        list->list.capacity = n;
+    }
+}
+
+void listChanged(tfobj *list) {
+    free(list->list.code);
+    list->list.code = NULL;
+    list->list.linked = 0;
+}
+
+/* ===================== Quotations =================== */
+
+/**
+ * @brief Link a list whose content was built or changed at run time
+ *
+ * Its symbols come from other lists ('concat', 'filter'...), and each one
+ * holds data about its place in a list: a jump target, the tail call flag
+ * and a depth check the analysis may have proven unnecessary there. The
+ * symbols shared with another list are copied, so that list keeps its
+ * own, and every check is put back.
+ */
+static void prepareQuotation(tfobj *quot) {
+    for (size_t i = 0; i < quot->list.len; i++) {
+        tfobj *o = quot->list.ele[i];
+        if (objType(o) != TFOBJ_TYPE_SYMBOL) continue;
+        if (o->refcount > 1) {
+            tfobj *copy = createSymbolObject(o->sym.ptr, o->sym.len);
+            copy->sym = o->sym;
+            incRef(copy->sym.arg);
+            copy->src_line = o->src_line;
+            copy->src_column = o->src_column;
+            decRef(o);
+            quot->list.ele[i] = o = copy;
+        }
+        o->sym.need = o->sym.in;
+    }
+    linkBranches(quot);
+}
+
+void callQuotation(tfctx *ctx, tfobj *quot) {
+    if (!quot->list.linked) {
+        prepareQuotation(quot);
+    }
+    ctx->run_quotation(ctx, quot);
+}
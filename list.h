@@ -3,6 +3,14 @@
  * @brief Dynamic list manipulation functions
  *
  * Provides operations for working with list objects (TFOBJ_TYPE_LIST).
+ * Lists are values, and a list of code written '[ ... ]' (a quotation)
+ * can also be run.
+ *
+ * Lists are shared by reference and copied on write: a word that changes
+ * a list does it in place when it holds the only reference (refcount 1),
+ * and works on a copy otherwise, so nobody else sees the change. A
+ * pipeline like '[ ... ] [ 1 + ] map [ 0 > ] filter' thus copies the
+ * literal once, then every step reuses the list it gets.
  */
 
 #ifndef LIST_H
@@ -20,4 +28,32 @@
  */
 void listAppendObject(tfobj *list, tfobj *o);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Make room for a total of n elements
+ * @param list List to grow
+ * @param n Number of elements it must be able to hold
+ */
+void listReserve(tfobj *list, size_t n);
+
+/**
+ * @brief Note that a list's content changed in place
+ * @param list List just modified
+ *
+ * Drops what was derived from the old content (the bytecode and jump
+ * targets used to run it as a quotation). Every in-place change of a
+ * list that may be run must call it.
+ */
+void listChanged(tfobj *list);
+
+/**
+ * @brief Run a list as code
+ * @param ctx Execution context
+ * @param quot List to run (the caller keeps its reference)
+ *
+ * Lists built at run time are linked first (see linkBranches()); their
+ * symbols are resolved already, since they come from quotations. Runs on
+ * ctx->run_quotation, the VM in use.
+ */
+void callQuotation(tfctx *ctx, tfobj *quot);
+
+#endif
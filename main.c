@@ -1,126 +1,310 @@
 /**
  * @file main.c
- * @brief Main entry point and virtual machine execution loop
+ * @brief Main entry point: command line options and run modes
  *
  * This module contains:
- * - File reading utilities
- * - The VM execution loop (exec)
- * - Program entry point (main)
+ * - Stream mode, which compiles and runs a program in bounded batches
+ * - REPL mode, which compiles and runs its input line by line
+ * - Program entry point (main), which parses the options and runs a file
+ *
+ * The VM loops and the compile pipeline live in vm.c, bytecode.c and
+ * profile.c, the batch mode in batch.c.
  */
 
-#include <ctype.h>
+#define _POSIX_C_SOURCE 200809L
+
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "tf.h"
 #include "mem.h"
-#include "stack.h"
 #include "parser.h"
-#include "dict.h"
-
-/* ===================== File I/O =================== */
+#include "fuse.h"
+#include "intern.h"
+#include "profile.h"
+#include "vm.h"
+#include "batch.h"
+#include "image.h"
+#include "output.h"
 
 /**
- * @brief Read an entire file into a string
- * @param filename Path to the file to read
- * @return Null-terminated string containing file contents
+ * @brief Compile and run a stream line by line, going on after errors
+ * @param ctx Execution context, kept for the whole session
+ * @param stream Stream to read lines from
+ * @param opt Options selecting the passes and the VM
  *
- * Reads the entire file into a dynamically allocated buffer. The caller
- * must free() the returned string. Exits with an error if the file cannot
- * be opened.
+ * Each line runs as soon as it is read (a definition, quotation or
+ * control structure may span several), and its output is flushed before
+ * the next one is read, so a process driving the interpreter through a
+ * pipe gets every answer right away. An error is printed to stderr and
+ * empties the stack, releasing its values (see resetContext()), but the
+ * definitions made so far are kept. A line that fails to compile frees
+ * what was parsed of it (compileLine() unwinds before the error reaches
+ * this trap), so a long session with many bad lines doesn't grow.
  */
-static char *readFile(const char *filename) {
-  FILE *file = fopen(filename, "r");
-  if (file == NULL) {
-    fprintf(stderr, "File not found\n");
-    exit(1);
-  }
-  fseek(file, 0, SEEK_END);
-  size_t size = ftell(file);
-
-  rewind(file);
-  char *buffer = xmalloc(size + 1);
-  fread(buffer, sizeof(char), size, file);
+static void runRepl(tfctx *ctx, FILE *stream, const runOptions *opt) {
+  char *buffer = xmalloc(STREAM_BUFFER_SIZE + 1);
+  tfparser parser;
+  initLineParser(&parser, stream, buffer, STREAM_BUFFER_SIZE);
+  tferrortrap trap = {.out = stderr, .name = NULL};
+  tferrortrap *old = setErrorTrap(&trap);
 
-  buffer[size] = '\0';
-  fclose(file);
-
-  return buffer;
+  for (;;) {
+    tfobj *volatile line = NULL;
+    if (setjmp(trap.jump) == 0) {
+      line = compileLine(&parser);
+      if (line == NULL) {
+        break;
+      }
+      runProgram(ctx, line, opt);
+    } else {
+      resetContext(ctx);
+      skipLine(&parser);
+    }
+    if (line) {
+      decRef(line);
+    }
+    flushOutput(&ctx->out);
+  }
+  setErrorTrap(old);
+  free(buffer);
 }
 
-/* ===================== Virtual Machine =================== */
+/* ===================== Main Entry Point =================== */
 
 /**
- * @brief Execute a compiled program
- * @param ctx Execution context (contains the stack)
- * @param program List object containing the compiled program
- *
- * This is the main VM loop. It iterates through the program list:
- * - Data objects (integers, booleans) are pushed onto the stack
- * - Symbol objects are looked up in the primitive dictionary and executed
+ * @brief Compile and run a stream batch by batch
+ * @param ctx Execution context
+ * @param stream Stream to read the program from
+ * @param opt Options selecting the passes and the VM
  *
- * The current object is tracked in ctx->current_object for error reporting.
- * Exits with an error if an unknown symbol is encountered.
+ * Reads through a STREAM_BUFFER_SIZE buffer and runs every
+ * STREAM_BATCH_SIZE top-level objects as soon as they are compiled, so
+ * output starts right away and memory use stays flat however long the
+ * input is. Definitions persist in the dictionary across batches.
  */
-void exec(tfctx *ctx, tfobj *program) {
-  for (size_t i = 0; i < program->list.len; i++) {
-    tfobj *o = program->list.ele[i];
-    ctx->current_object = o;
-    switch (o->type) {
-      case TFOBJ_TYPE_INT:
-      case TFOBJ_TYPE_BOOL:
-        // It's just data so we can
-        // push it to the stack
-        stackPush(ctx, o);
-        break;
-      case TFOBJ_TYPE_SYMBOL: {
-        /* We lookup the primitives' table to execute
-        * the correct symbol's function */
-        WordFn fn = lookupPrimitive(o->str.ptr);
-        if (!fn) {
-          char error_msg[256];
-          snprintf(error_msg, sizeof(error_msg), "Unknown word '%s'", o->str.ptr);
-          runtimeError(ctx, error_msg);
-        }
-        fn(ctx);
-        break;
-      }
-      default:
-        runtimeError(ctx, "Found an unknown keyword while executing the program");
-        break;
+static void runStream(tfctx *ctx, FILE *stream, const runOptions *opt) {
+  char *buffer = xmalloc(STREAM_BUFFER_SIZE + 1);
+  tfparser parser;
+  initStreamParser(&parser, stream, buffer, STREAM_BUFFER_SIZE);
+
+  for (;;) {
+    tfobj *batch = compileBatch(&parser, STREAM_BATCH_SIZE);
+    if (batch->list.len == 0) {
+      decRef(batch);
+      break;
     }
+    runProgram(ctx, batch, opt);
+    decRef(batch);
   }
+  free(buffer);
 }
 
-/* ===================== Main Entry Point =================== */
-
 /**
  * @brief Program entry point
  * @param argc Argument count
  * @param argv Argument vector
  * @return 0 on success, 1 on error
  *
- * Usage: toyforth <filename>
+ * Usage: toyforth [options] <filename>
+ *        toyforth [options] --repl [filename]
+ *        toyforth [options] --batch <directory or manifest>
+ *
+ * Reads the specified ToyForth source file, compiles it, resolves its
+ * symbols, folds constant expressions, fuses common word sequences,
+ * removes the depth checks it can prove unnecessary, and executes it.
+ * By default the program is lowered to bytecode and run by the threaded
+ * interpreter.
+ *
+ * Options:
+ * - --list: run the reference list-walking VM instead (for differential
+ *   testing)
+ * - --no-fuse: skip the superinstruction pass
+ * - --no-fold: skip constant folding and keep every depth check
+ * - --pairs: run the unfused program on the reference VM and print how
+ *   often each pair of words was executed, to tune the fusion rules
+ * - --stream: read, compile and run the file in bounded batches instead
+ *   of loading it whole (implied when the filename is '-', for stdin)
+ * - --profile: run on the profiling VM and print the time and allocations
+ *   of every word and the hottest call sites on exit
+ * - --flame FILE: profile, and write the call paths to FILE in collapsed
+ *   stack format for flame graph tools
+ * - --stats: print memory, refcount and stack statistics on exit
+ * - --batch PATH: run every script of a directory or manifest on a pool
+ *   of threads, printing their outputs in order (see batch.h); exits
+ *   with 1 if any script failed. Not with the profiling options,
+ *   --stream, --stats, --repl, --flush or --image
+ * - --jobs N: number of threads for --batch (default: one per CPU)
+ * - --repl: after running the file, if any, read lines from stdin and
+ *   run each one as it comes, with the same stack and definitions (see
+ *   runRepl()). Not with --stream
+ * - --flush POLICY: when the buffered output is written: 'line' (at
+ *   every newline, the default on a terminal), 'size' (when the 64KB
+ *   buffer is full, the default otherwise) or 'exit' (at the end of the
+ *   run, or by the 'flush' word)
+ * - --image FILE: load the compiled program from FILE if it was made
+ *   from this source, otherwise compile it and save it there (see
+ *   image.h). Not with --stream
  *
- * Reads the specified ToyForth source file, compiles it, and executes it.
  * Properly cleans up all allocated resources before exiting.
  */
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
+  runOptions opt = {0, 1, 1};
+  int profile_pairs = 0;
+  int profile_words = 0;
+  const char *flame_file = NULL;
+  int print_stats = 0;
+  int use_stream = 0;
+  int use_repl = 0;
+  const char *batch_path = NULL;
+  int jobs = 0;
+  const char *image_file = NULL;
+  const char *flush_name = NULL;
+  const char *filename = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--list") == 0) {
+      opt.use_list = 1;
+    } else if (strcmp(argv[i], "--no-fuse") == 0) {
+      opt.use_fuse = 0;
+    } else if (strcmp(argv[i], "--no-fold") == 0) {
+      opt.use_fold = 0;
+    } else if (strcmp(argv[i], "--pairs") == 0) {
+      profile_pairs = 1;
+      opt.use_list = 1;
+      opt.use_fuse = 0;
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      use_stream = 1;
+    } else if (strcmp(argv[i], "--repl") == 0) {
+      use_repl = 1;
+    } else if (strcmp(argv[i], "--profile") == 0) {
+      profile_words = 1;
+    } else if (strcmp(argv[i], "--flame") == 0 && i + 1 < argc) {
+      flame_file = argv[++i];
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      print_stats = 1;
+    } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      batch_path = argv[++i];
+    } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+      jobs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--flush") == 0 && i + 1 < argc) {
+      flush_name = argv[++i];
+    } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+      image_file = argv[++i];
+    } else if (filename == NULL) {
+      filename = argv[i];
+    } else {
+      filename = NULL;
+      break;
+    }
+  }
+  if (batch_path && !filename && !profile_pairs && !profile_words &&
+      !flame_file && !use_stream && !print_stats && !use_repl &&
+      !flush_name && !image_file) {
+    int failed = runBatch(batch_path, jobs, &opt);
+    if (failed < 0) {
+      fprintf(stderr, "Cannot read '%s'\n", batch_path);
+    }
+    freeInternTable();
+    return failed != 0;
+  }
+  int from_stdin = filename && strcmp(filename, "-") == 0;
+  int flush_policy = flush_name ? parseFlushPolicy(flush_name) : -1;
+  if ((filename == NULL && !use_repl) || batch_path ||
+      (flush_name && flush_policy < 0) ||
+      (use_repl && (use_stream || from_stdin)) ||
+      (image_file && (use_stream || from_stdin))) {
+    fprintf(stderr, "Usage: %s [--list] [--no-fuse] [--no-fold] [--pairs] [--stream] [--profile] [--flame FILE] [--stats] [--flush POLICY] [--image FILE] <filename>\n"
+                    "       %s [--list] [--no-fuse] [--no-fold] [--stats] [--flush POLICY] [--image FILE] --repl [filename]\n"
+                    "       %s [--list] [--no-fuse] [--no-fold] [--jobs N] --batch <directory or manifest>\n", argv[0], argv[0], argv[0]);
     return 1;
   }
   tfctx *ctx = createContext();
+  if (profile_pairs) {
+    ctx->pairs = createPairProfile();
+  }
+  if (profile_words || flame_file) {
+    ctx->profile = createProfile();
+  }
+  if (flush_name) {
+    ctx->out.policy = flush_policy;
+  }
 
-  char *progtxt = readFile(argv[1]);
+  // An error ends the run here, so that what the program printed is
+  // written out before the message
+  tferrortrap trap = {.out = NULL, .name = NULL};
+  setErrorTrap(&trap);
+  if (setjmp(trap.jump) != 0) {
+    flushOutput(&ctx->out);
+    fprintf(stderr, "%s\n", trap.message);
+    exit(1);
+  }
 
-  tfobj *program = compile(progtxt);
-  exec(ctx, program);
+  if (from_stdin) {
+    runStream(ctx, stdin, &opt);
+  } else if (use_stream) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+      fprintf(stderr, "File not found\n");
+      exit(1);
+    }
+    runStream(ctx, file, &opt);
+    fclose(file);
+  } else if (filename) {
+    sourceFile src;
+    if (loadFile(filename, &src) != 0) {
+      fprintf(stderr, "File not found\n");
+      exit(1);
+    }
+    tfobj *program = NULL;
+    if (image_file) {
+      uint64_t hash = hashSource(src.text, src.len);
+      program = loadImage(image_file, hash);
+      if (program == NULL) {
+        program = compile(src.text, src.len);
+        if (saveImage(image_file, program, hash) != 0) {
+          fprintf(stderr, "Cannot write '%s'\n", image_file);
+        }
+      }
+    } else {
+      program = compile(src.text, src.len);
+    }
+    unloadFile(&src);   // Symbol names are interned, the text isn't needed
+    runProgram(ctx, program, &opt);
+    decRef(program);
+  }
+  if (use_repl) {
+    runRepl(ctx, stdin, &opt);
+  }
+  setErrorTrap(NULL);
+  flushOutput(&ctx->out);
 
-  decRef(program);
+  if (ctx->pairs) {
+    printPairProfile(ctx->pairs, stderr);
+    freePairProfile(ctx->pairs);
+  }
+  if (ctx->profile) {
+    if (profile_words) {
+      printProfile(ctx->profile, stderr);
+    }
+    if (flame_file) {
+      FILE *f = fopen(flame_file, "w");
+      if (f == NULL) {
+        fprintf(stderr, "Cannot write '%s'\n", flame_file);
+        exit(1);
+      }
+      printCollapsedStacks(ctx->profile, f);
+      fclose(f);
+    }
+    freeProfile(ctx->profile);
+  }
+  if (print_stats) {
+    printStats(ctx, stderr);
+  }
   freeContext(ctx);
-  free(progtxt);
+  freeInternTable();
 
   return 0;
 }
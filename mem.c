@@ -4,13 +4,23 @@
  *
  * This module provides the core memory management functionality for ToyForth,
  * including safe allocation wrappers, reference counting, and object creation.
+ *
+ * The pool and the counters are per thread (_Thread_local), so threads
+ * running separate contexts never contend for them. Reference counts
+ * are not atomic: an object must only be used by the thread that
+ * allocated it.
  */
 
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "mem.h"
 #include "tf.h"
+#include "dict.h"
+#include "intern.h"
+#include "output.h"
 
 /* ===================== De/Allocation wrappers =================== */
 
@@ -27,8 +37,7 @@ static void freeObject(tfobj *o);
 void *xmalloc(size_t size) {
     void *ptr = malloc(size);
     if (ptr == NULL) {
-      fprintf(stderr, "Out of memory allocating %zu bytes\n", size);
-      exit(1);
+      memoryError(size);
     }
     return ptr;
 }
@@ -36,21 +45,199 @@ void *xmalloc(size_t size) {
 void *xrealloc(void *ptr, size_t size) {
     ptr = realloc(ptr, size);
     if (ptr == NULL) {
-      fprintf(stderr, "Out of memory reallocating %zu bytes\n", size);
-      exit(1);
+      memoryError(size);
+    }
+    return ptr;
+}
+
+/* ===================== Pool allocator =================== */
+
+/** @brief Size classes are multiples of this many bytes */
+#define POOL_GRANULE 16
+
+/** @brief Number of size classes (POOL_MAX_SIZE / POOL_GRANULE) */
+#define POOL_CLASSES (POOL_MAX_SIZE / POOL_GRANULE)
+
+/**
+ * @brief A free cell; the link lives in the cell itself (intrusive list)
+ */
+typedef struct poolCell {
+    struct poolCell *next;
+} poolCell;
+
+/**
+ * @brief Allocation state of one size class
+ *
+ * Freed cells go on the free list. When it is empty, new cells are bumped
+ * off the class's current slab, so consecutive allocations are contiguous.
+ */
+typedef struct poolClass {
+    poolCell *free;    /**< Free list of recycled cells */
+    char *bump;        /**< Next never-used cell in the current slab */
+    char *end;         /**< End of the current slab */
+} poolClass;
+
+/** @brief Memory counters of this thread, see memoryStats() */
+static _Thread_local tfstats memStats;
+
+#ifndef TF_NO_STATS
+/** @brief Sum of memStats.live_objects, to track the peak cheaply */
+static _Thread_local unsigned long memLiveObjects;
+#endif
+
+#ifdef TF_NO_STATS
+#define STAT(stmt) ((void)0)
+#else
+#define STAT(stmt) (stmt)
+#endif
+
+#ifndef TF_NO_POOL
+/**
+ * @brief Header of a slab, linking the thread's slabs for poolRelease()
+ *
+ * It takes one granule, so the cells after it stay 16-byte aligned.
+ */
+typedef struct poolSlab {
+    struct poolSlab *next;
+} poolSlab;
+
+static _Thread_local poolClass poolClasses[POOL_CLASSES];
+static _Thread_local poolSlab *poolSlabs;
+
+/**
+ * @brief Get a fresh slab for a size class
+ *
+ * Slabs are only given back to libc by poolRelease(): a program that once
+ * needed that many objects will likely need them again, and the cells
+ * stay on free lists.
+ */
+static void poolRefill(poolClass *pc) {
+    poolSlab *slab = xmalloc(POOL_SLAB_SIZE);
+    slab->next = poolSlabs;
+    poolSlabs = slab;
+    pc->bump = (char *)slab + POOL_GRANULE;
+    pc->end = (char *)slab + POOL_SLAB_SIZE;
+}
+#endif
+
+void *poolAlloc(size_t size) {
+    STAT((memStats.allocs++, memStats.live_bytes += size,
+          memStats.peak_live_bytes = memStats.live_bytes > memStats.peak_live_bytes
+                                   ? memStats.live_bytes : memStats.peak_live_bytes));
+#ifdef TF_NO_POOL
+    return xmalloc(size);
+#else
+    if (size == 0 || size > POOL_MAX_SIZE) {
+        return xmalloc(size);
     }
+    size_t cls = (size - 1) / POOL_GRANULE;
+    poolClass *pc = &poolClasses[cls];
+
+    poolCell *cell = pc->free;
+    if (cell != NULL) {
+        pc->free = cell->next;
+        return cell;
+    }
+    size_t cell_size = (cls + 1) * POOL_GRANULE;
+    if (pc->bump + cell_size > pc->end) {
+        poolRefill(pc);
+    }
+    void *ptr = pc->bump;
+    pc->bump += cell_size;
     return ptr;
+#endif
+}
+
+unsigned long poolAllocations(void) {
+    return memStats.allocs;
+}
+
+void poolFree(void *ptr, size_t size) {
+    if (ptr != NULL) {
+        STAT((memStats.frees++, memStats.live_bytes -= size));
+    }
+#ifdef TF_NO_POOL
+    (void)size;
+    free(ptr);
+#else
+    if (ptr == NULL) {
+        return;
+    }
+    if (size == 0 || size > POOL_MAX_SIZE) {
+        free(ptr);
+        return;
+    }
+    poolClass *pc = &poolClasses[(size - 1) / POOL_GRANULE];
+    poolCell *cell = ptr;
+    cell->next = pc->free;
+    pc->free = cell;
+#endif
+}
+
+void poolRelease(void) {
+#ifndef TF_NO_POOL
+    while (poolSlabs) {
+        poolSlab *next = poolSlabs->next;
+        free(poolSlabs);
+        poolSlabs = next;
+    }
+    memset(poolClasses, 0, sizeof(poolClasses));
+#endif
+}
+
+/**
+ * @brief Pool state kept aside while its owner isn't running
+ */
+struct tfpool {
+#ifndef TF_NO_POOL
+    poolClass classes[POOL_CLASSES];
+    poolSlab *slabs;
+#else
+    int unused;
+#endif
+};
+
+tfpool *createPool(void) {
+    tfpool *pool = xmalloc(sizeof(tfpool));
+    memset(pool, 0, sizeof(tfpool));
+    return pool;
 }
 
+void poolSwap(tfpool *pool) {
+#ifndef TF_NO_POOL
+    // A handful of pointers: cheap enough to do around every API call
+    poolClass classes[POOL_CLASSES];
+    memcpy(classes, poolClasses, sizeof(classes));
+    memcpy(poolClasses, pool->classes, sizeof(classes));
+    memcpy(pool->classes, classes, sizeof(classes));
+    poolSlab *slabs = poolSlabs;
+    poolSlabs = pool->slabs;
+    pool->slabs = slabs;
+#else
+    (void)pool;
+#endif
+}
+
+void freePool(tfpool *pool) {
+    poolSwap(pool);
+    poolRelease();
+    poolSwap(pool);
+    free(pool);
+}
+
+/* ===================== Reference counting =================== */
+
 void incRef(tfobj *o) {
-    if (o == NULL)
+    if (o == NULL || isImmediate(o))
         return;
+    STAT(memStats.increfs++);
     o->refcount++;
 }
   
 void decRef(tfobj *o) {
-    if (o == NULL)
+    if (o == NULL || isImmediate(o))
         return;
+    STAT(memStats.decrefs++);
 
     o->refcount--;
     if (o->refcount == 0) {
@@ -63,15 +250,28 @@ static void freeObject(tfobj *o) {
         return;
     }
 
-    if (o->type == TFOBJ_TYPE_STR || o->type == TFOBJ_TYPE_SYMBOL) {
-        free(o->str.ptr);
+    if (o->type == TFOBJ_TYPE_STR) {
+        poolFree(o->str.ptr, o->str.len + 1);
+    } else if (o->type == TFOBJ_TYPE_SYMBOL) {
+        decRef(o->sym.arg);
+    } else if (o->type == TFOBJ_TYPE_BIGINT) {
+        free(o->big.limbs);
+    } else if (o->type == TFOBJ_TYPE_INTVEC) {
+        free(o->vec.data);
     } else if (o->type == TFOBJ_TYPE_LIST) {
         for (size_t i = 0; i < o->list.len; i++) {
         decRef(o->list.ele[i]);
         }
         free(o->list.ele);
+        free(o->list.code);
+    } else if (o->type == TFOBJ_TYPE_WORD) {
+        decRef(o->word.name);
+        decRef(o->word.body);
+        decRef(o->word.prev);
+        free(o->word.code);
     }
-    free(o);
+    STAT((memStats.live_objects[o->type]--, memLiveObjects--));
+    poolFree(o, sizeof(tfobj));
 }
   
 /* ===================== Object creation =================== */
@@ -85,7 +285,13 @@ static void freeObject(tfobj *o) {
  * allocate and initialize the common fields of a tfobj.
  */
 static tfobj *createObject(int type) {
-    tfobj *o = xmalloc(sizeof(tfobj));
+    tfobj *o = poolAlloc(sizeof(tfobj));
+#ifndef TF_NO_STATS
+    memStats.live_objects[type]++;
+    if (++memLiveObjects > memStats.peak_live_objects) {
+        memStats.peak_live_objects = memLiveObjects;
+    }
+#endif
     o->type = type;
     o->refcount = 1;
     o->src_line = 0;
@@ -100,21 +306,57 @@ tfobj *createStringObject(char *s, size_t len) {
     return o;
 }
 
-tfobj *createIntObject(int i) {
-    tfobj *o = createObject(TFOBJ_TYPE_INT);
-    o->i = i;
+tfobj *createIntObject(int64_t i) {
+    if (i < TFIMM_INT_MIN || i > TFIMM_INT_MAX) {
+        tfobj *o = createObject(TFOBJ_TYPE_INT);
+        o->i = i;
+        return o;
+    }
+    return makeImmInt((intptr_t)i);
+}
+
+tfobj *createBigIntObject(uint32_t *limbs, size_t len, int neg) {
+    tfobj *o = createObject(TFOBJ_TYPE_BIGINT);
+    o->big.limbs = limbs;
+    o->big.len = len;
+    o->big.neg = neg;
+    return o;
+}
+
+tfobj *createIntVecObject(size_t len) {
+    if (len > SIZE_MAX / sizeof(int64_t)) {
+        memoryError(SIZE_MAX);   // The byte count would wrap around
+    }
+    tfobj *o = createObject(TFOBJ_TYPE_INTVEC);
+    o->vec.data = xmalloc(sizeof(int64_t) * (len ? len : 1));
+    o->vec.len = len;
     return o;
 }
 
 tfobj *createBoolObject(int i) {
-    tfobj *o = createObject(TFOBJ_TYPE_BOOL);
-    o->i = i;
-    return o;
+    return makeImmBool(i);
 }
 
-tfobj *createSymbolObject(char *s, size_t len) {
-    tfobj *o = createStringObject(s, len);
-    o->type = TFOBJ_TYPE_SYMBOL;
+tfobj *createSymbolObject(const char *s, size_t len) {
+    const char *name;
+    uint32_t id = internSymbol(s, len, &name);
+    return createInternedSymbolObject(id, name, len);
+}
+
+tfobj *createInternedSymbolObject(uint32_t id, const char *name, size_t len) {
+    tfobj *o = createObject(TFOBJ_TYPE_SYMBOL);
+    o->sym.id = id;
+    o->sym.ptr = name;
+    o->sym.len = len;
+    o->sym.fn = NULL;
+    o->sym.word = NULL;
+    o->sym.arg = NULL;
+    o->sym.in = 0;
+    o->sym.out = 0;
+    o->sym.need = 0;
+    o->sym.control = 0;
+    o->sym.target = 0;
+    o->sym.tail = 0;
     return o;
 }
 
@@ -123,40 +365,191 @@ tfobj *createListObject(size_t capacity) {
     o->list.capacity = capacity;
     o->list.len = 0;
     o->list.ele = xmalloc(sizeof(tfobj *) * o->list.capacity);
+    o->list.code = NULL;
+    o->list.linked = 0;
 
     return o;
 }
 
+tfobj *createWordObject(tfobj *name, WordFn fn, tfobj *body) {
+    tfobj *o = createObject(TFOBJ_TYPE_WORD);
+    incRef(name);
+    incRef(body);
+    o->word.name = name;
+    o->word.fn = fn;
+    o->word.body = body;
+    o->word.prev = NULL;
+    o->word.code = NULL;
+    o->word.in = 0;
+    o->word.out = 0;
+    o->word.flags = 0;
+    return o;
+}
+
 /* ===================== Context management =================== */
 
-tfctx *createContext() {
+/**
+ * @brief Create a context around a dictionary (taking it over)
+ */
+static tfctx *createContextWith(tfdict *dict) {
     tfctx *ctx = xmalloc(sizeof(tfctx));
 
     ctx->sp = 0;
     ctx->capacity = INITIAL_STACK_CAPACITY;
+    ctx->max_sp = 0;
     ctx->stack = xmalloc(sizeof(tfobj *) * ctx->capacity);
     ctx->current_object = NULL;
+    ctx->loop_sp = 0;
+    ctx->loop_capacity = INITIAL_LOOP_CAPACITY;
+    ctx->loops = xmalloc(sizeof(tfloop) * ctx->loop_capacity);
+    ctx->rsp = 0;
+    ctx->rstack_capacity = INITIAL_RETURN_CAPACITY;
+    ctx->rstack = xmalloc(sizeof(tfframe) * ctx->rstack_capacity);
+    ctx->dict = dict;
+    ctx->pairs = NULL;
+    ctx->profile = NULL;
+    ctx->run_quotation = NULL;
+    initOutput(&ctx->out, stdout);
 
     return ctx;
 }
 
+tfctx *createContext(void) {
+    return createContextWith(createDict());
+}
+
+tfctx *createChildContext(const tfdict *base) {
+    return createContextWith(createChildDict(base));
+}
+
+void resetContext(tfctx *ctx) {
+    // Only the operands of the word that failed may be in use by it
+    tfobj *o = ctx->current_object;
+    size_t held = 0;
+    if (o != NULL && objType(o) == TFOBJ_TYPE_SYMBOL && o->sym.in > 0) {
+        held = (size_t)o->sym.in;
+    }
+    for (size_t i = 0; i + held < ctx->sp; i++) {
+        decRef(ctx->stack[i]);
+    }
+    ctx->sp = 0;
+    ctx->loop_sp = 0;
+    ctx->rsp = 0;
+    ctx->current_object = NULL;
+}
+
 void freeContext(tfctx *ctx) {
     // decRef all the objects still on the stack
     for (size_t i = 0; i < ctx->sp; i++) {
         decRef(ctx->stack[i]);
     }
     free(ctx->stack);
+    free(ctx->loops);
+    free(ctx->rstack);
+    freeOutput(&ctx->out);
+    freeDict(ctx->dict);
     free(ctx);
 }
 
+/* ===================== Statistics =================== */
+
+const tfstats *memoryStats(void) {
+    return &memStats;
+}
+
+void printStats(tfctx *ctx, FILE *out) {
+    static const char *const names[TFOBJ_TYPE_COUNT] = {
+        "int", "str", "bool", "list", "symbol", "word", "bigint", "intvec"
+    };
+#ifdef TF_NO_STATS
+    fprintf(out, "stats: not available (built with TF_NO_STATS)\n");
+    (void)names;
+    (void)ctx;
+#else
+    const tfstats *s = &memStats;
+    fprintf(out, "objects: %lu live (peak %lu):", memLiveObjects, s->peak_live_objects);
+    for (int t = 0; t < TFOBJ_TYPE_COUNT; t++) {
+        fprintf(out, " %s %lu", names[t], s->live_objects[t]);
+    }
+    fprintf(out, "\npool: %lu allocs, %lu frees, %zu bytes live (peak %zu)\n",
+            s->allocs, s->frees, s->live_bytes, s->peak_live_bytes);
+    fprintf(out, "refcount: %lu incRef, %lu decRef\n", s->increfs, s->decrefs);
+    fprintf(out, "stack: depth %zu (peak %zu)\n", ctx->sp, ctx->max_sp);
+#endif
+}
+
+/* ===================== Error handling =================== */
+
+/** @brief Trap of this thread, see setErrorTrap() */
+static _Thread_local tferrortrap *errorTrap;
+
+tferrortrap *setErrorTrap(tferrortrap *trap) {
+    tferrortrap *old = errorTrap;
+    errorTrap = trap;
+    return old;
+}
+
+/**
+ * @brief Report an error and stop, at the trap if one is set
+ * @param error TFERR_* kind of the error
+ * @param msg Complete message, possibly several lines, without the
+ *            final newline
+ */
+static void raiseError(int error, const char *msg) {
+    tferrortrap *trap = errorTrap;
+    if (trap == NULL) {
+        fprintf(stderr, "%s\n", msg);
+        exit(1);
+    }
+    trap->error = error;
+    snprintf(trap->message, sizeof(trap->message), "%s", msg);
+    if (trap->out) {
+        if (trap->name) {
+            fprintf(trap->out, "%s: ", trap->name);
+        }
+        fprintf(trap->out, "%s\n", msg);
+    }
+    longjmp(trap->jump, 1);
+}
+
+/**
+ * @brief Format " at line L, column C" for an object with a location
+ */
+static void formatLocation(char *buf, size_t size, tfobj *o) {
+    if (o && !isImmediate(o) && o->src_line > 0) {
+        snprintf(buf, size, " at line %d, column %d", o->src_line, o->src_column);
+    } else {
+        buf[0] = '\0';
+    }
+}
+
 void runtimeError(tfctx *ctx, const char *msg) {
-    fprintf(stderr, "Runtime error");
-    if (ctx->current_object && ctx->current_object->src_line > 0) {
-        fprintf(stderr, " at line %d, column %d",
-            ctx->current_object->src_line,
-            ctx->current_object->src_column);
-    }
-    fprintf(stderr, ": %s\n", msg);
-    fprintf(stderr, "Stack depth: %zu\n", ctx->sp);
-    exit(1);
-}
\ No newline at end of file
+    char where[64], text[512];
+    // What the program printed comes before the error
+    flushOutput(&ctx->out);
+    formatLocation(where, sizeof(where), ctx->current_object);
+    snprintf(text, sizeof(text), "Runtime error%s: %s\nStack depth: %zu",
+             where, msg, ctx->sp);
+    raiseError(TFERR_RUNTIME, text);
+}
+
+void compileError(tfobj *o, const char *msg) {
+    char where[64], text[512];
+    formatLocation(where, sizeof(where), o);
+    snprintf(text, sizeof(text), "Compile error%s: %s", where, msg);
+    raiseError(TFERR_COMPILE, text);
+}
+
+void inputError(const char *msg) {
+    raiseError(TFERR_COMPILE, msg);
+}
+
+void reraiseError(const tferrortrap *trap) {
+    raiseError(trap->error, trap->message);
+}
+
+void memoryError(size_t size) {
+    char text[64];
+    snprintf(text, sizeof(text), "Out of memory allocating %zu bytes", size);
+    raiseError(TFERR_MEMORY, text);
+}
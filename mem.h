@@ -9,6 +9,8 @@
 #ifndef MEM_H
 #define MEM_H
 #include <stddef.h>
+#include <setjmp.h>
+#include <stdio.h>
 #include "tf.h"
 
 /* ===================== Memory allocation wrappers =================== */
@@ -19,8 +21,9 @@
  * @return Pointer to allocated memory (never NULL)
  *
  * This function wraps malloc() and automatically exits the program with
- * an error message if allocation fails. This ensures NULL checks are not
- * needed throughout the codebase.
+ * an error message if allocation fails (or jumps to the thread's error
+ * trap, see memoryError()). This ensures NULL checks are not needed
+ * throughout the codebase.
  */
 void *xmalloc(size_t size);
 
@@ -31,10 +34,85 @@ void *xmalloc(size_t size);
  * @return Pointer to reallocated memory (never NULL)
  *
  * This function wraps realloc() and automatically exits the program with
- * an error message if reallocation fails.
+ * an error message if reallocation fails (or jumps to the thread's error
+ * trap). The old block is left intact in that case.
  */
 void *xrealloc(void *ptr, size_t size);
 
+/* ===================== Pool allocator =================== */
+
+/**
+ * @brief Allocate a small block from the object pool
+ * @param size Number of bytes to allocate
+ * @return Pointer to allocated memory (never NULL, 16-byte aligned)
+ *
+ * Requests up to POOL_MAX_SIZE bytes are served from per-size-class free
+ * lists carved out of large slabs, so the common case is a pointer pop and
+ * objects of the same size end up packed next to each other. Bigger
+ * requests go to xmalloc(). All tfobj cells and symbol/string payloads
+ * come from here.
+ *
+ * Building with -DTF_NO_POOL (make POOL=0) turns this into plain
+ * xmalloc(), which is what you want under AddressSanitizer or Valgrind.
+ */
+void *poolAlloc(size_t size);
+
+/**
+ * @brief Number of poolAlloc() calls made so far
+ *
+ * Used by the profiler to attribute allocations to the words making them.
+ */
+unsigned long poolAllocations(void);
+
+/**
+ * @brief Return a block to the object pool
+ * @param ptr Block obtained from poolAlloc() (NULL-safe)
+ * @param size The size that was passed to poolAlloc()
+ */
+void poolFree(void *ptr, size_t size);
+
+/**
+ * @brief Give every slab of the calling thread back to libc
+ *
+ * Only when none of the thread's pool objects is alive any more, e.g.
+ * at the end of a batch worker. The pool starts over empty.
+ */
+void poolRelease(void);
+
+/**
+ * @brief Pool owned by an embedded instance rather than by a thread
+ *
+ * An embedded instance (toyforth.c) may be used by several threads in
+ * turn and destroyed on any of them, so its objects can't come from the
+ * pool of the thread running it: that pool is only released when the
+ * thread says so (poolRelease()), which threads of a host program never
+ * do. The instance owns a tfpool instead and makes it the thread's pool
+ * for the duration of each call.
+ */
+typedef struct tfpool tfpool;
+
+/**
+ * @brief Create an empty pool
+ */
+tfpool *createPool(void);
+
+/**
+ * @brief Exchange the calling thread's pool with another one
+ *
+ * Call it once to allocate from 'pool' (what the thread had is kept in
+ * it), and once more to go back.
+ */
+void poolSwap(tfpool *pool);
+
+/**
+ * @brief Give every slab of a pool back to libc and free it
+ *
+ * The pool must not be swapped in. Whatever objects are still in it,
+ * including those leaked by errors (see resetContext()), are gone, but
+ * not the libc buffers they own (list arrays, vector data, bigint limbs).
+ */
+void freePool(tfpool *pool);
+
 /* ===================== Reference counting =================== */
 
 /**
@@ -42,7 +120,8 @@ void *xrealloc(void *ptr, size_t size);
  * @param o Object to increment (NULL-safe)
  *
  * Call this when a new reference to an object is created (e.g., when
- * storing it in a data structure). Does nothing if o is NULL.
+ * storing it in a data structure). Does nothing if o is NULL or an
+ * immediate value.
  */
 void incRef(tfobj *o);
 
@@ -52,7 +131,7 @@ void incRef(tfobj *o);
  *
  * Call this when a reference to an object is no longer needed. When the
  * reference count reaches 0, the object is automatically freed. Does
- * nothing if o is NULL.
+ * nothing if o is NULL or an immediate value.
  */
 void decRef(tfobj *o);
 
@@ -64,35 +143,74 @@ void decRef(tfobj *o);
  * @param len Length of string in bytes
  * @return New string object with refcount=1
  *
- * The string pointer 's' must be heap-allocated, as it will be freed
- * when the object is destroyed.
+ * The string pointer 's' must come from poolAlloc(len + 1), as it will be
+ * returned to the pool when the object is destroyed.
  */
 tfobj *createStringObject(char *s, size_t len);
 
 /**
  * @brief Create a new integer object
  * @param i Integer value
- * @return New integer object with refcount=1
+ * @return Immediate integer, or a new heap object with refcount=1 if the
+ *         value doesn't fit in an immediate
+ *
+ * On 64-bit platforms only values beyond 63 bits allocate.
+ */
+tfobj *createIntObject(int64_t i);
+
+/**
+ * @brief Create a new big integer object
+ * @param limbs Magnitude from xmalloc(), least significant limb first
+ *              (ownership is transferred to the object)
+ * @param len Number of limbs, the top one nonzero
+ * @param neg Nonzero for a negative number
+ * @return New object with refcount=1
+ *
+ * Only for values outside the int64_t range; see makeNumber() in
+ * bigint.c, which picks the right representation.
+ */
+tfobj *createBigIntObject(uint32_t *limbs, size_t len, int neg);
+
+/**
+ * @brief Create a new integer vector object
+ * @param len Number of elements
+ * @return New object with refcount=1 whose elements are left
+ *         uninitialized for the caller to fill
+ *
+ * A len too large to count in bytes is reported like a failed
+ * allocation (see memoryError()).
  */
-tfobj *createIntObject(int i);
+tfobj *createIntVecObject(size_t len);
 
 /**
  * @brief Create a new boolean object
  * @param i Boolean value (0=false, non-zero=true)
- * @return New boolean object with refcount=1
+ * @return Immediate boolean (never allocates)
  */
 tfobj *createBoolObject(int i);
 
 /**
  * @brief Create a new symbol object (identifier/word)
- * @param s Pointer to symbol string data (takes ownership)
- * @param len Length of symbol string in bytes
+ * @param s Pointer to the name (need not be null-terminated, not retained)
+ * @param len Length of the name in bytes
  * @return New symbol object with refcount=1
  *
- * Similar to createStringObject, but creates a SYMBOL type instead.
- * The string pointer 's' must be heap-allocated.
+ * The name is looked up in the intern table (see intern.h) rather than
+ * copied, so 's' can point straight into the source text and symbols
+ * with equal names share their storage.
  */
-tfobj *createSymbolObject(char *s, size_t len);
+tfobj *createSymbolObject(const char *s, size_t len);
+
+/**
+ * @brief Create a symbol object for a name already interned
+ * @param id Intern id of the name
+ * @param name The interned name (as returned by internSymbol())
+ * @param len Length of the name in bytes
+ * @return New symbol object with refcount=1
+ *
+ * For loaders that intern each distinct name once, like loadImage().
+ */
+tfobj *createInternedSymbolObject(uint32_t id, const char *name, size_t len);
 
 /**
  * @brief Create a new list object
@@ -104,36 +222,172 @@ tfobj *createSymbolObject(char *s, size_t len);
  */
 tfobj *createListObject(size_t capacity);
 
+/**
+ * @brief Create a new word object (dictionary entry)
+ * @param name Symbol object naming the word (its refcount is incremented)
+ * @param fn C implementation for primitives, or NULL for colon definitions
+ * @param body Compiled body list for colon definitions (its refcount is
+ *             incremented), or NULL for primitives
+ * @return New word object with refcount=1
+ */
+tfobj *createWordObject(tfobj *name, WordFn fn, tfobj *body);
+
 /* ===================== Context management =================== */
 
 /**
  * @brief Create a new execution context with an empty stack
- * @return New context with initialized stack
+ * @return New context with initialized stack and a dictionary holding
+ *         all the primitives
  *
  * The context must be freed with freeContext() when done.
  */
 tfctx *createContext(void);
 
+/**
+ * @brief Create a context whose dictionary sits on top of a shared one
+ * @param base Dictionary holding the primitives (see createChildDict())
+ * @return New context, to be freed with freeContext()
+ *
+ * Creating it costs no primitive lookups or allocations per word, and
+ * the definitions the program makes stay in the context.
+ */
+tfctx *createChildContext(const tfdict *base);
+
 /**
  * @brief Free an execution context and all objects on its stack
  * @param ctx Context to free
  *
  * This decrements the reference count of all objects still on the stack,
- * then frees the context structure itself.
+ * frees the dictionary, then frees the context structure itself.
  */
 void freeContext(tfctx *ctx);
 
+/**
+ * @brief Empty the stacks of a context after an error
+ * @param ctx Context whose program stopped at an error trap
+ *
+ * The values left on the stack are released, except the operands of
+ * the word that failed (ctx->current_object): it may have been using
+ * them without a reference of its own, so releasing them could free an
+ * object twice. Those few are leaked instead, buffers and all (only
+ * their pool cells come back, with freePool() or poolRelease()). The
+ * dictionary is kept, so the context can run more code.
+ *
+ * ctx->current_object must be NULL or a live object: runProgram() clears
+ * it when the program ends, so an error before the next one runs (while
+ * compiling it) releases the whole stack.
+ */
+void resetContext(tfctx *ctx);
+
+/* ===================== Statistics =================== */
+
+/**
+ * @brief Get the memory and reference counting counters
+ * @return Counters since the start of the program (never NULL)
+ *
+ * Live objects only count heap objects: immediate integers and booleans
+ * cost no memory. Bytes count pool allocations, i.e. objects and their
+ * small payloads, not list arrays or the stack itself.
+ */
+const tfstats *memoryStats(void);
+
+/**
+ * @brief Print the counters and the stack high-water mark
+ * @param ctx Execution context (for the stack depth)
+ * @param out Stream to print to
+ *
+ * This is what the '.stats' word and the --stats option print.
+ */
+void printStats(tfctx *ctx, FILE *out);
+
 /* ===================== Error handling =================== */
 
+/** @brief Error kind: the program can't be parsed or linked */
+#define TFERR_COMPILE 1
+
+/** @brief Error kind: the program stopped while running */
+#define TFERR_RUNTIME 2
+
+/** @brief Error kind: an allocation failed */
+#define TFERR_MEMORY 3
+
+/** @brief Longest error message a trap keeps, including the NUL */
+#define TFERR_MESSAGE_SIZE 512
+
 /**
- * @brief Report a runtime error and exit the program
+ * @brief Where the errors of a thread go instead of exiting the program
+ *
+ * Set one with setErrorTrap() after setjmp(trap.jump): an error then
+ * records its kind and message in the trap, prints the message to 'out'
+ * if set, and longjmp()s there with the value 1. The objects the failing
+ * operation was holding are not freed (only their pool cells come back,
+ * with freePool() or poolRelease()), and the context must be reset
+ * (resetContext()) before it runs anything else: the stacks may be in
+ * any state.
+ */
+typedef struct tferrortrap {
+  jmp_buf jump;        /**< Where errors jump to */
+  FILE *out;           /**< Stream to print the messages to, or NULL */
+  const char *name;    /**< Prefix for the printed messages (a file name), or NULL */
+  int error;           /**< TFERR_* kind of the error caught */
+  char message[TFERR_MESSAGE_SIZE]; /**< Its message, without the final newline */
+} tferrortrap;
+
+/**
+ * @brief Set the error trap of the calling thread
+ * @param trap Trap to use, or NULL to exit(1) on errors again
+ * @return The previous trap, to restore afterwards
+ */
+tferrortrap *setErrorTrap(tferrortrap *trap);
+
+/**
+ * @brief Report a runtime error and stop
  * @param ctx Execution context (for stack depth and source location)
  * @param msg Error message to display
  *
  * This function prints an error message including line/column information
  * (if available from ctx->current_object) and stack depth, then exits
- * the program with status 1.
+ * the program with status 1, or jumps to the thread's error trap.
  */
 void runtimeError(tfctx *ctx, const char *msg);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Report a compile (link) time error and stop
+ * @param o Object that caused the error (for source location, NULL-safe)
+ * @param msg Error message to display
+ *
+ * Used by the passes that run before execution, such as symbol
+ * resolution. Prints the message with the line/column recorded on 'o'
+ * (if available), then exits the program with status 1, or jumps to the
+ * thread's error trap.
+ */
+void compileError(tfobj *o, const char *msg);
+
+/**
+ * @brief Report an error reading the program and stop
+ * @param msg Complete message
+ *
+ * Like compileError() for the errors that have no object to point at.
+ */
+void inputError(const char *msg);
+
+/**
+ * @brief Report a failed allocation and stop
+ * @param size Number of bytes that couldn't be allocated
+ *
+ * Called by xmalloc() and xrealloc(). Exits the program with status 1,
+ * or jumps to the thread's error trap.
+ */
+void memoryError(size_t size);
+
+/**
+ * @brief Pass an error caught by a trap on to the enclosing one
+ * @param trap Trap that caught the error
+ *
+ * For code that sets a trap only to clean up after itself: the error is
+ * reported again, with the same kind and message, to the trap that was
+ * set before (or printed, exiting the program, if there is none).
+ */
+void reraiseError(const tferrortrap *trap);
+
+#endif
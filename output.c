@@ -0,0 +1,110 @@
+/**
+ * @file output.c
+ * @brief Implementation of the buffered output
+ *
+ * The buffer is handed to the stream with one fwrite() per flush, and
+ * integers are converted by hand, two digits at a time, so printing a
+ * long run of values costs little more than copying their digits.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "tf.h"
+#include "mem.h"
+
+/** @brief "00" to "99", the two digits of every value below 100 */
+static const char digitPairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+void initOutput(tfoutput *out, FILE *stream) {
+    out->stream = stream;
+    out->size = OUTPUT_BUFFER_SIZE;
+    out->buf = xmalloc(out->size);
+    out->len = 0;
+    out->policy = isatty(fileno(stream)) ? TFFLUSH_LINE : TFFLUSH_SIZE;
+}
+
+void freeOutput(tfoutput *out) {
+    flushOutput(out);
+    free(out->buf);
+    out->buf = NULL;
+}
+
+/**
+ * @brief Hand the buffered text to the stream, without flushing it
+ */
+static void writeOutput(tfoutput *out) {
+    if (out->len > 0) {
+        fwrite(out->buf, 1, out->len, out->stream);
+        out->len = 0;
+    }
+}
+
+void flushOutput(tfoutput *out) {
+    writeOutput(out);
+    fflush(out->stream);
+}
+
+void setOutputStream(tfoutput *out, FILE *stream) {
+    flushOutput(out);
+    out->stream = stream;
+}
+
+int parseFlushPolicy(const char *name) {
+    if (strcmp(name, "size") == 0) return TFFLUSH_SIZE;
+    if (strcmp(name, "line") == 0) return TFFLUSH_LINE;
+    if (strcmp(name, "exit") == 0) return TFFLUSH_EXIT;
+    return -1;
+}
+
+void outputSpill(tfoutput *out, size_t n) {
+    if (out->policy != TFFLUSH_EXIT) {
+        writeOutput(out);
+    }
+    if (out->size - out->len < n) {
+        size_t size = out->size * 2;
+        while (size - out->len < n) size *= 2;
+        out->buf = xrealloc(out->buf, size);
+        out->size = size;
+    }
+}
+
+void outputText(tfoutput *out, const char *text, size_t len) {
+    memcpy(outputReserve(out, len), text, len);
+    out->len += len;
+    if (out->policy == TFFLUSH_LINE && memchr(text, '\n', len)) {
+        flushOutput(out);
+    }
+}
+
+void outputInt(tfoutput *out, int64_t value) {
+    // Digits are produced from the right, into the end of a scratch area
+    char digits[20];
+    char *p = digits + sizeof(digits);
+    uint64_t u = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    while (u >= 100) {
+        p -= 2;
+        memcpy(p, digitPairs + (u % 100) * 2, 2);
+        u /= 100;
+    }
+    if (u >= 10) {
+        p -= 2;
+        memcpy(p, digitPairs + u * 2, 2);
+    } else {
+        *--p = (char)('0' + u);
+    }
+    if (value < 0) {
+        *--p = '-';
+    }
+    size_t len = digits + sizeof(digits) - p;
+    memcpy(outputReserve(out, len), p, len);
+    out->len += len;
+}
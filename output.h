@@ -0,0 +1,97 @@
+/**
+ * @file output.h
+ * @brief Buffered output of a context (see tfoutput)
+ *
+ * Everything the printing words write goes through the context's
+ * tfoutput: characters and numbers are formatted straight into its
+ * buffer, and the buffer reaches the stream in large writes, as the flush
+ * policy says. The single-character and reservation paths are inline so
+ * printing a small integer is a few stores.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tf.h"
+
+/**
+ * @brief Prepare an output writing to a stream
+ * @param out Output to initialize
+ * @param stream Stream to write to
+ *
+ * The policy is TFFLUSH_LINE if the stream is a terminal, TFFLUSH_SIZE
+ * otherwise.
+ */
+void initOutput(tfoutput *out, FILE *stream);
+
+/**
+ * @brief Flush an output and release its buffer
+ */
+void freeOutput(tfoutput *out);
+
+/**
+ * @brief Write the buffered text to the stream and flush the stream
+ */
+void flushOutput(tfoutput *out);
+
+/**
+ * @brief Send the output to another stream
+ *
+ * What was buffered so far is flushed to the old stream first.
+ */
+void setOutputStream(tfoutput *out, FILE *stream);
+
+/**
+ * @brief Parse a flush policy name
+ * @param name "line", "size" or "exit"
+ * @return TFFLUSH_* constant, or -1 for an unknown name
+ */
+int parseFlushPolicy(const char *name);
+
+/**
+ * @brief Make room in a full buffer (see outputReserve())
+ * @param out Output
+ * @param n Bytes needed
+ *
+ * Writes the buffer out, or grows it under TFFLUSH_EXIT or when n alone
+ * doesn't fit.
+ */
+void outputSpill(tfoutput *out, size_t n);
+
+/**
+ * @brief Get room for n more bytes in the buffer
+ * @return Where to write them; add what was written to out->len
+ */
+static inline char *outputReserve(tfoutput *out, size_t n) {
+  if (out->size - out->len < n) {
+    outputSpill(out, n);
+  }
+  return out->buf + out->len;
+}
+
+/**
+ * @brief Write one character
+ */
+static inline void outputChar(tfoutput *out, char c) {
+  *outputReserve(out, 1) = c;
+  out->len++;
+  if (c == '\n' && out->policy == TFFLUSH_LINE) {
+    flushOutput(out);
+  }
+}
+
+/**
+ * @brief Write len bytes of text
+ */
+void outputText(tfoutput *out, const char *text, size_t len);
+
+/**
+ * @brief Write a signed integer in decimal
+ *
+ * Formats two digits per step from a table: no locale, no stdio.
+ */
+void outputInt(tfoutput *out, int64_t value);
+
+#endif
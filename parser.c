@@ -5,16 +5,112 @@
  * Converts source text into executable objects. Handles tokenization,
  * number parsing, symbol extraction, whitespace, and comments. Tracks
  * source locations for error reporting.
+ *
+ * The same code parses a program held in memory and a stream read through
+ * a fixed-size buffer: current() refills the buffer when the text in it
+ * runs out, and bufferToken() makes sure a whole token is in memory before
+ * it is parsed, even if it straddles two reads.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "parser.h"
 #include "tf.h"
 #include "mem.h"
 #include "list.h"
+#include "intern.h"
+#include "bigint.h"
+#include "control.h"
+
+/* ===================== Input =================== */
+
+/**
+ * @brief Read more of the stream into the buffer
+ * @param p Parser state
+ * @return Non-zero if new text was read
+ *
+ * Everything before the current position is discarded: the unread text
+ * is moved to the start of the buffer and the rest is filled from the
+ * stream. Exits with an error if the unread text already fills the
+ * buffer (a single token longer than STREAM_BUFFER_SIZE). A line parser
+ * reads up to the end of the next line only.
+ */
+static int refill(tfparser *p) {
+  if (p->stream == NULL || p->eof) {
+    return 0;
+  }
+  size_t keep = p->end - p->p;
+  if (keep == p->size) {
+    char error_msg[128];
+    snprintf(error_msg, sizeof(error_msg),
+             "Compile error at line %d, column %d: Token longer than %zu bytes",
+             p->line, p->column, p->size);
+    inputError(error_msg);
+  }
+  memmove(p->prg, p->p, keep);
+  p->p = p->prg;
+
+  size_t n;
+  if (p->lines) {
+    // Don't wait for more than the next line: it may be all there is yet
+    char *text = p->prg + keep;
+    n = fgets(text, p->size - keep + 1, p->stream) ? strlen(text) : 0;
+  } else {
+    n = fread(p->prg + keep, 1, p->size - keep, p->stream);
+  }
+  if (n == 0) {
+    if (ferror(p->stream)) {
+      inputError("Error reading the program");
+    }
+    p->eof = 1;
+  }
+  p->end = p->prg + keep + n;
+  *p->end = '\0';
+  return n > 0;
+}
+
+/**
+ * @brief Get the current character, refilling the buffer if needed
+ * @param p Parser state
+ * @return The current character, or '\0' at the end of the input
+ *
+ * The text is never read past p->end, so it doesn't need a terminator
+ * (a memory-mapped file has none).
+ */
+static char current(tfparser *p) {
+  if (p->p == p->end && !refill(p)) {
+    return '\0';
+  }
+  return *p->p;
+}
+
+/**
+ * @brief Make sure the whole token at the current position is in memory
+ * @param p Parser state
+ *
+ * A token ends at whitespace or at the real end of the input. If the
+ * buffered text ends first, the token continues in the stream, so read
+ * more (which moves the token to the start of the buffer) and look again.
+ */
+static void bufferToken(tfparser *p) {
+  for (;;) {
+    char *q = p->p;
+    while (q < p->end && !isspace((unsigned char)*q)) {
+      q++;
+    }
+    if (q < p->end || !refill(p)) {
+      return;
+    }
+  }
+}
 
 /* ===================== Parsing & compile =================== */
 
@@ -44,7 +140,7 @@ static void advance(tfparser *p) {
  * (spaces, tabs, newlines, etc.), updating line and column tracking.
  */
 static void skipWhitespace(tfparser *p) {
-    while (*(p->p) && isspace(*(p->p))) {
+    while (isspace((unsigned char)current(p))) {
       advance(p);
     }
 }
@@ -54,20 +150,23 @@ static void skipWhitespace(tfparser *p) {
  * @param p Parser state
  *
  * If the current character is '\', skips all characters until the end
- * of the line. This implements line comments: \ comment text here
+ * of the line (or of the input). This implements line comments:
+ * \ comment text here
  */
 static void skipComments(tfparser *p) {
-  if(*(p->p) == '\\') {
-    while (*(p->p) && *(p->p) != '\n') {
+  if (current(p) == '\\') {
+    while (current(p) && *p->p != '\n') {
+      advance(p);
+    }
+    if (current(p) == '\n') {
       advance(p);
     }
-    advance(p);
   }
 }
 
 /**
  * @brief Set source location information on an object
- * @param o Object to update (NULL-safe)
+ * @param o Object to update (NULL-safe, immediates are left alone)
  * @param line Line number
  * @param column Column number
  *
@@ -75,13 +174,37 @@ static void skipComments(tfparser *p) {
  * error reporting during execution.
  */
 static void setObjectLocation(tfobj *o, int line, int column) {
-  if (o == NULL) {
+  if (o == NULL || isImmediate(o)) {
       return;
   }
   o->src_line = line;
   o->src_column = column;
 }
 
+/**
+ * @brief Parse an optionally negative decimal integer
+ * @param s Start of the number (a digit, or '-' followed by a digit)
+ * @param end End of the available text
+ * @param val Where to store the value, if it fits in 64 bits
+ * @param overflow Set when it doesn't (the digits are still consumed)
+ * @return Pointer to the first character after the digits
+ */
+static char *parseInteger(char *s, char *end, int64_t *val, int *overflow) {
+  int neg = (*s == '-');
+  if (neg) s++;
+  int64_t v = 0;
+  *overflow = 0;
+  while (s < end && isdigit((unsigned char)*s)) {
+    int d = *s++ - '0';
+    // Accumulate negative numbers downwards so INT64_MIN is reachable
+    if (mulOverflow(v, 10, &v) || (neg ? subOverflow(v, d, &v) : addOverflow(v, d, &v))) {
+      *overflow = 1;
+    }
+  }
+  *val = v;
+  return s;
+}
+
 /**
  * @brief Parse a single token into an object
  * @param p Parser state
@@ -89,7 +212,11 @@ static void setObjectLocation(tfobj *o, int line, int column) {
  *
  * Determines whether the current token is a number or symbol and creates
  * the appropriate object. Numbers (including negative integers) become
- * TFOBJ_TYPE_INT, everything else becomes TFOBJ_TYPE_SYMBOL.
+ * TFOBJ_TYPE_INT, or TFOBJ_TYPE_BIGINT past 64 bits; everything else
+ * becomes TFOBJ_TYPE_SYMBOL.
+ *
+ * Symbols are created straight from the source text: their name is
+ * interned, not copied, so no string is allocated per token.
  *
  * The parser position is advanced past the parsed token.
  */
@@ -98,59 +225,423 @@ static tfobj *parseObject(tfparser *p) {
   int start_column = p->column;
 
   char c = *p->p;
-  if (isdigit(c) || (c == '-' && isdigit(*(p->p + 1)))) {
-    char *end_ptr;
-    // strtol converts string to long, last arg is base
-    // end_ptr moves to the next of last digit
-    int val = strtol(p->p, &end_ptr, 10);
+  if (isdigit((unsigned char)c) ||
+      (c == '-' && p->p + 1 < p->end && isdigit((unsigned char)p->p[1]))) {
+    int64_t val;
+    int overflow;
+    char *end_ptr = parseInteger(p->p, p->end, &val, &overflow);
+    tfobj *obj = overflow ? numberFromDecimal(p->p, end_ptr - p->p)
+                          : createIntObject(val);
+    p->column += end_ptr - p->p;
     p->p = end_ptr;
 
-    tfobj *obj = createIntObject(val);
     setObjectLocation(obj, start_line, start_column);
     return obj;
   } else {
     char *start = p->p;
-    while (*p->p != '\0' && !isspace(*p->p)) {
+    while (p->p < p->end && !isspace((unsigned char)*p->p)) {
       advance(p);
     }
-    size_t len = p->p - start;
-    char *sym_str = xmalloc(len + 1);
-    memcpy(sym_str, start, len);
-    sym_str[len] = '\0';
 
-    tfobj *obj = createSymbolObject(sym_str, len);
+    tfobj *obj = createSymbolObject(start, p->p - start);
     setObjectLocation(obj, start_line, start_column);
     return obj;
   }
 }
 
-tfobj *compile(char *progtxt) {
-    tfparser pstorage;
-    pstorage.p = progtxt;
-    pstorage.line = 1;
-    pstorage.column = 1;
-  
+/**
+ * @brief Skip whitespace and comments before the next token
+ * @param p Parser state
+ *
+ * Loops because a comment can be followed by more whitespace and so on.
+ */
+static void skipBlanks(tfparser *p) {
+  while (current(p) != '\0') {
+    skipWhitespace(p);
+    if (current(p) == '\\') {
+      skipComments(p);
+    } else {
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Parse the next token, if any
+ * @param p Parser state
+ * @return New object for the next token, or NULL at end of input
+ */
+static tfobj *nextToken(tfparser *p) {
+  skipBlanks(p);
+  if (current(p) == '\0')
+    return NULL;
+  bufferToken(p);
+  tfobj *o = parseObject(p);
+  markControl(o);
+  return o;
+}
+
+/**
+ * @brief Check whether an object is the symbol with the given intern id
+ */
+static int isSymbol(tfobj *o, uint32_t id) {
+  return objType(o) == TFOBJ_TYPE_SYMBOL && o->sym.id == id;
+}
+
+/**
+ * @brief Record an unfinished object the parser owns
+ * @param p Parser state
+ * @param o Object (NULL is allowed)
+ * @return Its slot, for letGo() or to replace the object
+ *
+ * A compile error longjmps out of the parser in the middle of building
+ * lists, definitions and quotations. compileObjects() then releases the
+ * held objects, so a failed compile frees everything it made. An object
+ * must be let go as soon as it is handed to its parent list, before the
+ * local reference is dropped.
+ */
+static size_t hold(tfparser *p, tfobj *o) {
+  if (p->held_len == p->held_cap) {
+    size_t cap = p->held_cap ? p->held_cap * 2 : 16;
+    p->held = xrealloc(p->held, sizeof(tfobj *) * cap);
+    p->held_cap = cap;
+  }
+  p->held[p->held_len] = o;
+  return p->held_len++;
+}
+
+/**
+ * @brief Stop holding the object in a slot and every one held after it
+ */
+static void letGo(tfparser *p, size_t slot) {
+  p->held_len = slot;
+}
+
+/**
+ * @brief Parse a quotation ( [ ... ] )
+ * @param p Parser state, positioned right after the '['
+ * @param open The '[' symbol (used for error locations)
+ * @return New list object holding the quoted objects
+ *
+ * The list is a value, pushed when the program reaches it, and code that
+ * the list words run. Quotations nest, and can hold control structures
+ * but not definitions.
+ */
+static tfobj *parseQuotation(tfparser *p, tfobj *open) {
+  tfobj *quot = createListObject(4);
+  size_t mark = hold(p, quot);
+  setObjectLocation(quot, open->src_line, open->src_column);
+  tfobj *o;
+  while ((o = nextToken(p)) != NULL && !isSymbol(o, TFSYM_RBRACKET)) {
+    size_t slot = hold(p, o);
+    if (isSymbol(o, TFSYM_COLON) || isSymbol(o, TFSYM_SEMICOLON)) {
+      compileError(o, "Definitions can't appear inside quotations");
+    }
+    if (isSymbol(o, TFSYM_LBRACKET)) {
+      tfobj *inner = parseQuotation(p, o);
+      p->held[slot] = inner;
+      decRef(o);
+      o = inner;
+    }
+    listAppendObject(quot, o);
+    letGo(p, slot);
+    decRef(o);
+  }
+  if (o == NULL) {
+    compileError(open, "Unterminated quotation, missing ']'");
+  }
+  decRef(o);
+  linkBranches(quot);
+  letGo(p, mark);
+  return quot;
+}
+
+/**
+ * @brief Parse the next object: a token, or a whole quotation
+ * @param p Parser state
+ * @return New object, or NULL at end of input
+ */
+static tfobj *nextObject(tfparser *p) {
+  tfobj *o = nextToken(p);
+  if (o == NULL) return NULL;
+  if (isSymbol(o, TFSYM_LBRACKET)) {
+    size_t slot = hold(p, o);
+    tfobj *quot = parseQuotation(p, o);
+    letGo(p, slot);
+    decRef(o);
+    return quot;
+  }
+  if (isSymbol(o, TFSYM_RBRACKET)) {
+    hold(p, o);
+    compileError(o, "']' without a matching '['");
+  }
+  return o;
+}
+
+/**
+ * @brief Update the number of control structures left open
+ * @param o Object just parsed
+ * @param open Count of if/begin/do not closed yet (unmatched closing
+ *             words are left for linkBranches() to report)
+ */
+static void trackNesting(tfobj *o, int *open) {
+  if (objType(o) != TFOBJ_TYPE_SYMBOL) return;
+  switch (o->sym.control) {
+    case TFCTRL_IF:
+    case TFCTRL_BEGIN:
+    case TFCTRL_DO:
+      (*open)++;
+      break;
+    case TFCTRL_THEN:
+    case TFCTRL_UNTIL:
+    case TFCTRL_LOOP:
+      if (*open > 0) (*open)--;
+      break;
+  }
+}
+
+
+/**
+ * @brief Parse a colon definition ( : name body ; )
+ * @param p Parser state, positioned right after the ':'
+ * @param colon The ':' symbol (used for error locations)
+ * @return New word object holding the name and the body list
+ *
+ * The body is compiled into its own list, which the linker later
+ * resolves and installs in the dictionary. Definitions can't be nested,
+ * and a missing name or ';' is a compile error.
+ */
+static tfobj *parseDefinition(tfparser *p, tfobj *colon) {
+  tfobj *name = nextObject(p);
+  size_t mark = hold(p, name);
+  if (name == NULL || objType(name) != TFOBJ_TYPE_SYMBOL ||
+      isSymbol(name, TFSYM_COLON) || isSymbol(name, TFSYM_SEMICOLON) ||
+      isSymbol(name, TFSYM_RECURSE) || name->sym.control) {
+    compileError(name ? name : colon, "Expected a word name after ':'");
+  }
+
+  tfobj *body = createListObject(16);
+  hold(p, body);
+  tfobj *o;
+  while ((o = nextObject(p)) != NULL && !isSymbol(o, TFSYM_SEMICOLON)) {
+    size_t slot = hold(p, o);
+    if (isSymbol(o, TFSYM_COLON)) {
+      compileError(o, "Nested ':' inside a definition");
+    }
+    listAppendObject(body, o);
+    letGo(p, slot);
+    decRef(o);
+  }
+  if (o == NULL) {
+    compileError(colon, "Unterminated definition, missing ';'");
+  }
+  decRef(o);
+  linkBranches(body);
+
+  tfobj *word = createWordObject(name, NULL, body);
+  setObjectLocation(word, colon->src_line, colon->src_column);
+  letGo(p, mark);
+  decRef(name);
+  decRef(body);
+  return word;
+}
+
+/**
+ * @brief Check whether the text read so far has all been parsed
+ * @param p Parser state
+ * @return Non-zero if only blanks and comments are left in the buffer
+ *
+ * Skips them, but never reads the stream: a line parser calls it to stop
+ * at the end of a line instead of waiting for the next one.
+ */
+static int bufferDone(tfparser *p) {
+  while (p->p < p->end) {
+    if (*p->p == '\\') {
+      while (p->p < p->end && *p->p != '\n') {
+        advance(p);
+      }
+    } else if (isspace((unsigned char)*p->p)) {
+      advance(p);
+    } else {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void initParser(tfparser *p, char *progtxt, size_t len) {
+    p->prg = progtxt;
+    p->p = progtxt;
+    p->end = progtxt + len;
+    p->line = 1;
+    p->column = 1;
+    p->stream = NULL;
+    p->size = 0;
+    p->eof = 1;
+    p->lines = 0;
+    p->held = NULL;
+    p->held_len = 0;
+    p->held_cap = 0;
+}
+
+void initStreamParser(tfparser *p, FILE *stream, char *buf, size_t size) {
+    p->prg = buf;
+    p->p = buf;
+    p->end = buf;
+    *buf = '\0';
+    p->line = 1;
+    p->column = 1;
+    p->stream = stream;
+    p->size = size;
+    p->eof = 0;
+    p->lines = 0;
+    p->held = NULL;
+    p->held_len = 0;
+    p->held_cap = 0;
+}
+
+void initLineParser(tfparser *p, FILE *stream, char *buf, size_t size) {
+    initStreamParser(p, stream, buf, size);
+    p->lines = 1;
+}
+
+/**
+ * @brief Parse top-level objects into a new program list
+ * @param p Parser state
+ * @param max_objects Stop after this many objects
+ * @param by_line Also stop once the text read so far is parsed
+ */
+static tfobj *parseObjects(tfparser *p, size_t max_objects, int by_line) {
     tfobj *program_list = createListObject(16);
+    size_t mark = hold(p, program_list);
+    tfobj *o;
+    int open = 0;
   
-    while (*(pstorage.p) != '\0') {
-      // Skip whitespace and comments (loop in case comment followed by whitespace)
-      while (*pstorage.p != '\0') {
-        skipWhitespace(&pstorage);
-        if (*pstorage.p == '\\') {
-          skipComments(&pstorage);
-        } else {
-          break;
+    // A batch never ends inside a control structure
+    while ((program_list->list.len < max_objects || open > 0) &&
+           !(by_line && open == 0 && bufferDone(p)) &&
+           (o = nextObject(p)) != NULL) {
+      size_t slot = hold(p, o);
+      trackNesting(o, &open);
+      if (isSymbol(o, TFSYM_COLON)) {
+        if (open > 0) {
+          compileError(o, "Definitions can't appear inside control structures");
         }
-      }
-      
-      if (*pstorage.p == '\0')
-        break;
-  
-      tfobj *o = parseObject(&pstorage);
-      if (o) {
-        listAppendObject(program_list, o);
+        tfobj *word = parseDefinition(p, o);
+        p->held[slot] = word;
         decRef(o);
+        o = word;
+      } else if (isSymbol(o, TFSYM_SEMICOLON)) {
+        compileError(o, "';' without a matching ':'");
       }
+      listAppendObject(program_list, o);
+      letGo(p, slot);
+      decRef(o);
     }
+    linkBranches(program_list);
+    letGo(p, mark);
     return program_list;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Release the parser's list of held objects
+ * @param p Parser state
+ * @param drop Also drop the objects still in it (after an error)
+ */
+static void freeHeld(tfparser *p, int drop) {
+    for (size_t i = 0; drop && i < p->held_len; i++) {
+        decRef(p->held[i]);
+    }
+    free(p->held);
+    p->held = NULL;
+    p->held_len = 0;
+    p->held_cap = 0;
+}
+
+/**
+ * @brief Parse top-level objects, freeing what was built on an error
+ *
+ * Errors are caught here only to release the held objects, then passed
+ * on to the caller's trap.
+ */
+static tfobj *compileObjects(tfparser *p, size_t max_objects, int by_line) {
+    tferrortrap trap = {.out = NULL, .name = NULL};
+    tferrortrap *outer = setErrorTrap(&trap);
+    if (setjmp(trap.jump) != 0) {
+        setErrorTrap(outer);
+        freeHeld(p, 1);
+        reraiseError(&trap);
+    }
+    tfobj *program_list = parseObjects(p, max_objects, by_line);
+    setErrorTrap(outer);
+    freeHeld(p, 0);
+    return program_list;
+}
+
+tfobj *compileBatch(tfparser *p, size_t max_objects) {
+    return compileObjects(p, max_objects, 0);
+}
+
+tfobj *compileLine(tfparser *p) {
+    if (current(p) == '\0') {
+        return NULL;   // Nothing but the end of the input
+    }
+    return compileObjects(p, SIZE_MAX, 1);
+}
+
+void skipLine(tfparser *p) {
+    while (p->p < p->end && *p->p != '\n') {
+        advance(p);
+    }
+}
+
+tfobj *compile(char *progtxt, size_t len) {
+    tfparser pstorage;
+    initParser(&pstorage, progtxt, len);
+    return compileBatch(&pstorage, SIZE_MAX);
+}
+
+/* ===================== Source files =================== */
+
+int loadFile(const char *filename, sourceFile *src) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if (text != MAP_FAILED) {
+      posix_madvise(text, st.st_size, POSIX_MADV_SEQUENTIAL);
+      src->text = text;
+      src->len = st.st_size;
+      src->mapped = 1;
+      fclose(file);
+      return 0;
+    }
+  }
+
+  size_t capacity = 4096, len = 0, n;
+  char *buffer = xmalloc(capacity);
+  while ((n = fread(buffer + len, 1, capacity - len, file)) > 0) {
+    len += n;
+    if (len == capacity) {
+      capacity *= 2;
+      buffer = xrealloc(buffer, capacity);
+    }
+  }
+  fclose(file);
+  src->text = buffer;
+  src->len = len;
+  src->mapped = 0;
+  return 0;
+}
+
+void unloadFile(sourceFile *src) {
+  if (src->mapped) {
+    munmap(src->text, src->len);
+  } else {
+    free(src->text);
+  }
+}
@@ -12,22 +12,121 @@
 
 /**
  * @brief Compile source text into an executable object list
- * @param progtxt Null-terminated source code string
+ * @param progtxt Source code (need not be null-terminated, never modified)
+ * @param len Length of the source code in bytes
  * @return A list object containing the compiled program
  *
  * This function tokenizes and parses the input text, creating objects
  * for each token. Numbers become integer objects, and words become symbol
- * objects. Returns a list with refcount=1 that the caller must eventually
- * decRef().
+ * objects, whose names are interned rather than copied (the text can be
+ * released as soon as this returns). Colon definitions ( : name ... ; ) become word objects whose
+ * body is a nested list. Returns a list with refcount=1 that the caller
+ * must eventually decRef().
  *
  * The parser handles:
  * - Integers (including negative numbers)
  * - Symbols (words/identifiers)
  * - Whitespace (spaces, tabs, newlines)
  * - Backslash comments (from \ to end of line)
+ * - Colon definitions (malformed ones are reported via compileError())
  *
  * Line and column information is tracked for error reporting.
  */
-tfobj *compile(char *progtxt);
+tfobj *compile(char *progtxt, size_t len);
+
+/**
+ * @brief Prepare a parser over a program held in memory
+ * @param p Parser state to initialize
+ * @param progtxt Source code (need not be null-terminated, never modified)
+ * @param len Length of the source code in bytes
+ */
+void initParser(tfparser *p, char *progtxt, size_t len);
+
+/**
+ * @brief Prepare a parser that reads a stream through a fixed buffer
+ * @param p Parser state to initialize
+ * @param stream Stream to read the program from
+ * @param buf Buffer of size + 1 bytes (one for the terminator)
+ * @param size Usable size of the buffer; tokens must be shorter than this
+ *
+ * Memory use doesn't depend on the length of the input: text is read on
+ * demand and dropped once parsed.
+ */
+void initStreamParser(tfparser *p, FILE *stream, char *buf, size_t size);
+
+/**
+ * @brief Compile the next part of a program
+ * @param p Parser state
+ * @param max_objects Stop after this many top-level objects
+ * @return A list object with up to max_objects objects, empty once the
+ *         input is exhausted (refcount=1, the caller must decRef() it)
+ *
+ * A colon definition counts as one object and is always compiled whole,
+ * and a batch never ends inside an if/begin/do structure, so each batch
+ * can be linked and run on its own. compile() is a single unbounded batch.
+ */
+tfobj *compileBatch(tfparser *p, size_t max_objects);
+
+/**
+ * @brief Prepare a parser that reads a stream a line at a time
+ * @param p Parser state to initialize
+ * @param stream Stream to read the program from (typically a terminal or
+ *               a pipe from a controlling process)
+ * @param buf Buffer of size + 1 bytes (one for the terminator)
+ * @param size Usable size of the buffer; tokens must be shorter than this
+ *
+ * Like initStreamParser(), but the parser never reads past the end of
+ * the line it needs, so compileLine() returns as soon as a line is in.
+ */
+void initLineParser(tfparser *p, FILE *stream, char *buf, size_t size);
+
+/**
+ * @brief Compile the next line of a program
+ * @param p Parser state, from initLineParser()
+ * @return A list object with the objects of the line (empty for a blank
+ *         line), or NULL once the input is exhausted
+ *
+ * Waits for the next line, and for more lines only while a definition,
+ * a quotation or a control structure is still open, so the result can be
+ * linked and run on its own.
+ */
+tfobj *compileLine(tfparser *p);
+
+/**
+ * @brief Drop the rest of the current line
+ * @param p Parser state, from initLineParser()
+ *
+ * Used after an error, so the next compileLine() starts on a fresh line.
+ */
+void skipLine(tfparser *p);
+
+/* ===================== Source files =================== */
+
+/**
+ * @brief Source text loaded by loadFile()
+ */
+typedef struct sourceFile {
+  char *text;        /**< File contents (not null-terminated) */
+  size_t len;        /**< Length of the contents in bytes */
+  int mapped;        /**< Set if text is a memory mapping, not a heap copy */
+} sourceFile;
+
+/**
+ * @brief Load an entire file for the parser
+ * @param filename Path to the file to load
+ * @param src Where to store the contents
+ * @return 0 on success, -1 if the file cannot be opened
+ *
+ * Regular files are memory-mapped read-only, so the text is never copied:
+ * the parser reads the page cache directly and symbols are interned from
+ * it. Anything that can't be mapped (an empty file, a pipe) is read into
+ * a heap buffer instead. Release with unloadFile().
+ */
+int loadFile(const char *filename, sourceFile *src);
+
+/**
+ * @brief Release the contents of a file loaded with loadFile()
+ */
+void unloadFile(sourceFile *src);
 
 #endif
\ No newline at end of file
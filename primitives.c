@@ -3,13 +3,16 @@
  * @brief Implementation of built-in primitive words
  *
  * Each primitive is a C function that manipulates the execution stack.
+ * The VM guarantees the stack holds at least as many values as the
+ * primitive consumes (see the stack effects in dict.c), either with a
+ * runtime check before the call or because analyzeStack() proved it.
  * Primitives are responsible for:
- * - Checking stack depth
  * - Type checking operands
  * - Performing the operation
  * - Managing reference counts properly
  */
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -17,98 +20,896 @@
 #include "tf.h"
 #include "mem.h"
 #include "stack.h"
+#include "bigint.h"
+#include "list.h"
+#include "vector.h"
+#include "output.h"
 
 /* ===================== Primitives Operations =================== */
 
+/*
+ * The arithmetic words handle two immediate integers inline: immediates
+ * have at most 63 bits, so their sum or difference always fits in an
+ * int64_t and only multiplication needs an overflow check. Everything
+ * else (heap integers, big integers, overflow, type errors) goes through
+ * arithSlow().
+ */
+
+/**
+ * @brief Apply a number*() operation to the two top values
+ * @param ctx Execution context
+ * @param op numberAdd, numberSub or numberMul
+ * @param msg Error message if an operand is not an integer
+ *
+ * The second value is the left operand: ( a b -- a op b ).
+ */
+static void arithSlow(tfctx *ctx, tfobj *(*op)(const tfobj *, const tfobj *),
+                      const char *msg) {
+  tfobj *b = stackPeek(ctx, 0);
+  tfobj *a = stackPeek(ctx, 1);
+  if (!isNumber(a) || !isNumber(b)) {
+    runtimeError(ctx, msg);
+  }
+  tfobj *result = op(a, b);
+  stackDrop(ctx, 2);
+  stackPushOwned(ctx, result);
+}
+
 void primitiveAdd(tfctx *ctx) {
-    if (ctx->sp < 2) {
-      runtimeError(ctx, "Stack underflow: '+' requires two values");
-    }
-    tfobj *a = stackPop(ctx);
-    tfobj *b = stackPop(ctx);
-  
-    if (a->type != TFOBJ_TYPE_INT || b->type != TFOBJ_TYPE_INT) {
-      runtimeError(ctx, "The addition requires two integers");
-    }
-    int result = a->i + b->i;
-    tfobj *objResult = createIntObject(result);
-  
-    stackPush(ctx, objResult);
-  
-    // We are done with our local references
-    decRef(objResult); // Our var ref is gone, ref is on stack now
-    decRef(a);
-    decRef(b);
+  tfobj *a = ctx->stack[ctx->sp - 2];
+  tfobj *b = ctx->stack[ctx->sp - 1];
+  if (isImmInt(a) && isImmInt(b)) {
+    ctx->stack[ctx->sp - 2] = createIntObject(objInt(a) + objInt(b));
+    ctx->sp--;
+    return;
+  }
+  arithSlow(ctx, numberAdd, "The addition requires two integers");
 }
 
 void primitiveSub(tfctx *ctx) {
-  if (ctx->sp < 2) {
-    runtimeError(ctx, "Stack underflow: '-' requires two values");
-  }
-  tfobj *a = stackPop(ctx);
-  tfobj *b = stackPop(ctx);
-  if (a->type != TFOBJ_TYPE_INT || b->type != TFOBJ_TYPE_INT) {
-    runtimeError(ctx, "The subtraction requires two integers");
-  }
-  int result = (b->i) - (a->i);
-  tfobj *resObject = createIntObject(result);
-  
-  stackPush(ctx, resObject);
-  decRef(resObject);
-  decRef(a);
-  decRef(b);
+  tfobj *a = ctx->stack[ctx->sp - 2];
+  tfobj *b = ctx->stack[ctx->sp - 1];
+  if (isImmInt(a) && isImmInt(b)) {
+    ctx->stack[ctx->sp - 2] = createIntObject(objInt(a) - objInt(b));
+    ctx->sp--;
+    return;
+  }
+  arithSlow(ctx, numberSub, "The subtraction requires two integers");
 }
 
 void primitiveMul(tfctx *ctx) {
-  if (ctx->sp < 2) {
-    runtimeError(ctx, "Stack underflow: '*' requires two values");
+  tfobj *a = ctx->stack[ctx->sp - 2];
+  tfobj *b = ctx->stack[ctx->sp - 1];
+  int64_t result;
+  if (isImmInt(a) && isImmInt(b) && !mulOverflow(objInt(a), objInt(b), &result)) {
+    ctx->stack[ctx->sp - 2] = createIntObject(result);
+    ctx->sp--;
+    return;
   }
-  tfobj *a = stackPop(ctx);
-  tfobj *b = stackPop(ctx);
-
-  tfobj *resObject = createIntObject(a->i*b->i);
-  
-  stackPush(ctx, resObject);
-  decRef(resObject);
-  decRef(a);
-  decRef(b);
+  arithSlow(ctx, numberMul, "The multiplication requires two integers");
 }
 
 void primitiveDrop(tfctx *ctx) {
-  if (ctx->sp < 1) {
-    runtimeError(ctx, "Stack underflow: 'drop' requires one value");
-  }
-  tfobj *popped = stackPop(ctx);
-  decRef(popped);
+  stackDrop(ctx, 1);
 }
 
 void primitiveSwap(tfctx *ctx) {
-  if (ctx->sp < 2) {
-    runtimeError(ctx, "Stack underflow: 'swap' requires two values");
-  }
-  tfobj *a = ctx->stack[ctx->sp - 1];
-  tfobj *b = ctx->stack[ctx->sp - 2];
+  stackRoll(ctx, 1);
+}
 
-  ctx->stack[ctx->sp - 1] = b;
-  ctx->stack[ctx->sp - 2] = a;
+/**
+ * @brief Print a value the way '.' shows it, without a newline
+ * @param o Any value: lists print as '[ 1 2 3 ]', vectors as '{ 1 2 3 }',
+ *          symbols as their name
+ * @param out Output to print to
+ */
+static void printValue(tfobj *o, tfoutput *out) {
+  switch (objType(o)) {
+    case TFOBJ_TYPE_INT:
+      outputInt(out, objInt(o));
+      break;
+    case TFOBJ_TYPE_BIGINT:
+      printNumber(o, out);
+      break;
+    case TFOBJ_TYPE_BOOL:
+      if (objInt(o)) {
+        outputText(out, "true", 4);
+      } else {
+        outputText(out, "false", 5);
+      }
+      break;
+    case TFOBJ_TYPE_SYMBOL:
+      outputText(out, o->sym.ptr, o->sym.len);
+      break;
+    case TFOBJ_TYPE_LIST:
+      outputChar(out, '[');
+      for (size_t i = 0; i < o->list.len; i++) {
+        outputChar(out, ' ');
+        printValue(o->list.ele[i], out);
+      }
+      outputText(out, " ]", 2);
+      break;
+    case TFOBJ_TYPE_INTVEC:
+      outputChar(out, '{');
+      for (size_t i = 0; i < o->vec.len; i++) {
+        outputChar(out, ' ');
+        outputInt(out, o->vec.data[i]);
+      }
+      outputText(out, " }", 2);
+      break;
+    default:
+      outputText(out, "<object>", 8);
+      break;
+  }
 }
 
 void primitivePrint(tfctx *ctx) {
-  if (ctx->sp < 1) {
-      runtimeError(ctx, "Stack underflow: '.' requires a value");
-  }
   tfobj *val = stackPop(ctx);
-  if (val->type != TFOBJ_TYPE_INT) {
-      runtimeError(ctx, "Can't print a symbol");
-  }
-  printf("%d\n", val->i);
+  printValue(val, &ctx->out);
+  outputChar(&ctx->out, '\n');
   decRef(val);
 }
 
+void primitiveStats(tfctx *ctx) {
+  // Printed by stdio, after what is already buffered
+  flushOutput(&ctx->out);
+  printStats(ctx, ctx->out.stream);
+}
+
+/* ===================== Output =================== */
+
+void primitiveFlush(tfctx *ctx) {
+  flushOutput(&ctx->out);
+}
+
+void primitiveCr(tfctx *ctx) {
+  outputChar(&ctx->out, '\n');
+}
+
+/**
+ * @brief Check that a value is a character code, for 'emit' and 'type'
+ */
+static int isCharCode(const tfobj *o) {
+  return objType(o) == TFOBJ_TYPE_INT && objInt(o) >= 0 && objInt(o) <= 255;
+}
+
+void primitiveEmit(tfctx *ctx) {
+  tfobj *c = stackPeek(ctx, 0);
+  if (!isCharCode(c)) {
+    runtimeError(ctx, "'emit' requires a character code from 0 to 255");
+  }
+  outputChar(&ctx->out, (char)objInt(c));
+  stackDrop(ctx, 1);
+}
+
+void primitiveType(tfctx *ctx) {
+  tfobj *list = stackPeek(ctx, 0);
+  if (objType(list) != TFOBJ_TYPE_LIST) {
+    runtimeError(ctx, "'type' requires a list of character codes");
+  }
+  // Checked first, so a bad list prints nothing
+  for (size_t i = 0; i < list->list.len; i++) {
+    if (!isCharCode(list->list.ele[i])) {
+      runtimeError(ctx, "'type' requires a list of character codes from 0 to 255");
+    }
+  }
+  size_t len = list->list.len;
+  char *p = outputReserve(&ctx->out, len);
+  int newline = 0;
+  for (size_t i = 0; i < len; i++) {
+    p[i] = (char)objInt(list->list.ele[i]);
+    newline |= p[i] == '\n';
+  }
+  ctx->out.len += len;
+  if (newline && ctx->out.policy == TFFLUSH_LINE) {
+    flushOutput(&ctx->out);
+  }
+  stackDrop(ctx, 1);
+}
+
 void primitiveDuplicate(tfctx *ctx) {
-    if (ctx->sp < 1) {
-        runtimeError(ctx, "Stack underflow: 'dup' requires a value");
+  stackPick(ctx, 0);
+}
+
+/* ===================== Comparisons and loops =================== */
+
+/*
+ * A comparison replaces its two operands with an immediate boolean, so
+ * it never allocates. Two immediate integers are compared inline.
+ */
+
+/**
+ * @brief Compare and drop the two top values, slow path of compareTop()
+ * @param equality Nonzero for '=' and '<>', which also accept two booleans
+ * @param name Word name, for error messages
+ */
+static int compareSlow(tfctx *ctx, int equality, const char *name) {
+  tfobj *b = stackPeek(ctx, 0);
+  tfobj *a = stackPeek(ctx, 1);
+  int c = 0;
+  if (isNumber(a) && isNumber(b)) {
+    c = numberCompare(a, b);
+  } else if (equality && objType(a) == TFOBJ_TYPE_BOOL &&
+             objType(b) == TFOBJ_TYPE_BOOL) {
+    c = objInt(a) != objInt(b);
+  } else {
+    char error_msg[256];
+    snprintf(error_msg, sizeof(error_msg), equality ?
+             "'%s' requires two integers or two booleans" :
+             "'%s' requires two integers", name);
+    runtimeError(ctx, error_msg);
+  }
+  stackDrop(ctx, 2);
+  return c;
+}
+
+/**
+ * @brief Compare and drop the two top values ( a b -- )
+ * @return Negative if a < b, 0 if a == b, positive if a > b (for
+ *         booleans, only whether they are equal)
+ */
+static inline int compareTop(tfctx *ctx, int equality, const char *name) {
+  tfobj *a = ctx->stack[ctx->sp - 2];
+  tfobj *b = ctx->stack[ctx->sp - 1];
+  if (isImmInt(a) && isImmInt(b)) {
+    int64_t x = objInt(a), y = objInt(b);
+    ctx->sp -= 2;
+    return (x > y) - (x < y);
+  }
+  return compareSlow(ctx, equality, name);
+}
+
+/**
+ * @brief Push a comparison result into the slot freed by compareTop()
+ */
+static inline void pushFlag(tfctx *ctx, int flag) {
+  ctx->stack[ctx->sp++] = makeImmBool(flag);
+}
+
+void primitiveEqual(tfctx *ctx) {
+  pushFlag(ctx, compareTop(ctx, 1, "=") == 0);
+}
+
+void primitiveNotEqual(tfctx *ctx) {
+  pushFlag(ctx, compareTop(ctx, 1, "<>") != 0);
+}
+
+void primitiveLess(tfctx *ctx) {
+  pushFlag(ctx, compareTop(ctx, 0, "<") < 0);
+}
+
+void primitiveGreater(tfctx *ctx) {
+  pushFlag(ctx, compareTop(ctx, 0, ">") > 0);
+}
+
+void primitiveLessEqual(tfctx *ctx) {
+  pushFlag(ctx, compareTop(ctx, 0, "<=") <= 0);
+}
+
+void primitiveGreaterEqual(tfctx *ctx) {
+  pushFlag(ctx, compareTop(ctx, 0, ">=") >= 0);
+}
+
+void primitiveLoopIndex(tfctx *ctx) {
+  if (ctx->loop_sp == 0) {
+    runtimeError(ctx, "'i' used outside of a do/loop");
+  }
+  stackPush(ctx, createIntObject(ctx->loops[ctx->loop_sp - 1].index));
+}
+
+/* ===================== Lists and quotations =================== */
+
+/*
+ * The list words take their operands off the stack and own those
+ * references while they run the quotation, so the quotation only sees
+ * the stack below them. A list whose only reference they hold is
+ * changed in place (copy on write, see list.h): its elements move to the
+ * stack and back without any refcount traffic.
+ */
+
+/**
+ * @brief Report list word operands of the wrong type and exit
+ * @param effect What the word requires, with its stack effect
+ */
+static void listOperandError(tfctx *ctx, const char *name, const char *effect) {
+  char error_msg[256];
+  snprintf(error_msg, sizeof(error_msg), "'%s' requires %s", name, effect);
+  runtimeError(ctx, error_msg);
+}
+
+/**
+ * @brief Take a list and a quotation off the stack ( list quot -- )
+ * @param effect Stack effect of the word, for the error message
+ * @param list Receives the list; the caller owns the reference
+ * @param quot Receives the quotation; the caller owns the reference
+ */
+static void popListAndQuotation(tfctx *ctx, const char *name, const char *effect,
+                                tfobj **list, tfobj **quot) {
+  *quot = stackPeek(ctx, 0);
+  *list = stackPeek(ctx, 1);
+  if (objType(*list) != TFOBJ_TYPE_LIST || objType(*quot) != TFOBJ_TYPE_LIST) {
+    char usage[128];
+    snprintf(usage, sizeof(usage), "a list and a quotation %s", effect);
+    listOperandError(ctx, name, usage);
+  }
+  ctx->sp -= 2;
+}
+
+/**
+ * @brief Exit with an error unless a quotation left the expected depth
+ * @param effect Stack effect the quotation must have
+ */
+static void checkQuotation(tfctx *ctx, size_t depth, const char *name,
+                           const char *effect) {
+  if (ctx->sp != depth) {
+    char error_msg[256];
+    snprintf(error_msg, sizeof(error_msg),
+             "The quotation of '%s' must have the effect %s", name, effect);
+    runtimeError(ctx, error_msg);
+  }
+}
+
+void primitiveMap(tfctx *ctx) {
+  tfobj *list, *quot;
+  popListAndQuotation(ctx, "map", "( list quot -- list )", &list, &quot);
+  size_t len = list->list.len;
+  int unique = list->refcount == 1;
+  tfobj *result = unique ? list : createListObject(len + 1);
+
+  for (size_t i = 0; i < len; i++) {
+    size_t depth = ctx->sp;
+    if (unique) {
+      stackPushOwned(ctx, list->list.ele[i]);   // The result takes its slot
+    } else {
+      stackPush(ctx, list->list.ele[i]);
+    }
+    callQuotation(ctx, quot);
+    checkQuotation(ctx, depth + 1, "map", "( x -- y )");
+    result->list.ele[i] = ctx->stack[--ctx->sp];
+    result->list.len = i + 1;
+  }
+  if (unique) {
+    listChanged(list);
+  } else {
+    decRef(list);
+  }
+  decRef(quot);
+  stackPushOwned(ctx, result);
+}
+
+void primitiveFilter(tfctx *ctx) {
+  tfobj *list, *quot;
+  popListAndQuotation(ctx, "filter", "( list quot -- list )", &list, &quot);
+  size_t len = list->list.len;
+  int unique = list->refcount == 1;
+  tfobj *result = unique ? list : createListObject(len + 1);
+  size_t kept = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    tfobj *x = list->list.ele[i];
+    size_t depth = ctx->sp;
+    stackPush(ctx, x);
+    callQuotation(ctx, quot);
+    checkQuotation(ctx, depth + 1, "filter", "( x -- flag )");
+
+    tfobj *flag = ctx->stack[--ctx->sp];
+    int type = objType(flag);
+    if (type != TFOBJ_TYPE_BOOL && !isNumber(flag)) {
+      runtimeError(ctx, "The quotation of 'filter' must leave a boolean or an integer");
+    }
+    int keep = type == TFOBJ_TYPE_BIGINT || objInt(flag) != 0;
+    decRef(flag);
+
+    if (keep) {
+      if (!unique) incRef(x);
+      result->list.ele[kept++] = x;
+    } else if (unique) {
+      decRef(x);
     }
-    tfobj *val = ctx->stack[ctx->sp - 1];
-    stackPush(ctx, val);
+    if (!unique) result->list.len = kept;
+  }
+  if (unique) {
+    list->list.len = kept;
+    listChanged(list);
+  } else {
+    decRef(list);
+  }
+  decRef(quot);
+  stackPushOwned(ctx, result);
+}
+
+/**
+ * @brief Push every element of a list and run a quotation after each
+ * @param list List owned by the caller; it is released
+ * @param check Name of the word if the quotation must keep the depth
+ *              ( acc x -- acc ), NULL to allow any effect
+ */
+static void runOnElements(tfctx *ctx, tfobj *list, tfobj *quot, const char *check) {
+  int unique = list->refcount == 1;
+  for (size_t i = 0; i < list->list.len; i++) {
+    size_t depth = ctx->sp;
+    if (unique) {
+      // Moved out: the list is emptied and freed below
+      stackPushOwned(ctx, list->list.ele[i]);
+      list->list.ele[i] = NULL;
+    } else {
+      stackPush(ctx, list->list.ele[i]);
+    }
+    callQuotation(ctx, quot);
+    if (check) {
+      checkQuotation(ctx, depth, check, "( acc x -- acc )");
+    }
+  }
+  if (unique) {
+    list->list.len = 0;
+  }
+  decRef(list);
+}
+
+void primitiveEach(tfctx *ctx) {
+  tfobj *list, *quot;
+  popListAndQuotation(ctx, "each", "( list quot -- ? )", &list, &quot);
+  runOnElements(ctx, list, quot, NULL);
+  decRef(quot);
+}
+
+void primitiveFold(tfctx *ctx) {
+  tfobj *quot = stackPeek(ctx, 0);
+  tfobj *list = stackPeek(ctx, 2);
+  if (objType(list) != TFOBJ_TYPE_LIST || objType(quot) != TFOBJ_TYPE_LIST) {
+    listOperandError(ctx, "fold", "a list, a value and a quotation ( list acc quot -- acc )");
+  }
+  // Take both off the stack, leaving the initial accumulator
+  ctx->sp--;
+  stackRoll(ctx, 1);
+  ctx->sp--;
+  runOnElements(ctx, list, quot, "fold");
+  decRef(quot);
+}
+
+/**
+ * @brief Number of elements of a list or vector, -1 for anything else
+ */
+static int64_t sequenceLength(tfobj *o) {
+  switch (objType(o)) {
+    case TFOBJ_TYPE_LIST: return (int64_t)o->list.len;
+    case TFOBJ_TYPE_INTVEC: return (int64_t)o->vec.len;
+    default: return -1;
+  }
+}
+
+void primitiveLength(tfctx *ctx) {
+  int64_t len = sequenceLength(stackPeek(ctx, 0));
+  if (len < 0) {
+    listOperandError(ctx, "len", "a list or a vector ( list -- n )");
+  }
+  stackPoke(ctx, 0, createIntObject(len));
+}
+
+void primitiveNth(tfctx *ctx) {
+  tfobj *n = stackPeek(ctx, 0);
+  tfobj *list = stackPeek(ctx, 1);
+  int64_t len = sequenceLength(list);
+  if (len < 0 || objType(n) != TFOBJ_TYPE_INT) {
+    listOperandError(ctx, "nth", "a list or a vector and an index ( list n -- x )");
+  }
+  int64_t i = objInt(n);
+  if (i < 0 || i >= len) {
+    char error_msg[256];
+    snprintf(error_msg, sizeof(error_msg),
+             "'nth' index %" PRId64 " out of range for %" PRId64 " elements", i, len);
+    runtimeError(ctx, error_msg);
+  }
+  tfobj *x;
+  if (objType(list) == TFOBJ_TYPE_INTVEC) {
+    x = createIntObject(list->vec.data[i]);
+  } else {
+    x = list->list.ele[i];
+    incRef(x);
+  }
+  stackDrop(ctx, 2);
+  stackPushOwned(ctx, x);
+}
+
+void primitiveConcat(tfctx *ctx) {
+  tfobj *b = stackPeek(ctx, 0);
+  tfobj *a = stackPeek(ctx, 1);
+  if (objType(a) != TFOBJ_TYPE_LIST || objType(b) != TFOBJ_TYPE_LIST) {
+    listOperandError(ctx, "concat", "two lists ( a b -- ab )");
+  }
+  ctx->sp -= 2;
+
+  tfobj *result;
+  if (a->refcount == 1) {
+    result = a;
+    listReserve(result, a->list.len + b->list.len);
+    listChanged(result);
+  } else {
+    result = createListObject(a->list.len + b->list.len + 1);
+    for (size_t i = 0; i < a->list.len; i++) {
+      incRef(a->list.ele[i]);
+      result->list.ele[i] = a->list.ele[i];
+    }
+    result->list.len = a->list.len;
+    decRef(a);
+  }
+
+  // The elements of a list nobody else holds just move
+  int move = b->refcount == 1;
+  for (size_t i = 0; i < b->list.len; i++) {
+    if (!move) incRef(b->list.ele[i]);
+    result->list.ele[result->list.len++] = b->list.ele[i];
+  }
+  if (move) {
+    b->list.len = 0;
+  }
+  decRef(b);
+  stackPushOwned(ctx, result);
+}
+
+/* ===================== Integer vectors =================== */
+
+/*
+ * The arithmetic is done by the kernels in vector.c. Like the list words,
+ * the element-wise words reuse an operand's buffer for the result when
+ * the stack holds its only reference.
+ */
+
+/**
+ * @brief Exit with an error unless the operands are vectors
+ * @param count Number of vectors on top of the stack (1 or 2)
+ * @param effect Stack effect of the word, for the error message
+ */
+static void checkVectors(tfctx *ctx, int count, const char *name, const char *effect) {
+  for (int i = 0; i < count; i++) {
+    if (objType(stackPeek(ctx, i)) != TFOBJ_TYPE_INTVEC) {
+      char usage[128];
+      snprintf(usage, sizeof(usage), "%s %s",
+               count == 1 ? "a vector" : "two vectors", effect);
+      listOperandError(ctx, name, usage);
+    }
+  }
+}
+
+/**
+ * @brief Exit with an error unless two vectors have the same length
+ */
+static void checkSameLength(tfctx *ctx, tfobj *a, tfobj *b, const char *name) {
+  if (a->vec.len != b->vec.len) {
+    char error_msg[256];
+    snprintf(error_msg, sizeof(error_msg),
+             "'%s' requires vectors of the same length (%zu and %zu)",
+             name, a->vec.len, b->vec.len);
+    runtimeError(ctx, error_msg);
+  }
+}
+
+/**
+ * @brief Report an element that doesn't fit in 64 bits and exit
+ */
+static void vectorOverflowError(tfctx *ctx, const char *name) {
+  char error_msg[256];
+  snprintf(error_msg, sizeof(error_msg),
+           "'%s' overflow: an element doesn't fit in 64 bits", name);
+  runtimeError(ctx, error_msg);
+}
+
+/**
+ * @brief Replace the top n values with a vector result
+ * @param r The result
+ * @param operand Nonzero if r is one of the n values (reused in place),
+ *                0 if it is a new vector whose reference passes to the stack
+ */
+static void replaceWithVector(tfctx *ctx, int n, tfobj *r, int operand) {
+  if (operand) incRef(r);   // Keep it alive past the drop
+  stackDrop(ctx, n);
+  stackPushOwned(ctx, r);
+}
+
+/**
+ * @brief Vector to store an element-wise result of a and b in
+ * @return a or b if the stack holds the only reference, else a new vector
+ */
+static tfobj *vectorResult(tfobj *a, tfobj *b) {
+  if (a->refcount == 1) return a;
+  if (b != NULL && b->refcount == 1) return b;
+  return createIntVecObject(a->vec.len);
+}
+
+void primitiveIota(tfctx *ctx) {
+  tfobj *n = stackPeek(ctx, 0);
+  if (objType(n) != TFOBJ_TYPE_INT || objInt(n) < 0) {
+    listOperandError(ctx, "iota", "a count from 0 up ( n -- vec )");
+  }
+  if ((uint64_t)objInt(n) > SIZE_MAX / sizeof(int64_t)) {
+    runtimeError(ctx, "'iota' count is too large for a vector");
+  }
+  tfobj *v = createIntVecObject((size_t)objInt(n));
+  vecIota(v->vec.data, v->vec.len);
+  stackPoke(ctx, 0, v);
+}
+
+void primitiveToVector(tfctx *ctx) {
+  tfobj *list = stackPeek(ctx, 0);
+  if (objType(list) != TFOBJ_TYPE_LIST) {
+    listOperandError(ctx, ">vec", "a list of integers ( list -- vec )");
+  }
+  tfobj *v = createIntVecObject(list->list.len);
+  for (size_t i = 0; i < list->list.len; i++) {
+    tfobj *x = list->list.ele[i];
+    if (objType(x) != TFOBJ_TYPE_INT) {
+      decRef(v);
+      runtimeError(ctx, "'>vec' requires a list of integers that fit in 64 bits");
+    }
+    v->vec.data[i] = objInt(x);
+  }
+  stackPoke(ctx, 0, v);
+}
+
+void primitiveVectorSum(tfctx *ctx) {
+  checkVectors(ctx, 1, "vsum", "( vec -- n )");
+  tfobj *v = stackPeek(ctx, 0);
+  int64_t sum;
+  if (!vecSum(v->vec.data, v->vec.len, &sum)) {
+    stackPoke(ctx, 0, createIntObject(sum));
+    return;
+  }
+  // The sum doesn't fit in 64 bits (or nearly): add with big integers
+  tfobj *acc = createIntObject(0);
+  for (size_t i = 0; i < v->vec.len; i++) {
+    tfobj *x = createIntObject(v->vec.data[i]);
+    tfobj *r = numberAdd(acc, x);
+    decRef(x);
+    decRef(acc);
+    acc = r;
+  }
+  stackPoke(ctx, 0, acc);
+}
+
+void primitiveVectorDot(tfctx *ctx) {
+  checkVectors(ctx, 2, "vdot", "( a b -- n )");
+  tfobj *b = stackPeek(ctx, 0);
+  tfobj *a = stackPeek(ctx, 1);
+  checkSameLength(ctx, a, b, "vdot");
+  int64_t dot;
+  tfobj *result;
+  if (!vecDot(a->vec.data, b->vec.data, a->vec.len, &dot)) {
+    result = createIntObject(dot);
+  } else {
+    result = createIntObject(0);
+    for (size_t i = 0; i < a->vec.len; i++) {
+      tfobj *x = createIntObject(a->vec.data[i]);
+      tfobj *y = createIntObject(b->vec.data[i]);
+      tfobj *p = numberMul(x, y);
+      tfobj *r = numberAdd(result, p);
+      decRef(x);
+      decRef(y);
+      decRef(p);
+      decRef(result);
+      result = r;
+    }
+  }
+  stackDrop(ctx, 2);
+  stackPushOwned(ctx, result);
+}
+
+/**
+ * @brief Run an element-wise kernel on the two vectors on top ( a b -- c )
+ */
+static void vectorBinary(tfctx *ctx, const char *name,
+                         int (*kernel)(int64_t *, const int64_t *, const int64_t *, size_t)) {
+  checkVectors(ctx, 2, name, "( a b -- c )");
+  tfobj *b = stackPeek(ctx, 0);
+  tfobj *a = stackPeek(ctx, 1);
+  checkSameLength(ctx, a, b, name);
+  tfobj *r = vectorResult(a, b);
+  if (kernel(r->vec.data, a->vec.data, b->vec.data, a->vec.len)) {
+    vectorOverflowError(ctx, name);
+  }
+  replaceWithVector(ctx, 2, r, r == a || r == b);
+}
+
+void primitiveVectorAdd(tfctx *ctx) {
+  vectorBinary(ctx, "vadd", vecAdd);
+}
+
+void primitiveVectorMul(tfctx *ctx) {
+  vectorBinary(ctx, "vmul", vecMul);
+}
+
+void primitiveVectorScale(tfctx *ctx) {
+  tfobj *k = stackPeek(ctx, 0);
+  tfobj *v = stackPeek(ctx, 1);
+  if (objType(v) != TFOBJ_TYPE_INTVEC || objType(k) != TFOBJ_TYPE_INT) {
+    listOperandError(ctx, "vscale", "a vector and an integer ( vec k -- vec )");
+  }
+  tfobj *r = vectorResult(v, NULL);
+  if (vecScale(r->vec.data, v->vec.data, objInt(k), v->vec.len)) {
+    vectorOverflowError(ctx, "vscale");
+  }
+  replaceWithVector(ctx, 2, r, r == v);
+}
+
+/**
+ * @brief Replace a nonempty vector with its smallest or largest element
+ */
+static void vectorExtreme(tfctx *ctx, const char *name, int64_t (*kernel)(const int64_t *, size_t)) {
+  checkVectors(ctx, 1, name, "( vec -- n )");
+  tfobj *v = stackPeek(ctx, 0);
+  if (v->vec.len == 0) {
+    char error_msg[256];
+    snprintf(error_msg, sizeof(error_msg), "'%s' of an empty vector", name);
+    runtimeError(ctx, error_msg);
+  }
+  stackPoke(ctx, 0, createIntObject(kernel(v->vec.data, v->vec.len)));
+}
+
+void primitiveVectorMin(tfctx *ctx) {
+  vectorExtreme(ctx, "vmin", vecMin);
+}
+
+void primitiveVectorMax(tfctx *ctx) {
+  vectorExtreme(ctx, "vmax", vecMax);
+}
+
+/* ===================== Stack words =================== */
+
+/*
+ * Values are only moved between slots (no refcount changes), except for
+ * the words that really create new references, like 'over'.
+ */
+
+void primitiveOver(tfctx *ctx) {
+  stackPick(ctx, 1);
+}
+
+void primitiveRot(tfctx *ctx) {
+  stackRoll(ctx, 2);
+}
+
+void primitiveMinusRot(tfctx *ctx) {
+  stackUnroll(ctx, 2);
+}
+
+void primitiveNip(tfctx *ctx) {
+  stackRoll(ctx, 1);
+  stackDrop(ctx, 1);
+}
+
+void primitiveTuck(tfctx *ctx) {
+  stackPick(ctx, 0);
+  stackUnroll(ctx, 2);
+}
+
+void primitiveTwoDup(tfctx *ctx) {
+  stackPick(ctx, 1);
+  stackPick(ctx, 1);
+}
+
+/**
+ * @brief Pop the index operand of 'pick' or 'roll' and check the depth
+ * @param ctx Execution context
+ * @param name Word name, for error messages
+ * @return The index u; the stack is known to hold u + 1 more values
+ */
+static size_t popIndex(tfctx *ctx, const char *name) {
+  tfobj *u = stackPeek(ctx, 0);
+  char error_msg[256];
+  if (objType(u) != TFOBJ_TYPE_INT || objInt(u) < 0) {
+    snprintf(error_msg, sizeof(error_msg),
+             "'%s' requires a non-negative integer index", name);
+    runtimeError(ctx, error_msg);
+  }
+  int64_t n = objInt(u);
+  stackDrop(ctx, 1);
+  if ((uint64_t)n >= ctx->sp) {
+    snprintf(error_msg, sizeof(error_msg),
+             "Stack underflow: '%" PRId64 " %s' requires %" PRId64 " more values",
+             n, name, n + 1);
+    runtimeError(ctx, error_msg);
+  }
+  return (size_t)n;
+}
+
+void primitivePick(tfctx *ctx) {
+  stackPick(ctx, popIndex(ctx, "pick"));
+}
+
+void primitiveRoll(tfctx *ctx) {
+  stackRoll(ctx, popIndex(ctx, "roll"));
+}
+
+/* ===================== Fused primitives =================== */
+
+/**
+ * @brief Replace the top of the stack with an integer result
+ * @param ctx Execution context
+ * @param result Value to store
+ *
+ * Used by the fast paths of the unary fused primitives, which consume an
+ * immediate top value and push one back: the slot is reused instead of
+ * popping and pushing, and the old value needs no decRef().
+ */
+static void replaceTop(tfctx *ctx, int64_t result) {
+  ctx->stack[ctx->sp - 1] = createIntObject(result);
+}
+
+/*
+ * Each fused primitive has the same fast path as the words it replaces,
+ * and otherwise just runs them one after the other.
+ */
+
+void primitiveDupMul(tfctx *ctx) {
+  tfobj *a = ctx->stack[ctx->sp - 1];
+  int64_t result;
+  if (isImmInt(a) && !mulOverflow(objInt(a), objInt(a), &result)) {
+    replaceTop(ctx, result);
+    return;
+  }
+  stackPick(ctx, 0);
+  primitiveMul(ctx);
+}
+
+void primitiveDupAdd(tfctx *ctx) {
+  tfobj *a = ctx->stack[ctx->sp - 1];
+  if (isImmInt(a)) {
+    replaceTop(ctx, objInt(a) + objInt(a));
+    return;
+  }
+  stackPick(ctx, 0);
+  primitiveAdd(ctx);
+}
+
+void primitiveSwapSub(tfctx *ctx) {
+  tfobj *a = ctx->stack[ctx->sp - 2];
+  tfobj *b = ctx->stack[ctx->sp - 1];
+  if (isImmInt(a) && isImmInt(b)) {
+    ctx->stack[ctx->sp - 2] = createIntObject(objInt(b) - objInt(a));
+    ctx->sp--;
+    return;
+  }
+  primitiveSwap(ctx);
+  primitiveSub(ctx);
+}
+
+void primitiveSwapDrop(tfctx *ctx) {
+  primitiveNip(ctx);
+}
+
+void primitiveDropDrop(tfctx *ctx) {
+  stackDrop(ctx, 2);
+}
+
+void primitiveAddLit(tfctx *ctx) {
+  tfobj *a = ctx->stack[ctx->sp - 1];
+  tfobj *n = ctx->current_object->sym.arg;
+  if (isImmInt(a)) {
+    replaceTop(ctx, objInt(a) + objInt(n));
+    return;
+  }
+  stackPush(ctx, n);
+  primitiveAdd(ctx);
+}
+
+void primitiveSubLit(tfctx *ctx) {
+  tfobj *a = ctx->stack[ctx->sp - 1];
+  tfobj *n = ctx->current_object->sym.arg;
+  if (isImmInt(a)) {
+    replaceTop(ctx, objInt(a) - objInt(n));
+    return;
+  }
+  stackPush(ctx, n);
+  primitiveSub(ctx);
+}
+
+void primitiveMulLit(tfctx *ctx) {
+  tfobj *a = ctx->stack[ctx->sp - 1];
+  tfobj *n = ctx->current_object->sym.arg;
+  int64_t result;
+  if (isImmInt(a) && !mulOverflow(objInt(a), objInt(n), &result)) {
+    replaceTop(ctx, result);
+    return;
+  }
+  stackPush(ctx, n);
+  primitiveMul(ctx);
 }
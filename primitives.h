@@ -4,7 +4,9 @@
  *
  * This module contains the C implementations of all built-in ToyForth
  * words (primitives). Each primitive manipulates the execution stack
- * and performs type checking.
+ * and performs type checking. Stack depth is not checked here: the VM
+ * makes sure the stack holds at least the number of values a primitive
+ * consumes before calling it.
  */
 
 #ifndef PRIMITIVES_H
@@ -16,8 +18,7 @@
  * @param ctx Execution context
  *
  * Pops two integers from the stack, adds them, and pushes the result.
- * Exits with an error if the stack has fewer than 2 values or if either
- * value is not an integer.
+ * Exits with an error if either value is not an integer.
  */
 void primitiveAdd(tfctx *ctx);
 
@@ -26,8 +27,7 @@ void primitiveAdd(tfctx *ctx);
  * @param ctx Execution context
  *
  * Pops two integers from the stack (b then a), computes a-b, and pushes
- * the result. Exits with an error if the stack has fewer than 2 values
- * or if either value is not an integer.
+ * the result. Exits with an error if either value is not an integer.
  */
 void primitiveSub(tfctx *ctx);
 
@@ -36,8 +36,7 @@ void primitiveSub(tfctx *ctx);
  * @param ctx Execution context
  *
  * Pops two integers from the stack (b then a), computes a*b, and pushes
- * the result. Exits with an error if the stack has fewer than 2 values
- * or if either value is not an integer.
+ * the result.
  */
  void primitiveMul(tfctx *ctx);
 
@@ -45,8 +44,7 @@ void primitiveSub(tfctx *ctx);
  * @brief Discard the top stack value ( a -- )
  * @param ctx Execution context
  *
- * Pops and discards the top value from the stack. Exits with an error
- * if the stack is empty.
+ * Pops and discards the top value from the stack.
  */
 void primitiveDrop(tfctx *ctx);
 
@@ -54,8 +52,7 @@ void primitiveDrop(tfctx *ctx);
  * @brief Swap the top two stack values ( a b -- b a )
  * @param ctx Execution context
  *
- * Exchanges the positions of the top two values on the stack. Exits with
- * an error if the stack has fewer than 2 values.
+ * Exchanges the positions of the top two values on the stack.
  */
 void primitiveSwap(tfctx *ctx);
 
@@ -63,9 +60,9 @@ void primitiveSwap(tfctx *ctx);
  * @brief Pop and print an integer ( n -- )
  * @param ctx Execution context
  *
- * Pops an integer from the stack and prints it to stdout followed by a
- * newline. Exits with an error if the stack is empty or if the top value
- * is not an integer.
+ * Pops an integer from the stack and prints it to ctx->out followed by a
+ * newline; booleans print as 'true' or 'false', lists and vectors with
+ * their elements. The text is buffered, see output.h.
  */
 void primitivePrint(tfctx *ctx);
 
@@ -73,9 +70,306 @@ void primitivePrint(tfctx *ctx);
  * @brief Duplicate the top stack value ( a -- a a )
  * @param ctx Execution context
  *
- * Pushes a copy of the top stack value onto the stack. Exits with an
- * error if the stack is empty.
+ * Pushes a copy of the top stack value onto the stack.
  */
 void primitiveDuplicate(tfctx *ctx);
 
+/**
+ * @brief Print memory and stack statistics ( -- )
+ * @param ctx Execution context
+ *
+ * Prints live objects by type, pool allocations and bytes, incRef and
+ * decRef counts, and the stack depth and high-water mark (see
+ * printStats()). The counts depend on the VM and optimization passes in
+ * use, so they are meant for people, not for tests.
+ */
+void primitiveStats(tfctx *ctx);
+
+/* ===================== Output =================== */
+
+/**
+ * @brief Write out what the context has buffered ( -- )
+ * @param ctx Execution context
+ *
+ * Whatever the flush policy, the text printed so far reaches the stream
+ * (and the stream is flushed).
+ */
+void primitiveFlush(tfctx *ctx);
+
+/**
+ * @brief Print a newline ( -- )
+ * @param ctx Execution context
+ */
+void primitiveCr(tfctx *ctx);
+
+/**
+ * @brief Print a character ( c -- )
+ * @param ctx Execution context
+ *
+ * Exits with an error unless c is a character code from 0 to 255.
+ */
+void primitiveEmit(tfctx *ctx);
+
+/**
+ * @brief Print a list of character codes as text ( list -- )
+ * @param ctx Execution context
+ *
+ * '[ 72 105 10 ] type' prints "Hi" and a newline. Exits with an error,
+ * printing nothing, unless every element is a code from 0 to 255.
+ */
+void primitiveType(tfctx *ctx);
+
+/* ===================== Stack words =================== */
+
+/**
+ * @brief Copy the second value to the top ( a b -- a b a )
+ * @param ctx Execution context
+ */
+void primitiveOver(tfctx *ctx);
+
+/**
+ * @brief Rotate the third value to the top ( a b c -- b c a )
+ * @param ctx Execution context
+ */
+void primitiveRot(tfctx *ctx);
+
+/**
+ * @brief Rotate the top value to third place, '-rot' ( a b c -- c a b )
+ * @param ctx Execution context
+ */
+void primitiveMinusRot(tfctx *ctx);
+
+/**
+ * @brief Drop the second value ( a b -- b )
+ * @param ctx Execution context
+ */
+void primitiveNip(tfctx *ctx);
+
+/**
+ * @brief Copy the top value below the second ( a b -- b a b )
+ * @param ctx Execution context
+ */
+void primitiveTuck(tfctx *ctx);
+
+/**
+ * @brief Duplicate the top two values, '2dup' ( a b -- a b a b )
+ * @param ctx Execution context
+ */
+void primitiveTwoDup(tfctx *ctx);
+
+/**
+ * @brief Copy the u-th value to the top ( xu ... x0 u -- xu ... x0 xu )
+ * @param ctx Execution context
+ *
+ * '0 pick' is 'dup', '1 pick' is 'over'. The VM only guarantees u itself
+ * is on the stack, so the depth below it is checked here. Exits with an
+ * error if u is not a non-negative integer.
+ */
+void primitivePick(tfctx *ctx);
+
+/**
+ * @brief Move the u-th value to the top ( xu ... x0 u -- xu-1 ... x0 xu )
+ * @param ctx Execution context
+ *
+ * '1 roll' is 'swap', '2 roll' is 'rot'. Checks the depth like 'pick'.
+ */
+void primitiveRoll(tfctx *ctx);
+
+/* ===================== Comparisons and loops =================== */
+
+/**
+ * @brief Test two values for equality ( a b -- flag )
+ * @param ctx Execution context
+ *
+ * Compares two integers of any size, or two booleans. Exits with an
+ * error for any other pair of values.
+ */
+void primitiveEqual(tfctx *ctx);
+
+/**
+ * @brief Test two values for inequality ( a b -- flag ), like '='
+ */
+void primitiveNotEqual(tfctx *ctx);
+
+/**
+ * @brief Compare two integers ( a b -- a<b )
+ * @param ctx Execution context
+ *
+ * The ordered comparisons '<', '>', '<=' and '>=' accept integers of
+ * any size and exit with an error for anything else.
+ */
+void primitiveLess(tfctx *ctx);
+
+/** @brief Compare two integers ( a b -- a>b ) */
+void primitiveGreater(tfctx *ctx);
+
+/** @brief Compare two integers ( a b -- a<=b ) */
+void primitiveLessEqual(tfctx *ctx);
+
+/** @brief Compare two integers ( a b -- a>=b ) */
+void primitiveGreaterEqual(tfctx *ctx);
+
+/**
+ * @brief Push the index of the innermost do/loop ( -- i )
+ * @param ctx Execution context
+ *
+ * Works in any word called from the loop body too. Exits with an error
+ * if no loop is running.
+ */
+void primitiveLoopIndex(tfctx *ctx);
+
+/* ===================== Lists and quotations =================== */
+
+/*
+ * A quotation is a list used as code: the words below run it once per
+ * element with callQuotation() (see list.h). The quotation of map,
+ * filter and fold must have the effect shown, which is checked after
+ * every call; the analysis relies on it.
+ */
+
+/**
+ * @brief Apply a quotation to every element ( list quot -- list' )
+ * @param ctx Execution context
+ *
+ * The quotation must be ( x -- y ). The result replaces the list in
+ * place if nothing else holds it.
+ */
+void primitiveMap(tfctx *ctx);
+
+/**
+ * @brief Keep the elements a quotation accepts ( list quot -- list' )
+ * @param ctx Execution context
+ *
+ * The quotation must be ( x -- flag ), the flag being a boolean or an
+ * integer as for 'if'.
+ */
+void primitiveFilter(tfctx *ctx);
+
+/**
+ * @brief Combine the elements from the left ( list acc quot -- acc' )
+ * @param ctx Execution context
+ *
+ * The quotation must be ( acc x -- acc' ).
+ */
+void primitiveFold(tfctx *ctx);
+
+/**
+ * @brief Run a quotation on every element ( list quot -- ? )
+ * @param ctx Execution context
+ *
+ * The quotation may have any effect, so the analysis stops tracking
+ * the depth after 'each'.
+ */
+void primitiveEach(tfctx *ctx);
+
+/** @brief Number of elements of a list or vector ( list -- n ) */
+void primitiveLength(tfctx *ctx);
+
+/** @brief Element n of a list or vector, counting from 0 ( list n -- x ) */
+void primitiveNth(tfctx *ctx);
+
+/**
+ * @brief Join two lists ( a b -- ab )
+ * @param ctx Execution context
+ *
+ * Appends to a in place if nothing else holds it.
+ */
+void primitiveConcat(tfctx *ctx);
+
+/* ===================== Integer vectors =================== */
+
+/*
+ * Packed int64_t vectors (TFOBJ_TYPE_INTVEC, see vector.h), built with
+ * 'iota' or '>vec' and processed in bulk. 'len', 'nth' and '.' work on
+ * them too. The element-wise words require vectors of the same length and
+ * report an element that overflows; the reductions return a big integer
+ * when the result needs one.
+ */
+
+/** @brief Vector of 0, 1, ... n-1 ( n -- vec ) */
+void primitiveIota(tfctx *ctx);
+
+/** @brief Vector of the integers of a list ( list -- vec ) */
+void primitiveToVector(tfctx *ctx);
+
+/** @brief Sum of the elements ( vec -- n ) */
+void primitiveVectorSum(tfctx *ctx);
+
+/** @brief Dot product ( a b -- n ) */
+void primitiveVectorDot(tfctx *ctx);
+
+/** @brief Element-wise sum ( a b -- c ) */
+void primitiveVectorAdd(tfctx *ctx);
+
+/** @brief Element-wise product ( a b -- c ) */
+void primitiveVectorMul(tfctx *ctx);
+
+/** @brief Product of every element by an integer ( vec k -- vec' ) */
+void primitiveVectorScale(tfctx *ctx);
+
+/** @brief Smallest element of a nonempty vector ( vec -- n ) */
+void primitiveVectorMin(tfctx *ctx);
+
+/** @brief Largest element of a nonempty vector ( vec -- n ) */
+void primitiveVectorMax(tfctx *ctx);
+
+/* ===================== Fused primitives =================== */
+
+/*
+ * Superinstructions produced by fuseProgram() (see fuse.h). Each one does
+ * the work of a common two-word sequence in a single dispatch and leaves
+ * exactly the same stack as the unfused sequence would.
+ */
+
+/**
+ * @brief Fused 'dup *' ( a -- a*a )
+ * @param ctx Execution context
+ */
+void primitiveDupMul(tfctx *ctx);
+
+/**
+ * @brief Fused 'dup +' ( a -- a+a )
+ * @param ctx Execution context
+ */
+void primitiveDupAdd(tfctx *ctx);
+
+/**
+ * @brief Fused 'swap -' ( a b -- b-a )
+ * @param ctx Execution context
+ */
+void primitiveSwapSub(tfctx *ctx);
+
+/**
+ * @brief Fused 'swap drop' ( a b -- b )
+ * @param ctx Execution context
+ */
+void primitiveSwapDrop(tfctx *ctx);
+
+/**
+ * @brief Fused 'drop drop' ( a b -- )
+ * @param ctx Execution context
+ */
+void primitiveDropDrop(tfctx *ctx);
+
+/**
+ * @brief Fused 'n +' ( a -- a+n )
+ * @param ctx Execution context
+ *
+ * The literal n is read from the sym.arg of the executing symbol
+ * (ctx->current_object). Same for the other *Lit primitives.
+ */
+void primitiveAddLit(tfctx *ctx);
+
+/**
+ * @brief Fused 'n -' ( a -- a-n )
+ * @param ctx Execution context
+ */
+void primitiveSubLit(tfctx *ctx);
+
+/**
+ * @brief Fused 'n *' ( a -- a*n )
+ * @param ctx Execution context
+ */
+void primitiveMulLit(tfctx *ctx);
+
 #endif
\ No newline at end of file
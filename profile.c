@@ -0,0 +1,398 @@
+/**
+ * @file profile.c
+ * @brief Implementation of the execution profiler
+ *
+ * Sites live in an open-addressing hash table keyed by (name, line,
+ * column) rather than by symbol pointer, so a profile stays valid across
+ * stream batches whose objects are freed and reused. Call paths form a
+ * tree with one node per (parent, word name); each node's self time is
+ * its total minus that of its children.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+#include "tf.h"
+#include "mem.h"
+#include "stack.h"
+#include "intern.h"
+#include "control.h"
+
+/** @brief Number of call sites listed by printProfile() */
+#define PROFILE_TOP_SITES 20
+
+/**
+ * @brief Measurements for one call site
+ */
+typedef struct profSite {
+    uint32_t id;            /**< Intern id of the word name */
+    int line;               /**< Source location of the call */
+    int column;
+    unsigned long calls;    /**< 0 marks an empty slot */
+    uint64_t ns;            /**< Time spent, including called words */
+    unsigned long allocs;   /**< Pool allocations made */
+} profSite;
+
+/**
+ * @brief One node of the call path tree
+ */
+typedef struct profNode {
+    uint32_t id;
+    unsigned long calls;
+    uint64_t ns;
+    struct profNode *child;    /**< First word called from this one */
+    struct profNode *sibling;  /**< Next word called from the parent */
+} profNode;
+
+typedef struct tfprofile {
+    profSite *sites;
+    size_t capacity;
+    size_t count;
+    profNode root;          /**< The top level of the program ('main') */
+} tfprofile;
+
+/* ===================== Sites =================== */
+
+/**
+ * @brief Hash a call site
+ */
+static size_t hashSite(uint32_t id, int line, int column) {
+    uint64_t h = ((uint64_t)id << 32 | (uint32_t)line) * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)(uint32_t)column + 0x7F4A7C15ULL + (h << 6) + (h >> 2);
+    return (size_t)(h ^ (h >> 29));
+}
+
+/**
+ * @brief Find the entry for a site, or the empty slot where it belongs
+ */
+static profSite *findSite(tfprofile *prof, uint32_t id, int line, int column) {
+    size_t mask = prof->capacity - 1;
+    size_t i = hashSite(id, line, column) & mask;
+    while (prof->sites[i].calls != 0 &&
+           (prof->sites[i].id != id || prof->sites[i].line != line ||
+            prof->sites[i].column != column)) {
+        i = (i + 1) & mask;
+    }
+    return &prof->sites[i];
+}
+
+/**
+ * @brief Double the table size and rehash every site
+ */
+static void growSites(tfprofile *prof) {
+    profSite *old = prof->sites;
+    size_t old_capacity = prof->capacity;
+
+    prof->capacity *= 2;
+    prof->sites = xmalloc(sizeof(profSite) * prof->capacity);
+    memset(prof->sites, 0, sizeof(profSite) * prof->capacity);
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].calls == 0) continue;
+        *findSite(prof, old[i].id, old[i].line, old[i].column) = old[i];
+    }
+    free(old);
+}
+
+/**
+ * @brief Record one execution of the word at a site
+ * @param id Name of the word run ('recurse' is recorded as the word it calls)
+ */
+static void recordSite(tfprofile *prof, tfobj *o, uint32_t id, uint64_t ns,
+                       unsigned long allocs) {
+    if ((prof->count + 1) * 4 > prof->capacity * 3) {
+        growSites(prof);
+    }
+    profSite *s = findSite(prof, id, o->src_line, o->src_column);
+    if (s->calls == 0) {
+        s->id = id;
+        s->line = o->src_line;
+        s->column = o->src_column;
+        prof->count++;
+    }
+    s->calls++;
+    s->ns += ns;
+    s->allocs += allocs;
+}
+
+/* ===================== Call paths =================== */
+
+/**
+ * @brief Find or add the node for a word called from 'parent'
+ */
+static profNode *childNode(profNode *parent, uint32_t id) {
+    for (profNode *n = parent->child; n; n = n->sibling) {
+        if (n->id == id) return n;
+    }
+    profNode *n = xmalloc(sizeof(profNode));
+    memset(n, 0, sizeof(profNode));
+    n->id = id;
+    n->sibling = parent->child;
+    parent->child = n;
+    return n;
+}
+
+static void freeNodes(profNode *n) {
+    while (n) {
+        profNode *next = n->sibling;
+        freeNodes(n->child);
+        free(n);
+        n = next;
+    }
+}
+
+/* ===================== Profiling VM =================== */
+
+static uint64_t profileNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief A word call in progress, next to its frame on ctx->rstack
+ */
+typedef struct profCall {
+    tfobj *site;            /**< Symbol that made the call */
+    uint32_t id;            /**< Name of the word called */
+    profNode *caller;       /**< Call path node to go back to */
+    tfobj *caller_word;     /**< Word to go back to, NULL at the top level */
+    profNode *callee;       /**< Node of the call, NULL if it recursed */
+    uint64_t start;
+    unsigned long allocs;   /**< poolAllocations() when it started */
+} profCall;
+
+/**
+ * @brief Account for a word (primitive or colon definition) that returned
+ * @param callee Node receiving the call, NULL for a recursive call, whose
+ *               time and allocations belong to the outermost call already
+ */
+static void endCall(tfprofile *prof, tfobj *site, uint32_t id, profNode *callee,
+                    uint64_t start, unsigned long allocs) {
+    if (callee == NULL) {
+        recordSite(prof, site, id, 0, 0);
+        return;
+    }
+    uint64_t ns = profileNow() - start;
+    callee->calls++;
+    callee->ns += ns;
+    recordSite(prof, site, id, ns, poolAllocations() - allocs);
+}
+
+/**
+ * @brief The exec() loop, with every word call timed
+ *
+ * Calls to colon definitions push a frame on ctx->rstack like in exec(),
+ * and their timing on a stack of profCall next to it. Every call gets a
+ * frame, tail calls included, so each one can be timed when it returns.
+ * A word calling itself stays on its call path node instead of adding a
+ * level to the tree.
+ */
+static void profileList(tfctx *ctx, tfobj *program) {
+    tfprofile *prof = ctx->profile;
+    size_t base = ctx->rsp;
+    profCall *calls = xmalloc(sizeof(profCall) * INITIAL_RETURN_CAPACITY);
+    size_t calls_capacity = INITIAL_RETURN_CAPACITY;
+    profNode *node = &prof->root;
+    tfobj *word = NULL;   // Colon definition being run
+    tfobj *list = program;
+    size_t i = 0;
+
+    for (;;) {
+        if (i == list->list.len) {
+            if (ctx->rsp == base) break;
+            tfframe *f = &ctx->rstack[--ctx->rsp];
+            profCall *c = &calls[ctx->rsp - base];
+            list = f->list;
+            i = f->index;
+            node = c->caller;
+            word = c->caller_word;
+            endCall(prof, c->site, c->id, c->callee, c->start, c->allocs);
+            continue;
+        }
+        tfobj *o = list->list.ele[i++];
+        switch (objType(o)) {
+            case TFOBJ_TYPE_INT:
+            case TFOBJ_TYPE_BIGINT:
+            case TFOBJ_TYPE_BOOL:
+            case TFOBJ_TYPE_LIST:
+                stackPush(ctx, o);
+                break;
+            case TFOBJ_TYPE_SYMBOL: {
+                ctx->current_object = o;
+                if (ctx->sp < (size_t)o->sym.need) {
+                    stackUnderflowError(ctx, o);
+                }
+                if (o->sym.control) {
+                    // Not a call, its time belongs to the enclosing word
+                    i = runControl(ctx, o, i);
+                    break;
+                }
+                if (o->sym.fn) {
+                    profNode *child = childNode(node, o->sym.id);
+                    unsigned long allocs = poolAllocations();
+                    uint64_t start = profileNow();
+                    o->sym.fn(ctx);
+                    endCall(prof, o, o->sym.id, child, start, allocs);
+                } else if (o->sym.word) {
+                    tfframe *f = returnPush(ctx);
+                    f->list = list;
+                    f->index = i;
+                    size_t depth = ctx->rsp - base;
+                    if (depth > calls_capacity) {
+                        calls_capacity *= 2;
+                        calls = xrealloc(calls, sizeof(profCall) * calls_capacity);
+                    }
+                    profCall *c = &calls[depth - 1];
+                    int recursive = o->sym.word == word;
+                    c->site = o;
+                    c->id = o->sym.word->word.name->sym.id;
+                    c->caller = node;
+                    c->caller_word = word;
+                    c->callee = recursive ? NULL : childNode(node, c->id);
+                    c->allocs = poolAllocations();
+                    c->start = profileNow();
+                    if (recursive) {
+                        node->calls++;
+                    } else {
+                        node = c->callee;
+                    }
+                    word = o->sym.word;
+                    list = word->word.body;
+                    i = 0;
+                } else {
+                    char error_msg[256];
+                    snprintf(error_msg, sizeof(error_msg), "Unresolved word '%s'", o->sym.ptr);
+                    runtimeError(ctx, error_msg);
+                }
+                break;
+            }
+            case TFOBJ_TYPE_WORD:
+                break;
+            default:
+                runtimeError(ctx, "Found an unknown keyword while executing the program");
+                break;
+        }
+    }
+    free(calls);
+}
+
+void execProfile(tfctx *ctx, tfobj *program) {
+    uint64_t start = profileNow();
+    profileList(ctx, program);
+    ctx->profile->root.ns += profileNow() - start;
+}
+
+/* ===================== Reports =================== */
+
+tfprofile *createProfile(void) {
+    tfprofile *prof = xmalloc(sizeof(tfprofile));
+    prof->capacity = 64;
+    prof->count = 0;
+    prof->sites = xmalloc(sizeof(profSite) * prof->capacity);
+    memset(prof->sites, 0, sizeof(profSite) * prof->capacity);
+    memset(&prof->root, 0, sizeof(profNode));
+    return prof;
+}
+
+/**
+ * @brief qsort comparator: most time first
+ */
+static int compareSites(const void *a, const void *b) {
+    uint64_t na = ((const profSite *)a)->ns;
+    uint64_t nb = ((const profSite *)b)->ns;
+    return (na < nb) - (na > nb);
+}
+
+void printProfile(tfprofile *prof, FILE *out) {
+    profSite *sites = xmalloc(sizeof(profSite) * (prof->count + 1));
+    size_t n = 0;
+    for (size_t i = 0; i < prof->capacity; i++) {
+        if (prof->sites[i].calls != 0) sites[n++] = prof->sites[i];
+    }
+
+    /* Words: the sites merged by name, using intern ids as indexes.
+     * They reuse the site layout (with no location) to share the sort. */
+    uint32_t max_id = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (sites[i].id > max_id) max_id = sites[i].id;
+    }
+    profSite *words = xmalloc(sizeof(profSite) * ((size_t)max_id + 1));
+    memset(words, 0, sizeof(profSite) * ((size_t)max_id + 1));
+    for (size_t i = 0; i < n; i++) {
+        profSite *w = &words[sites[i].id];
+        w->id = sites[i].id;
+        w->calls += sites[i].calls;
+        w->ns += sites[i].ns;
+        w->allocs += sites[i].allocs;
+    }
+    size_t n_words = 0;
+    for (size_t id = 0; id <= max_id; id++) {
+        if (words[id].calls != 0) words[n_words++] = words[id];
+    }
+    qsort(words, n_words, sizeof(profSite), compareSites);
+    qsort(sites, n, sizeof(profSite), compareSites);
+
+    double total = prof->root.ns ? (double)prof->root.ns : 1.0;
+    fprintf(out, "Total %.3f ms (time includes the words each word calls)\n",
+            prof->root.ns / 1e6);
+    fprintf(out, "%12s %12s %7s %10s  %s\n", "calls", "ms", "%", "allocs", "word");
+    for (size_t i = 0; i < n_words; i++) {
+        fprintf(out, "%12lu %12.3f %6.1f%% %10lu  %s\n", words[i].calls,
+                words[i].ns / 1e6, 100.0 * words[i].ns / total,
+                words[i].allocs, internString(words[i].id));
+    }
+    fprintf(out, "\n%12s %12s %7s %10s  %s\n", "calls", "ms", "%", "allocs", "site");
+    for (size_t i = 0; i < n && i < PROFILE_TOP_SITES; i++) {
+        fprintf(out, "%12lu %12.3f %6.1f%% %10lu  %s at %d:%d\n", sites[i].calls,
+                sites[i].ns / 1e6, 100.0 * sites[i].ns / total, sites[i].allocs,
+                internString(sites[i].id), sites[i].line, sites[i].column);
+    }
+    free(words);
+    free(sites);
+}
+
+/**
+ * @brief Print a node and its subtree, one collapsed stack per node
+ * @param path Names from the root down to the parent, ';' separated
+ * @param len Length of the path
+ */
+static void printStacks(profNode *node, const char *name, char **path,
+                        size_t *capacity, size_t len, FILE *out) {
+    size_t name_len = strlen(name);
+    if (len + name_len + 2 > *capacity) {
+        *capacity = (len + name_len + 2) * 2;
+        *path = xrealloc(*path, *capacity);
+    }
+    if (len > 0) (*path)[len++] = ';';
+    memcpy(*path + len, name, name_len + 1);
+    len += name_len;
+
+    uint64_t self = node->ns;
+    for (profNode *c = node->child; c; c = c->sibling) {
+        self -= c->ns < self ? c->ns : self;
+    }
+    if (self > 0) {
+        fprintf(out, "%s %llu\n", *path, (unsigned long long)self);
+    }
+    for (profNode *c = node->child; c; c = c->sibling) {
+        printStacks(c, internString(c->id), path, capacity, len, out);
+    }
+}
+
+void printCollapsedStacks(tfprofile *prof, FILE *out) {
+    size_t capacity = 256;
+    char *path = xmalloc(capacity);
+    printStacks(&prof->root, "main", &path, &capacity, 0, out);
+    free(path);
+}
+
+void freeProfile(tfprofile *prof) {
+    freeNodes(prof->root.child);
+    free(prof->sites);
+    free(prof);
+}
@@ -0,0 +1,64 @@
+/**
+ * @file profile.h
+ * @brief Execution profiler: time and allocations per word and per site
+ *
+ * The profiler has its own copy of the list-walking VM loop, which times
+ * every word it runs. The normal VMs contain no profiling code at all,
+ * so they pay nothing for it.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+#include <stdio.h>
+#include "tf.h"
+
+/**
+ * @brief Create an empty execution profile
+ * @return New profile, to be freed with freeProfile()
+ *
+ * Store it in ctx->profile and run programs with execProfile().
+ */
+struct tfprofile *createProfile(void);
+
+/**
+ * @brief Execute a compiled program, recording a profile
+ * @param ctx Execution context; ctx->profile receives the measurements
+ * @param program Program ready to run (same contract as exec())
+ *
+ * Behaves exactly like exec(). For every word executed it adds one call,
+ * the time spent in the word (including the words it calls) and the
+ * number of pool allocations it made (always 0 in a TF_NO_STATS build) to:
+ * - the word's entry, aggregated by name
+ * - the call site, identified by name and source location
+ * - the call path from the top level, for flame graphs
+ *
+ * A word calling itself ('recurse') counts every call, but the time and
+ * allocations of the inner calls belong to the outermost one, and the
+ * call path doesn't grow a level per recursion.
+ */
+void execProfile(tfctx *ctx, tfobj *program);
+
+/**
+ * @brief Print the profile, slowest words and sites first
+ * @param prof Profile to print
+ * @param out Stream to print to
+ */
+void printProfile(struct tfprofile *prof, FILE *out);
+
+/**
+ * @brief Write the call paths in collapsed stack format
+ * @param prof Profile to write
+ * @param out Stream to write to
+ *
+ * One line per call path, "main;word;callee <self nanoseconds>", the
+ * input format of flamegraph.pl and compatible tools.
+ */
+void printCollapsedStacks(struct tfprofile *prof, FILE *out);
+
+/**
+ * @brief Free a profile
+ * @param prof Profile to free
+ */
+void freeProfile(struct tfprofile *prof);
+
+#endif
@@ -1,7 +1,13 @@
 #!/bin/bash
 
 # ToyForth Test Runner
-# Runs all test files and verifies output matches expected results
+# Runs all test files and verifies output matches expected results,
+# with the bytecode VM, the reference list-walking VM (--list), with
+# compile-time optimizations disabled (--no-fuse --no-fold), in
+# streaming mode (--stream) and from a saved image (--image), then all
+# together in one parallel batch (--batch), then a session line by line
+# (--repl), and finally the embedding API (tests/embed, built by 'make
+# test')
 
 set -e
 
@@ -44,24 +50,95 @@ for test_file in tests/*.tf; do
         continue
     fi
     
-    # Run the test and capture output
+    # Run the test with the bytecode VM, the reference list VM, without
+    # compile-time optimizations, in streaming mode and from an image
     actual_output=$(./toyforth "$test_file" 2>&1)
+    list_output=$(./toyforth --list "$test_file" 2>&1)
+    unfused_output=$(./toyforth --no-fuse --no-fold "$test_file" 2>&1)
+    stream_output=$(./toyforth --stream "$test_file" 2>&1)
+    # The first run writes the image, the second one loads it
+    image_file=$(mktemp -u)
+    ./toyforth --image "$image_file" "$test_file" > /dev/null 2>&1 || true
+    image_output=$(./toyforth --image "$image_file" "$test_file" 2>&1)
+    rm -f "$image_file"
     expected_output=$(cat "$expected_file")
     
     # Compare outputs
-    if [ "$actual_output" = "$expected_output" ]; then
+    if [ "$actual_output" = "$expected_output" ] && [ "$list_output" = "$expected_output" ] \
+        && [ "$unfused_output" = "$expected_output" ] && [ "$stream_output" = "$expected_output" ] \
+        && [ "$image_output" = "$expected_output" ]; then
         echo -e "${GREEN}✓ PASS${NC} $test_name"
         PASSED=$((PASSED + 1))
     else
         echo -e "${RED}✗ FAIL${NC} $test_name"
         echo "  Expected:"
         echo "$expected_output" | sed 's/^/    /'
-        echo "  Got:"
+        echo "  Got (bytecode):"
         echo "$actual_output" | sed 's/^/    /'
+        echo "  Got (--list):"
+        echo "$list_output" | sed 's/^/    /'
+        echo "  Got (--no-fuse --no-fold):"
+        echo "$unfused_output" | sed 's/^/    /'
+        echo "  Got (--stream):"
+        echo "$stream_output" | sed 's/^/    /'
+        echo "  Got (--image):"
+        echo "$image_output" | sed 's/^/    /'
         FAILED=$((FAILED + 1))
     fi
 done
 
+# Run every test again as one batch on several threads: the output must
+# be that of running them one by one, in manifest order
+TOTAL=$((TOTAL + 1))
+manifest=$(mktemp)
+expected_batch=$(mktemp)
+for test_file in tests/*.tf; do
+    expected_file="tests/$(basename "$test_file" .tf).expected"
+    if [ -f "$expected_file" ]; then
+        echo "$test_file" >> "$manifest"
+        ./toyforth "$test_file" >> "$expected_batch" 2>&1 || true
+    fi
+done
+if ./toyforth --jobs 4 --batch "$manifest" 2>&1 | diff -q - "$expected_batch" > /dev/null; then
+    echo -e "${GREEN}✓ PASS${NC} batch"
+    PASSED=$((PASSED + 1))
+else
+    echo -e "${RED}✗ FAIL${NC} batch"
+    ./toyforth --jobs 4 --batch "$manifest" 2>&1 | diff - "$expected_batch" | sed 's/^/    /'
+    FAILED=$((FAILED + 1))
+fi
+rm -f "$manifest" "$expected_batch"
+
+# Line by line on one context (--repl): errors are reported and the
+# session goes on with the definitions made so far, ending with status 0.
+# The errors must not depend on the VM or on the compile-time passes
+for repl_mode in "" "--list" "--no-fuse --no-fold"; do
+    TOTAL=$((TOTAL + 1))
+    repl_status=0
+    repl_output=$(./toyforth $repl_mode --repl < tests/repl.in 2>&1) || repl_status=$?
+    if [ "$repl_status" -eq 0 ] && [ "$repl_output" = "$(cat tests/repl.expected)" ]; then
+        echo -e "${GREEN}✓ PASS${NC} repl${repl_mode:+ $repl_mode}"
+        PASSED=$((PASSED + 1))
+    else
+        echo -e "${RED}✗ FAIL${NC} repl${repl_mode:+ $repl_mode} (exit status $repl_status)"
+        echo "$repl_output" | diff - tests/repl.expected | sed 's/^/    /'
+        FAILED=$((FAILED + 1))
+    fi
+done
+
+# The embedding API, through a C program linked against the library
+if [ -x "./tests/embed" ]; then
+    TOTAL=$((TOTAL + 1))
+    if embed_output=$(./tests/embed 2>&1); then
+        echo -e "${GREEN}✓ PASS${NC} embed"
+        PASSED=$((PASSED + 1))
+    else
+        echo -e "${RED}✗ FAIL${NC} embed"
+        echo "$embed_output" | sed 's/^/    /'
+        FAILED=$((FAILED + 1))
+    fi
+fi
+
 echo ""
 echo "========================================"
 echo "  Test Results"
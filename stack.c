@@ -17,12 +17,13 @@
 
 void stackPush(tfctx *ctx, tfobj *o) {
     if (ctx->sp >= ctx->capacity) {
+      ctx->stack = xrealloc(ctx->stack, sizeof(tfobj *) * ctx->capacity * 2);
       ctx->capacity = ctx->capacity * 2;
-      ctx->stack = xrealloc(ctx->stack, sizeof(tfobj *) * ctx->capacity);
     }
     incRef(o);
     ctx->stack[ctx->sp] = o;
     ctx->sp++;
+    stackTrackDepth(ctx);
 }
 
 tfobj *stackPop(tfctx *ctx) {
@@ -33,4 +34,106 @@ tfobj *stackPop(tfctx *ctx) {
   tfobj *popped_item = ctx->stack[ctx->sp];
 
   return popped_item;
+}
+
+/* ===================== In-place operations =================== */
+
+tfobj *stackPeek(tfctx *ctx, size_t n) {
+  return ctx->stack[ctx->sp - 1 - n];
+}
+
+void stackPoke(tfctx *ctx, size_t n, tfobj *o) {
+  tfobj **slot = &ctx->stack[ctx->sp - 1 - n];
+  tfobj *old = *slot;
+  *slot = o;
+  decRef(old);
+}
+
+void stackPushOwned(tfctx *ctx, tfobj *o) {
+  if (ctx->sp >= ctx->capacity) {
+    ctx->stack = xrealloc(ctx->stack, sizeof(tfobj *) * ctx->capacity * 2);
+    ctx->capacity = ctx->capacity * 2;
+  }
+  ctx->stack[ctx->sp++] = o;
+  stackTrackDepth(ctx);
+}
+
+void stackPick(tfctx *ctx, size_t n) {
+  stackPush(ctx, ctx->stack[ctx->sp - 1 - n]);
+}
+
+void stackRoll(tfctx *ctx, size_t n) {
+  tfobj **s = &ctx->stack[ctx->sp - 1 - n];
+  tfobj *o = s[0];
+  for (size_t i = 0; i < n; i++) {
+    s[i] = s[i + 1];
+  }
+  s[n] = o;
+}
+
+void stackUnroll(tfctx *ctx, size_t n) {
+  tfobj **s = &ctx->stack[ctx->sp - 1 - n];
+  tfobj *o = s[n];
+  for (size_t i = n; i > 0; i--) {
+    s[i] = s[i - 1];
+  }
+  s[0] = o;
+}
+
+void stackDrop(tfctx *ctx, size_t n) {
+  while (n-- > 0) {
+    decRef(ctx->stack[--ctx->sp]);
+  }
+}
+
+/* ===================== Return stack =================== */
+
+void returnGrow(tfctx *ctx) {
+  if (ctx->rstack_capacity >= MAX_RETURN_DEPTH) {
+    runtimeError(ctx, "Return stack overflow: too many nested word calls");
+  }
+  ctx->rstack = xrealloc(ctx->rstack, sizeof(tfframe) * ctx->rstack_capacity * 2);
+  ctx->rstack_capacity *= 2;
+}
+
+/* ===================== Errors =================== */
+
+/**
+ * @brief Report that symbol o needs 'need' values on the stack
+ */
+static void underflowError(tfctx *ctx, tfobj *o, int need) {
+  static const char *const counts[] = {"no values", "a value", "two values", "three values"};
+  char error_msg[256];
+  if (need < 4) {
+    snprintf(error_msg, sizeof(error_msg), "Stack underflow: '%s' requires %s",
+             o->sym.ptr, counts[need]);
+  } else {
+    snprintf(error_msg, sizeof(error_msg), "Stack underflow: '%s' requires %d values",
+             o->sym.ptr, need);
+  }
+  ctx->current_object = o;
+  runtimeError(ctx, error_msg);
+}
+
+void stackUnderflowError(tfctx *ctx, tfobj *o) {
+  tfobj *first = o->sym.arg;
+  if (first == NULL) {
+    underflowError(ctx, o, o->sym.need);
+  }
+  /* A fused pair (see fuse.c) fails like the two words it replaces: the
+   * first one runs if it can, then the second one reports the values it
+   * lacks. Whichever limits the pair, the second needs in - in1 + out1 */
+  int in = 0, out = 1;   // A literal
+  if (objType(first) == TFOBJ_TYPE_SYMBOL) {
+    in = first->sym.in;
+    out = first->sym.out;
+    if (ctx->sp < (size_t)in) {
+      underflowError(ctx, first, in);
+    }
+    ctx->current_object = first;
+    first->sym.fn(ctx);
+  } else {
+    stackPush(ctx, first);
+  }
+  underflowError(ctx, o, o->sym.in - in + out);
 }
\ No newline at end of file
@@ -10,6 +10,18 @@
 #define STACK_H
 #include "tf.h"
 
+/**
+ * @brief Update the stack high-water mark (ctx->max_sp) after a push
+ *
+ * Compiled out with -DTF_NO_STATS, like the counters in mem.c.
+ */
+#ifdef TF_NO_STATS
+#define stackTrackDepth(ctx) ((void)0)
+#else
+#define stackTrackDepth(ctx) \
+  do { if ((ctx)->sp > (ctx)->max_sp) (ctx)->max_sp = (ctx)->sp; } while (0)
+#endif
+
 /**
  * @brief Push an object onto the execution stack
  * @param ctx Execution context containing the stack
@@ -32,4 +44,103 @@ void stackPush(tfctx *ctx, tfobj *o);
  */
 tfobj *stackPop(tfctx *ctx);
 
+/* ===================== In-place operations =================== */
+
+/*
+ * These work on slots that are already on the stack, so they never touch
+ * reference counts just to move a value around: the stack keeps owning
+ * the same references in a different order. Slot n is counted from the
+ * top (0 is the top of the stack). None of them check the depth; the
+ * caller must know the slots exist (see the stack effects in dict.c).
+ */
+
+/**
+ * @brief Get the object in slot n without popping it
+ * @param ctx Execution context
+ * @param n Slot, counted from the top (0 = top)
+ * @return The object (still owned by the stack)
+ */
+tfobj *stackPeek(tfctx *ctx, size_t n);
+
+/**
+ * @brief Replace the object in slot n
+ * @param ctx Execution context
+ * @param n Slot, counted from the top (0 = top)
+ * @param o New object; the stack takes over the caller's reference
+ *
+ * The object previously in the slot is released.
+ */
+void stackPoke(tfctx *ctx, size_t n, tfobj *o);
+
+/**
+ * @brief Push an object, taking over the caller's reference
+ * @param ctx Execution context
+ * @param o Object to push (its reference count is not incremented)
+ *
+ * Use it for freshly created results instead of stackPush() + decRef().
+ */
+void stackPushOwned(tfctx *ctx, tfobj *o);
+
+/**
+ * @brief Push another reference to the object in slot n ( xn ... x0 -- xn ... x0 xn )
+ * @param ctx Execution context
+ * @param n Slot, counted from the top (0 = top, like 'dup')
+ */
+void stackPick(tfctx *ctx, size_t n);
+
+/**
+ * @brief Move the object in slot n to the top ( xn ... x0 -- xn-1 ... x0 xn )
+ * @param ctx Execution context
+ * @param n Slot, counted from the top (1 is 'swap', 2 is 'rot')
+ */
+void stackRoll(tfctx *ctx, size_t n);
+
+/**
+ * @brief Move the top object down to slot n, the inverse of stackRoll()
+ * @param ctx Execution context
+ * @param n Slot, counted from the top (1 is 'swap', 2 is '-rot')
+ */
+void stackUnroll(tfctx *ctx, size_t n);
+
+/**
+ * @brief Drop the top n objects, releasing them
+ * @param ctx Execution context
+ * @param n Number of objects to drop
+ */
+void stackDrop(tfctx *ctx, size_t n);
+
+/* ===================== Return stack =================== */
+
+/**
+ * @brief Make room for one more frame, slow path of returnPush()
+ * @param ctx Execution context
+ *
+ * Doubles the return stack, or exits with "Return stack overflow" once
+ * MAX_RETURN_DEPTH calls are nested (runaway recursion).
+ */
+void returnGrow(tfctx *ctx);
+
+/**
+ * @brief Push a frame on the return stack before entering a word
+ * @param ctx Execution context
+ * @return The new frame, for the caller to fill in
+ */
+static inline tfframe *returnPush(tfctx *ctx) {
+  if (ctx->rsp == ctx->rstack_capacity) {
+    returnGrow(ctx);
+  }
+  return &ctx->rstack[ctx->rsp++];
+}
+
+/**
+ * @brief Report a word running with too few values on the stack and exit
+ * @param ctx Execution context
+ * @param o Symbol being executed (its sym.need is the depth it requires)
+ *
+ * Called by the VMs when the depth check in front of a word fails. For
+ * a fused symbol, the error is the one the unfused pair would raise:
+ * same word, same location and same depth.
+ */
+void stackUnderflowError(tfctx *ctx, tfobj *o);
+
 #endif
\ No newline at end of file
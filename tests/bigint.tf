@@ -0,0 +1,27 @@
+\ Test: Big integers (factorials, powers, long literals)
+
+\ 30! and 100!, far beyond 64 bits
+1 2 * 3 * 4 * 5 * 6 * 7 * 8 * 9 * 10 * 11 * 12 * 13 * 14 * 15 * 16 * 17 * 18 * 19 * 20 * 21 * 22 * 23 * 24 * 25 * 26 * 27 * 28 * 29 * 30 * .
+1
+2 * 3 * 4 * 5 * 6 * 7 * 8 * 9 * 10 * 11 * 12 * 13 * 14 * 15 * 16 * 17 * 18 * 19 * 20 * 21 *
+22 * 23 * 24 * 25 * 26 * 27 * 28 * 29 * 30 * 31 * 32 * 33 * 34 * 35 * 36 * 37 * 38 * 39 * 40 * 41 *
+42 * 43 * 44 * 45 * 46 * 47 * 48 * 49 * 50 * 51 * 52 * 53 * 54 * 55 * 56 * 57 * 58 * 59 * 60 * 61 *
+62 * 63 * 64 * 65 * 66 * 67 * 68 * 69 * 70 * 71 * 72 * 73 * 74 * 75 * 76 * 77 * 78 * 79 * 80 * 81 *
+82 * 83 * 84 * 85 * 86 * 87 * 88 * 89 * 90 * 91 * 92 * 93 * 94 * 95 * 96 * 97 * 98 * 99 * 100 *
+.
+
+\ 2^4096 by repeated squaring: Karatsuba, and divide and conquer printing
+: square dup * ;
+2 square square square square square square square square square square square square .
+3 square square square square square square square square square square square dup * 1 - .
+
+\ Mixed sizes and signs
+-7 square square square square square square square square square 12345678901234567890 * .
+2 square square square square square square square square square 10 square square square square square square square square - .
+
+\ Results that cancel back to small integers
+2 square square square square square square square square dup 1 + swap - .
+
+\ A 400-digit literal, read by divide and conquer
+31415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421170679314159265358979323846264338327950288419716939937510582097494459230781640628620899862803482534211706793141592653589793238462643383279502884197169399375105820974944592307816406286208998628034825342117067931415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421170679 .
+31415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421170679314159265358979323846264338327950288419716939937510582097494459230781640628620899862803482534211706793141592653589793238462643383279502884197169399375105820974944592307816406286208998628034825342117067931415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421170679 dup * 31415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421170679314159265358979323846264338327950288419716939937510582097494459230781640628620899862803482534211706793141592653589793238462643383279502884197169399375105820974944592307816406286208998628034825342117067931415926535897932384626433832795028841971693993751058209749445923078164062862089986280348253421170679 - .
@@ -0,0 +1,61 @@
+\ Test: Control flow (if else then, begin until, do loop) and comparisons
+
+\ if with an integer flag, 0 is false
+1 if 10 . then
+0 if 11 . then
+1 if 12 . else 13 . then
+0 if 14 . else 15 . then
+
+\ Comparisons push booleans
+1 2 < .
+2 1 < .
+3 3 = .
+3 4 <> .
+5 5 <= .
+5 4 >= .
+6 7 > .
+1 1 = 2 2 = = .
+1 2 < if 16 . else 17 . then
+
+\ Comparisons work on big integers too
+100000000000000000000 99999999999999999999 > .
+-100000000000000000000 5 < .
+100000000000000000000 100000000000000000000 = .
+
+\ Nested conditionals
+: sign dup 0 < if drop -1 else 0 > if 1 else 0 then then ;
+-42 sign .
+0 sign .
+42 sign .
+
+\ begin until runs the body at least once
+5 begin dup . 1 - dup 0 = until drop
+0 begin 1 + dup 3 >= until .
+
+\ do loop counts i from start up to limit - 1
+4 0 do i . loop
+3 0 do 2 0 do i . loop loop
+0 0 do 99 . loop
+3 5 do 99 . loop
+
+\ i works in the words a loop calls
+: show i 100 * . ;
+3 1 do show loop
+
+\ Loops and definitions
+: fact 1 swap 1 + 1 do i * loop ;
+10 fact .
+25 fact .
+: abs dup 0 < if 0 swap - then ;
+-7 abs .
+7 abs .
+
+\ A word whose stack effect depends on the branch taken
+: maybe if 1 2 then ;
+0 maybe 3 .
+1 maybe . .
+
+\ A loop replacing an unrolled sum
+: sum 0 swap 0 do i + loop ;
+1000 sum .
+100000 sum .
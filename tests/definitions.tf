@@ -0,0 +1,28 @@
+\ Test: Colon definitions and redefinition
+\ Expected output: 25, 1, 2, 9, 49, 6
+
+\ Simple definition
+: square dup * ;
+5 square .
+
+\ Redefinition only affects code compiled after it
+: one 1 ;
+: show-one one ;
+: one 2 ;
+show-one .
+one .
+
+\ A word can shadow a primitive and still use the old one
+: dup dup dup ;
+3 dup + + .
+
+\ Words calling words
+: sq square ;
+: add-sq + sq ;
+3 4 add-sq .
+
+\ Definitions spanning lines
+: triple
+  dup dup
+  + + ;
+2 triple .
@@ -0,0 +1,179 @@
+/**
+ * @file embed.c
+ * @brief Tests of the embedding API (toyforth.h)
+ *
+ * Linked against libtoyforth.a like an outside program. Checks that
+ * state carries over between tf_eval() calls, that errors come back as
+ * statuses with their message and leave the instance usable, that
+ * instances run concurrently on several threads, and that an instance
+ * can move from one thread to another.
+ *
+ * Usage: tests/embed (prints one line per failed check, exits 1 if any)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "toyforth.h"
+
+/** @brief Number of threads in the concurrency test */
+#define EMBED_THREADS 8
+
+static int failures = 0;
+
+/**
+ * @brief Record a failed check with its line
+ */
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "embed.c:%d: check failed: %s\n", __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+/**
+ * @brief Evaluate a null-terminated string
+ */
+static int eval(tfvm *vm, const char *src) {
+    return tf_eval(vm, src, strlen(src));
+}
+
+/**
+ * @brief Pop an integer, or return a value no test expects
+ */
+static int64_t pop(tfvm *vm) {
+    int64_t v;
+    return tf_pop_int(vm, &v) == TF_OK ? v : -999;
+}
+
+static void testState(void) {
+    tfvm *vm = tf_vm_create();
+    CHECK(vm != NULL);
+    CHECK(eval(vm, ": sq dup * ;") == TF_OK);
+    CHECK(eval(vm, "7 sq") == TF_OK);
+    CHECK(tf_depth(vm) == 1);
+    CHECK(tf_push_int(vm, 5) == TF_OK);
+    CHECK(eval(vm, "+") == TF_OK);
+    CHECK(pop(vm) == 54);
+    CHECK(tf_depth(vm) == 0);
+    CHECK(strcmp(tf_error(vm), "") == 0);
+    tf_vm_destroy(vm);
+}
+
+static void testErrors(void) {
+    tfvm *vm = tf_vm_create();
+    CHECK(eval(vm, "1 2 nosuchword") == TF_ERR_COMPILE);
+    CHECK(strstr(tf_error(vm), "Unknown word 'nosuchword'") != NULL);
+    CHECK(tf_depth(vm) == 0);
+
+    // Half-built definitions and quotations are freed (see ASan runs)
+    CHECK(eval(vm, ": half [ 1 [ 2 : ] ] ;") == TF_ERR_COMPILE);
+    CHECK(strstr(tf_error(vm), "inside quotations") != NULL);
+
+    CHECK(eval(vm, ": boom 1 + ; 5 drop drop") == TF_ERR_RUNTIME);
+    CHECK(strstr(tf_error(vm), "Stack underflow") != NULL);
+    CHECK(tf_depth(vm) == 0);
+
+    CHECK(eval(vm, "2305843009213693952 iota") == TF_ERR_RUNTIME);
+    CHECK(strstr(tf_error(vm), "'iota' count is too large") != NULL);
+    CHECK(eval(vm, "-1 iota") == TF_ERR_RUNTIME);
+    CHECK(tf_depth(vm) == 0);
+
+    // The values under the failing word are released (see ASan runs)
+    for (int i = 0; i < 3; i++) {
+        CHECK(eval(vm, "1000 iota [ 1 2 3 ] 0 0 nth") == TF_ERR_RUNTIME);
+        CHECK(tf_depth(vm) == 0);
+    }
+
+    // The instance still works, and kept the definition made before the error
+    CHECK(eval(vm, "41 boom") == TF_OK);
+    CHECK(pop(vm) == 42);
+    CHECK(strcmp(tf_error(vm), "") == 0);
+
+    int64_t v;
+    CHECK(tf_pop_int(vm, &v) == TF_ERR_RUNTIME);
+    CHECK(eval(vm, "[ 1 2 ]") == TF_OK);
+    CHECK(tf_pop_int(vm, &v) == TF_ERR_RUNTIME);
+    CHECK(tf_depth(vm) == 1);
+    tf_vm_destroy(vm);
+}
+
+static void testOutput(void) {
+    tfvm *vm = tf_vm_create();
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    tf_vm_set_output(vm, out);
+    CHECK(eval(vm, "1 2 + . 10 .") == TF_OK);
+    fclose(out);
+    CHECK(text != NULL && strcmp(text, "3\n10\n") == 0);
+    free(text);
+    tf_vm_destroy(vm);
+}
+
+/**
+ * @brief Thread body: sum 1..n with a definition of its own, many times
+ */
+static void *sumThread(void *arg) {
+    int64_t n = *(int64_t *)arg;
+    tfvm *vm = tf_vm_create();
+    int ok = eval(vm, ": sum 0 swap 1 + 1 do i + loop ;") == TF_OK;
+    for (int rep = 0; ok && rep < 200; rep++) {
+        ok = tf_push_int(vm, n) == TF_OK && eval(vm, "sum") == TF_OK &&
+             pop(vm) == n * (n + 1) / 2;
+        // An error on the way must not disturb the other threads
+        ok = ok && eval(vm, "drop") == TF_ERR_RUNTIME;
+    }
+    tf_vm_destroy(vm);
+    return ok ? arg : NULL;
+}
+
+static void testThreads(void) {
+    pthread_t threads[EMBED_THREADS];
+    int64_t n[EMBED_THREADS];
+    for (int i = 0; i < EMBED_THREADS; i++) {
+        n[i] = 100 * (i + 1);
+        CHECK(pthread_create(&threads[i], NULL, sumThread, &n[i]) == 0);
+    }
+    for (int i = 0; i < EMBED_THREADS; i++) {
+        void *result;
+        pthread_join(threads[i], &result);
+        CHECK(result == &n[i]);
+    }
+}
+
+/**
+ * @brief Thread body: use an instance created by another thread, then exit
+ */
+static void *useThread(void *arg) {
+    tfvm *vm = arg;
+    int ok = eval(vm, ": triple 3 * ; 12345678901234567890 triple [ 1 2 ] 14 triple") == TF_OK;
+    return ok ? arg : NULL;
+}
+
+static void testHandOff(void) {
+    // The objects outlive the thread that made them, and are freed by this one
+    tfvm *vm = tf_vm_create();
+    pthread_t thread;
+    void *result = NULL;
+    CHECK(pthread_create(&thread, NULL, useThread, vm) == 0);
+    pthread_join(thread, &result);
+    CHECK(result == vm);
+    CHECK(pop(vm) == 42);
+    CHECK(eval(vm, "drop 5 triple") == TF_OK);
+    CHECK(pop(vm) == 15);
+    tf_vm_destroy(vm);
+}
+
+int main(void) {
+    testState();
+    testErrors();
+    testOutput();
+    testThreads();
+    testHandOff();
+    return failures != 0;
+}
@@ -0,0 +1,17 @@
+\ Test: Constant folding gives the same results as running the words
+\ Expected output: 9, 7, 10, 2, 36, 13, 7, 16
+
+\ Literal-only expressions
+1 2 + 3 * .
+10 3 - .
+5 dup + .
+1 2 swap drop .
+6 dup * .
+
+\ Partially constant expressions
+7 10 3 + swap drop .
+4 3 + dup drop .
+
+\ Inside a colon definition, mixed with runtime values
+: add-sixteen 2 2 * dup * + ;
+0 add-sixteen .
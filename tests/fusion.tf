@@ -0,0 +1,28 @@
+\ Test: Fused word sequences give the same results as unfused ones
+\ Expected output: 49, 14, 7, -7, 20, 3, 11, 15, 0, 99, 2, 2
+
+\ dup * and dup +
+7 dup * .
+7 dup + .
+
+\ swap - (both operand orders)
+3 10 swap - .
+10 3 swap - .
+
+\ swap drop keeps the top value
+10 20 swap drop .
+
+\ drop drop
+1 2 3 4 5 6 drop drop drop drop + .
+
+\ Literal followed by arithmetic
+10 1 + .
+20 5 - .
+0 5 * .
+33 3 * .
+
+\ Fusion inside a colon definition, but not of redefined words
+: inc 1 + ;
+1 inc .
+: dup 1 ;
+2 dup * .
@@ -0,0 +1,49 @@
+\ Test: 64-bit integers and promotion to big integers on overflow
+
+\ Past 32 bits
+4294967296 .
+3000000000 3 * .
+-2147483649 1 - .
+
+\ The int64 limits, and just past them
+9223372036854775807 .
+-9223372036854775808 .
+9223372036854775807 1 + .
+-9223372036854775808 1 - .
+9223372036854775808 .
+-9223372036854775809 .
+
+\ Around the immediate limit (63 bits on 64-bit hosts)
+4611686018427387903 1 + .
+4611686018427387904 dup + .
+-4611686018427387904 dup + .
+
+\ Multiplication overflow
+9223372036854775807 dup * .
+4294967296 4294967296 * .
+-4294967296 4294967296 * 2 * .
+123456789012 123456789012 * 1000000 * .
+
+\ Literals too large for 64 bits
+123456789012345678901234567890 .
+-123456789012345678901234567890 1 + .
+
+\ Back below 64 bits
+9223372036854775807 1 + 1 - .
+18446744073709551616 18446744073709551615 - .
+-9223372036854775808 -1 * -1 * .
+100000000000000000000 0 * .
+
+\ Through words, so the arguments are not constants
+: square dup * ;
+: twice dup + ;
+: next 1 + ;
+: prev 1 - ;
+: triple 3 * ;
+4294967296 square .
+9223372036854775807 twice .
+9223372036854775807 next .
+-9223372036854775808 prev .
+6148914691236517206 triple .
+4294967296 square square .
+9223372036854775808 square .
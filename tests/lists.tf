@@ -0,0 +1,73 @@
+\ Test: Quotations and the list words
+
+\ Literals print as lists, nested ones too
+[ 1 2 3 ] .
+[ ] .
+[ 1 [ 2 [ 3 ] ] dup ] .
+[ 1 2 < ] .
+
+\ map, filter, fold
+[ 1 2 3 4 ] [ dup * ] map .
+[ 1 2 3 4 5 6 ] [ 2 < ] filter .
+[ 1 2 3 4 5 6 ] [ 3 > ] filter .
+[ 1 2 3 4 5 ] 0 [ + ] fold .
+[ ] 42 [ + ] fold .
+[ 1 2 3 ] 0 [ 10 * + ] fold .
+
+\ each may leave any number of values
+[ 1 2 3 ] [ . ] each
+0 [ 4 5 6 ] [ + ] each .
+[ 7 8 ] [ dup ] each . . . .
+
+\ len, nth, concat
+[ 10 20 30 ] len .
+[ ] len .
+[ 10 20 30 ] 0 nth .
+[ 10 20 30 ] 2 nth .
+[ 1 2 ] [ 3 4 ] concat .
+[ ] [ 5 ] concat .
+[ 6 ] dup concat .
+
+\ Big integers and booleans are values like any other
+[ 100000000000000000000 1 ] [ dup * ] map .
+[ 1 2 3 ] [ 2 = ] map .
+
+\ Control flow inside a quotation
+[ -2 0 3 ] [ dup 0 < if drop -1 else 0 > if 1 else 0 then then ] map .
+[ 3 4 ] [ 0 swap 0 do i + loop ] map .
+
+\ Nested quotations
+[ [ 1 2 ] [ 3 ] [ ] ] [ len ] map .
+[ [ 1 2 ] [ 3 4 ] ] [ 0 [ + ] fold ] map .
+
+\ Words calling list words and list words calling words
+: square dup * ;
+: squares [ square ] map ;
+[ 1 2 3 ] squares .
+: sum 0 [ + ] fold ;
+[ 1 2 3 ] squares sum .
+: twice dup [ 2 * ] map concat ;
+[ 1 2 ] twice .
+
+\ The quotation sees the stack below the list
+100 [ 1 2 ] [ over + ] map . .
+
+\ A literal reused in a loop is copied on write, never changed
+: bump [ 1 2 3 ] [ 1 + ] map ;
+3 0 do bump . loop
+
+\ The same quotation keeps working after its list is shared
+[ 5 6 ] dup [ 1 + ] map . .
+
+\ Lists built at run time can run as code
+[ 1 2 ] [ + ] concat [ 0 ] swap each . .
+[ 1 2 3 4 ] [ 2 ] [ > ] concat filter .
+[ [ 1 ] [ 2 3 ] ] [ ] [ concat ] fold .
+[ 3 ] [ dup * . ] concat [ 0 ] swap map drop
+
+\ Recursion inside a quotation
+: fact dup 1 > if dup 1 - recurse * then ;
+[ 5 10 25 ] [ fact ] map .
+\ Counts the lists in a tree of lists
+: nodes 1 [ recurse + ] fold ;
+[ [ ] [ [ ] [ ] ] ] nodes .
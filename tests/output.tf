@@ -0,0 +1,13 @@
+\ Output words: emit, cr, type and flush, and how '.' formats numbers
+72 emit 105 emit cr
+[ 84 121 112 101 100 10 ] type
+[ ] type
+0 . 7 . -7 . 10 . 99 . 100 . -100 . 1234567890 .
+9223372036854775807 . -9223372036854775808 . 9223372036854775808 .
+-12345678901234567890123 .
+[ 1 -20 300 ] >vec .
+[ 1 -2 [ 30 ] ] .
+flush
+: stars 0 do 42 emit loop cr ;
+5 stars
+3 1 do i 48 + emit loop cr
@@ -0,0 +1,28 @@
+\ Test: recurse, tail calls and deep call nesting
+
+\ Factorial, recursing in the middle of the body
+: fact dup 1 > if dup 1 - recurse * then ;
+5 fact .
+25 fact .
+
+\ Two recursive calls per level
+: fib dup 2 < if else dup 1 - recurse swap 2 - recurse + then ;
+15 fib .
+
+\ A tail call: the recursion runs in constant space
+: countdown dup 0 = if drop else 1 - recurse then ;
+1000000 countdown 1 .
+
+\ Not a tail call: every level keeps a return frame, but no C stack
+: depth dup 0 = if else 1 - recurse 1 + then ;
+200000 depth .
+
+\ Words calling words, with a tail call at the end of each one
+: inner 10 + ;
+: middle 2 * inner ;
+: outer 1 + middle ;
+5 outer .
+
+\ A loop in a word called from another loop
+: row 3 0 do i . loop ;
+2 0 do row loop
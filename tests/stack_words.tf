@@ -0,0 +1,34 @@
+\ Test: Stack shuffling words (over rot -rot nip tuck 2dup pick roll)
+\ Values print top first, so '1 2 over . . .' prints 1, 2, 1
+
+\ over ( a b -- a b a )
+1 2 over . . .
+
+\ rot ( a b c -- b c a )
+1 2 3 rot . . .
+
+\ -rot ( a b c -- c a b )
+1 2 3 -rot . . .
+
+\ nip ( a b -- b )
+1 2 nip .
+
+\ tuck ( a b -- b a b )
+1 2 tuck . . .
+
+\ 2dup ( a b -- a b a b )
+1 2 2dup . . . .
+
+\ pick: 0 pick is dup, 2 pick copies the third value
+5 0 pick * .
+10 20 30 2 pick . . . .
+
+\ roll: 1 roll is swap, 2 roll is rot
+6 7 1 roll . .
+10 20 30 2 roll . . .
+
+\ Inside definitions, on values computed at run time
+: sq-of-third 2 pick dup * nip nip nip ;
+3 4 5 sq-of-third .
+: rotate3 -rot rot rot ;
+1 2 3 rotate3 . . .
@@ -0,0 +1,46 @@
+\ Test: Packed integer vectors
+
+\ Building and printing
+5 iota .
+0 iota .
+[ 3 -1 4 1 -5 9 ] >vec .
+10 iota len .
+10 iota 7 nth .
+
+\ Reductions
+10 iota vsum .
+1000000 iota vsum .
+[ 3 -1 4 1 -5 9 2 6 ] >vec vmin .
+[ 3 -1 4 1 -5 9 2 6 ] >vec vmax .
+[ 7 ] >vec vmin .
+[ -9223372036854775808 9223372036854775807 ] >vec vmax .
+0 iota vsum .
+
+\ Element-wise words
+5 iota 5 iota vadd .
+5 iota dup vmul .
+[ 1 2 3 ] >vec [ 4 5 6 ] >vec vdot .
+7 iota 3 vscale .
+7 iota -1 vscale .
+1000 iota dup vdot .
+
+\ Odd lengths use the scalar tail after the SIMD lanes
+13 iota 13 iota vadd .
+[ 5 4 3 2 1 0 -1 ] >vec vmin .
+[ 5 4 3 2 1 0 -1 ] >vec vmax .
+
+\ Sums that don't fit in 64 bits become big integers
+[ 9223372036854775807 9223372036854775807 9223372036854775807 ] >vec vsum .
+[ 9223372036854775807 1 -1 ] >vec vsum .
+[ 4294967296 4294967296 ] >vec dup vdot .
+[ -9223372036854775808 -1 ] >vec vsum .
+
+\ Shared vectors are never changed in place
+5 iota dup dup vadd . .
+: v 4 iota ;
+v dup 10 vscale . .
+
+\ Works from definitions and loops
+: sumsq dup vdot ;
+100 iota sumsq .
+3 0 do i 3 + iota vsum . loop
@@ -11,6 +11,8 @@
 #define TF_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 
 /* ===================== Data types =================== */
 
@@ -29,11 +31,97 @@
 /** @brief Type tag for symbol objects (words/identifiers) */
 #define TFOBJ_TYPE_SYMBOL 4
 
+/** @brief Type tag for word objects (dictionary entries) */
+#define TFOBJ_TYPE_WORD 5
+
+/** @brief Type tag for integers too large for 64 bits (see bigint.h) */
+#define TFOBJ_TYPE_BIGINT 6
+
+/** @brief Type tag for packed int64_t arrays (see vector.h) */
+#define TFOBJ_TYPE_INTVEC 7
+
+/** @brief Number of object types (for per-type tables) */
+#define TFOBJ_TYPE_COUNT 8
+
+/** @brief Word flag: no side effects, can be evaluated at compile time */
+#define TFWORD_PURE 1
+
+/** @brief Stack effect 'out' of a word whose net effect varies at run time */
+#define TFEFFECT_UNKNOWN -1
+
 /** @brief Initial capacity for the execution stack */
 #define INITIAL_STACK_CAPACITY 256
 
+/** @brief Initial number of nested do loops the loop stack holds */
+#define INITIAL_LOOP_CAPACITY 16
+
+/** @brief Initial number of nested word calls the return stack holds */
+#define INITIAL_RETURN_CAPACITY 64
+
+/** @brief Deepest nesting of word calls, past it the program stops */
+#define MAX_RETURN_DEPTH (1 << 22)
+
+/** @brief Largest request served by the pool allocator (bytes) */
+#define POOL_MAX_SIZE 128
+
+/** @brief Size of each slab the pool allocator carves cells from (bytes) */
+#define POOL_SLAB_SIZE (64 * 1024)
+
+/** @brief Size of the read buffer in streaming mode (bytes) */
+#define STREAM_BUFFER_SIZE (64 * 1024)
+
+/** @brief Top-level objects compiled and run per batch in streaming mode */
+#define STREAM_BATCH_SIZE 4096
+
+/** @brief Size of the output buffer of a context (bytes) */
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+
+/** @brief Initial number of slots in the dictionary (symbol ids covered) */
+#define INITIAL_DICT_CAPACITY 64
+
+/** @brief Initial number of slots in a child dictionary (a power of two) */
+#define CHILD_DICT_CAPACITY 16
+
+/** @brief Initial number of slots in the symbol intern table */
+#define INITIAL_INTERN_CAPACITY 256
+
+/** @brief Size of each block interned symbol names are packed into (bytes) */
+#define INTERN_CHUNK_SIZE (16 * 1024)
+
+/** @brief Operand size (32-bit limbs) from which multiplication uses Karatsuba */
+#define BIGINT_KARATSUBA_THRESHOLD 32
+
+/** @brief Size (limbs) from which decimal conversion uses divide and conquer */
+#define BIGINT_DECIMAL_THRESHOLD 32
+
 /* ===================== Data structures =================== */
 
+struct tfctx;
+
+/**
+ * @brief Function pointer type for primitive word implementations
+ *
+ * All primitive words are C functions with this signature. They receive
+ * the execution context and can manipulate the stack, create objects, etc.
+ * Primitives are responsible for type checking and error handling.
+ */
+typedef void (*WordFn)(struct tfctx *ctx);
+
+/**
+ * @brief One cell of a compiled bytecode stream (see bytecode.h)
+ *
+ * A stream is a flat array of cells: an opcode cell followed by its
+ * operands. With direct threading the opcode cell holds the address of
+ * the interpreter code for that instruction instead of its number.
+ */
+typedef union tfcell {
+  const void *label;         /**< Opcode, as a handler address (threaded) */
+  intptr_t op;               /**< Opcode, as a TFOP_* number (switch) */
+  struct tfobj *obj;         /**< Object operand (literal, symbol, word) */
+  WordFn fn;                 /**< Primitive operand */
+  const union tfcell *jump;  /**< Branch destination */
+} tfcell;
+
 /**
  * @brief ToyForth object - unified representation for all values
  *
@@ -44,6 +132,10 @@
  * Memory management uses reference counting: when refcount reaches 0, the
  * object is automatically freed.
  *
+ * Integers and booleans are usually not heap objects at all: they are
+ * encoded directly in the tfobj pointer (see "Immediate values" below), so
+ * only access them through objType() and objInt().
+ *
  * Source location (src_line, src_column) is tracked for error reporting.
  */
 typedef struct tfobj {
@@ -52,32 +144,251 @@ typedef struct tfobj {
   int src_line;        /**< Source line number where this object originated */
   int src_column;      /**< Source column number where this object originated */
   union {
-    int i;             /**< Integer value (for INT and BOOL types) */
+    int64_t i;         /**< Integer value (for INT and BOOL types) */
+    struct {
+      uint32_t *limbs; /**< Magnitude, least significant limb first */
+      size_t len;      /**< Number of limbs (the top one is never 0) */
+      int neg;         /**< Set for negative numbers */
+    } big;
+    struct {
+      int64_t *data;   /**< Elements, contiguous (for INTVEC) */
+      size_t len;      /**< Number of elements */
+    } vec;
     struct {
       char *ptr;       /**< Pointer to string data (for STR and SYMBOL) */
       size_t len;      /**< Length of string in bytes */
     } str;
+    struct {
+      const char *ptr; /**< Interned name (null-terminated, not owned) */
+      size_t len;      /**< Length of the name in bytes */
+      uint32_t id;     /**< Intern id: equal names have equal ids */
+      WordFn fn;       /**< Primitive bound by resolveSymbols(), or NULL */
+      struct tfobj *word;  /**< Word bound by resolveSymbols() (not owned) */
+      struct tfobj *arg;   /**< First of the pair a fused word replaces
+                                (its literal operand or word), or NULL */
+      int in;              /**< Values consumed (stack effect of the word) */
+      int out;             /**< Values produced */
+      int need;            /**< Depth to check before running, 0 if proven */
+      int control;         /**< TFCTRL_* for control flow words, else 0 */
+      size_t target;       /**< List index a control word jumps to */
+      int tail;            /**< Nothing runs after this word in its list */
+    } sym;
+    struct {
+      struct tfobj *name;  /**< Symbol naming the word (for WORD) */
+      WordFn fn;           /**< C implementation, NULL for colon definitions */
+      struct tfobj *body;  /**< Compiled body list for colon definitions */
+      struct tfobj *prev;  /**< Older definition this one shadows, or NULL */
+      tfcell *code;        /**< Bytecode for the body, built on first use */
+      int in;              /**< Stack depth the word needs ( in -- out ) */
+      int out;             /**< Values on the stack in place of those 'in' */
+      int flags;           /**< TFWORD_* flags */
+    } word;
     struct {
       struct tfobj **ele;  /**< Array of object pointers (for LIST type) */
       size_t len;          /**< Number of elements currently in list */
       size_t capacity;     /**< Allocated capacity of list */
+      tfcell *code;        /**< Bytecode when run as a quotation, or NULL */
+      int linked;          /**< Jump targets set for this content (linkBranches()) */
     } list;
   };
 } tfobj;
 
+/* ===================== Immediate values =================== */
+
+/*
+ * Heap objects are at least 4-byte aligned, so the two low bits of a real
+ * tfobj pointer are always zero. We use them as a tag to store small values
+ * inline, in the pointer itself:
+ *
+ *   ...xxxxxxx1  integer, value in the upper bits (arithmetic shift by 1)
+ *   ...xxxxx010  boolean false
+ *   ...xxxxx110  boolean true
+ *   ...xxxxxx00  pointer to a heap tfobj
+ *
+ * Immediates have no refcount, no source location and are never freed:
+ * incRef()/decRef() ignore them, so pushing and popping numbers costs no
+ * allocation at all. Integers are 64 bits wide; those that don't fit in
+ * an immediate (the top 64-bit values, or anything past 31 bits where
+ * intptr_t is 32 bits) fall back to heap TFOBJ_TYPE_INT objects.
+ */
+
+/** @brief Tag bit marking an immediate integer */
+#define TFIMM_INT_TAG 1
+
+/** @brief Tag bits marking an immediate boolean */
+#define TFIMM_BOOL_TAG 2
+
+/** @brief Largest integer that can be stored as an immediate */
+#define TFIMM_INT_MAX (INTPTR_MAX >> 1)
+
+/** @brief Smallest integer that can be stored as an immediate */
+#define TFIMM_INT_MIN (INTPTR_MIN >> 1)
+
+/**
+ * @brief Check whether an object is an immediate (not a heap pointer)
+ */
+static inline int isImmediate(const tfobj *o) {
+  return ((uintptr_t)o & 3) != 0;
+}
+
+/**
+ * @brief Check whether an object is an immediate integer
+ */
+static inline int isImmInt(const tfobj *o) {
+  return ((uintptr_t)o & TFIMM_INT_TAG) != 0;
+}
+
+/**
+ * @brief Encode an integer as an immediate (caller checks the range)
+ */
+static inline tfobj *makeImmInt(intptr_t i) {
+  return (tfobj *)(((uintptr_t)i << 1) | TFIMM_INT_TAG);
+}
+
+/**
+ * @brief Encode a boolean as an immediate
+ */
+static inline tfobj *makeImmBool(int b) {
+  return (tfobj *)(uintptr_t)((b ? 4 : 0) | TFIMM_BOOL_TAG);
+}
+
+/**
+ * @brief Get the type of any object, immediate or not
+ * @return One of TFOBJ_TYPE_*
+ */
+static inline int objType(const tfobj *o) {
+  if (isImmInt(o)) return TFOBJ_TYPE_INT;
+  if (isImmediate(o)) return TFOBJ_TYPE_BOOL;
+  return o->type;
+}
+
+/**
+ * @brief Get the value of an integer or boolean object
+ * @return The integer value (0 or 1 for booleans)
+ */
+static inline int64_t objInt(const tfobj *o) {
+  if (isImmInt(o)) return (int64_t)((intptr_t)o >> 1);
+  if (isImmediate(o)) return (int64_t)((uintptr_t)o >> 2);
+  return o->i;
+}
+
 /**
  * @brief Parser state for reading and tokenizing source code
  *
  * Tracks the current position in the source text and maintains line/column
  * information for error reporting.
+ *
+ * The text is either a whole program in memory, or a window over a stream
+ * (stream != NULL): a fixed-size buffer that is refilled as the parser
+ * reaches its end, keeping only the token being read. The parser never
+ * reads at or past 'end', so the text needs no terminator and can be a
+ * read-only memory-mapped file.
  */
 typedef struct tfparser {
-  char *prg;         /**< Pointer to start of the program text */
+  char *prg;         /**< Pointer to start of the program text (or buffer) */
   char *p;           /**< Current position in the program text */
+  char *end;         /**< End of the text currently in memory */
   int line;          /**< Current line number (1-indexed) */
   int column;        /**< Current column number (1-indexed) */
+  FILE *stream;      /**< Stream being read, or NULL for in-memory text */
+  size_t size;       /**< Capacity of the stream buffer (excluding the NUL) */
+  int eof;           /**< Set once the stream is exhausted */
+  int lines;         /**< Read the stream a line at a time (compileLine()) */
+  tfobj **held;      /**< Unfinished objects it owns (see hold() in parser.c) */
+  size_t held_len;   /**< Number of objects in held */
+  size_t held_cap;   /**< Allocated capacity of held */
 } tfparser;
 
+/** @brief Flush policies of a tfoutput: when the buffered text is written */
+#define TFFLUSH_SIZE 0   /**< When the buffer is full */
+#define TFFLUSH_LINE 1   /**< At every newline (interactive use) */
+#define TFFLUSH_EXIT 2   /**< Only at the end of the run or by 'flush' */
+
+/**
+ * @brief Buffered output of a context
+ *
+ * Printing words format straight into the buffer, which is written to the
+ * stream in large blocks according to the flush policy, so printing a
+ * value costs no stdio call. With TFFLUSH_EXIT the buffer grows instead.
+ */
+typedef struct tfoutput {
+  FILE *stream;      /**< Where the text goes */
+  char *buf;         /**< Text not written yet */
+  size_t len;        /**< Bytes in the buffer */
+  size_t size;       /**< Capacity of the buffer */
+  int policy;        /**< TFFLUSH_* */
+} tfoutput;
+
+/**
+ * @brief Word dictionary - word objects indexed by symbol id
+ *
+ * Slot i holds the latest definition (TFOBJ_TYPE_WORD) for the name with
+ * intern id i, or NULL. Ids are dense, so this is a plain array and a
+ * lookup is a single load. Redefining a name does not drop the old word:
+ * it is chained from the new one through word.prev, so code compiled
+ * against it keeps working.
+ *
+ * A dictionary may sit on top of a read-only base (the primitives shared
+ * by batch workers): names it doesn't hold are looked up there. Such a
+ * child dictionary only holds the few words one script defines, while
+ * ids keep growing over a whole batch, so it is an open-addressing hash
+ * table keyed by id instead (ids[i] is the id of slots[i]).
+ */
+typedef struct tfdict {
+  struct tfobj **slots;    /**< Words, indexed by the id of their name */
+  uint32_t *ids;           /**< Ids of the slots of a child, NULL otherwise */
+  size_t capacity;         /**< Number of slots (past the largest id, or a
+                                power of two for a child) */
+  size_t count;            /**< Number of distinct names stored */
+  const struct tfdict *base; /**< Dictionary behind this one, or NULL */
+} tfdict;
+
+/**
+ * @brief Memory and reference counting counters (see memoryStats())
+ *
+ * Maintained by mem.c unless the interpreter is built with -DTF_NO_STATS
+ * (make STATS=0), in which case they all stay zero.
+ */
+typedef struct tfstats {
+  unsigned long allocs;          /**< poolAlloc() calls */
+  unsigned long frees;           /**< poolFree() calls */
+  size_t live_bytes;             /**< Bytes handed out by the pool, not freed */
+  size_t peak_live_bytes;        /**< Highest live_bytes so far */
+  unsigned long increfs;         /**< incRef() calls on heap objects */
+  unsigned long decrefs;         /**< decRef() calls on heap objects */
+  unsigned long live_objects[TFOBJ_TYPE_COUNT]; /**< Heap objects, by type */
+  unsigned long peak_live_objects; /**< Highest total of live_objects */
+} tfstats;
+
+/**
+ * @brief One active do loop (see control.h)
+ */
+typedef struct tfloop {
+  int64_t index;           /**< Current value, pushed by 'i' */
+  int64_t limit;           /**< The loop ends when index reaches it */
+} tfloop;
+
+/**
+ * @brief Return stack entry: where a word call resumes its caller
+ *
+ * Word calls push a frame instead of recursing in C, so call depth only
+ * costs heap memory. The bytecode VM uses 'ip', the list VMs 'list' and
+ * 'index'.
+ */
+typedef struct tfframe {
+  const tfcell *ip;        /**< Next instruction of the caller */
+  tfobj *list;             /**< List of the caller */
+  size_t index;            /**< Next index in that list */
+} tfframe;
+
+/**
+ * @brief Function that runs a quotation (a list of code) on a VM
+ *
+ * The list words ('map', 'each'...) call quotations through the one in
+ * tfctx.run_quotation, so quotations run on the same VM as the program.
+ */
+typedef void (*QuotationFn)(struct tfctx *ctx, struct tfobj *quot);
+
 /**
  * @brief Execution context for the ToyForth virtual machine
  *
@@ -88,7 +399,19 @@ typedef struct tfctx {
   tfobj **stack;           /**< Array of object pointers forming the stack */
   size_t sp;               /**< Stack pointer (index of next free slot) */
   size_t capacity;         /**< Allocated capacity of stack array */
+  size_t max_sp;           /**< Deepest the stack has been (high-water mark) */
   tfobj *current_object;   /**< Currently executing object (for error context) */
+  tfloop *loops;           /**< Active do loops, innermost last */
+  size_t loop_sp;          /**< Number of active do loops */
+  size_t loop_capacity;    /**< Allocated capacity of the loop stack */
+  tfframe *rstack;         /**< Return stack of the running word calls */
+  size_t rsp;              /**< Number of frames on the return stack */
+  size_t rstack_capacity;  /**< Allocated capacity of the return stack */
+  tfdict *dict;            /**< Word dictionary (primitives and definitions) */
+  struct tfpairs *pairs;   /**< Word pair profile being recorded, or NULL */
+  struct tfprofile *profile; /**< Execution profile being recorded, or NULL */
+  QuotationFn run_quotation; /**< Runs quotations on the VM in use */
+  tfoutput out;            /**< Where the printing words write (stdout) */
 } tfctx;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,153 @@
+/**
+ * @file toyforth.c
+ * @brief Implementation of the embedding API (see toyforth.h)
+ *
+ * A tfvm wraps a context and the run options. Every entry point that can
+ * fail sets an error trap for the calling thread around the work, so the
+ * errors the interpreter reports (which would exit the command line
+ * program) come back here as a status instead. Entry points that create
+ * or free objects also swap in the instance's own pool, so its object
+ * cells are all returned by tf_vm_destroy(), whatever thread ran it.
+ * After an error the stack is released (see resetContext()), except the
+ * operands of the word that failed, whose buffers stay leaked.
+ */
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "toyforth.h"
+#include "tf.h"
+#include "mem.h"
+#include "stack.h"
+#include "parser.h"
+#include "vm.h"
+#include "output.h"
+
+_Static_assert(TF_ERR_COMPILE == TFERR_COMPILE && TF_ERR_RUNTIME == TFERR_RUNTIME &&
+               TF_ERR_MEMORY == TFERR_MEMORY, "API statuses must match error kinds");
+
+/**
+ * @brief An interpreter instance
+ */
+struct tfvm {
+    tfctx *ctx;
+    tfpool *pool;                     /**< Where its objects come from, see poolSwap() */
+    runOptions opt;
+    char error[TFERR_MESSAGE_SIZE];   /**< Message of the last error, or "" */
+};
+
+/* ===================== Instances =================== */
+
+tfvm *tf_vm_create(void) {
+    tfvm *volatile vm = malloc(sizeof(tfvm));   // Freed after a longjmp
+    if (vm == NULL) {
+        return NULL;
+    }
+    vm->pool = NULL;
+    tferrortrap trap = {.out = NULL, .name = NULL};
+    tferrortrap *old = setErrorTrap(&trap);
+    if (setjmp(trap.jump) != 0) {
+        setErrorTrap(old);
+        if (vm->pool) {
+            poolSwap(vm->pool);
+            freePool(vm->pool);
+        }
+        free(vm);
+        return NULL;
+    }
+    vm->pool = createPool();
+    poolSwap(vm->pool);
+    vm->ctx = createContext();
+    poolSwap(vm->pool);
+    setErrorTrap(old);
+    vm->opt = (runOptions){0, 1, 1};
+    vm->error[0] = '\0';
+    return vm;
+}
+
+void tf_vm_destroy(tfvm *vm) {
+    if (vm == NULL) return;
+    poolSwap(vm->pool);
+    freeContext(vm->ctx);
+    poolSwap(vm->pool);
+    freePool(vm->pool);
+    free(vm);
+}
+
+void tf_vm_set_output(tfvm *vm, FILE *out) {
+    setOutputStream(&vm->ctx->out, out);
+}
+
+const char *tf_error(const tfvm *vm) {
+    return vm->error;
+}
+
+/* ===================== Running code =================== */
+
+int tf_eval(tfvm *vm, const char *src, size_t len) {
+    poolSwap(vm->pool);
+    tferrortrap trap = {.out = NULL, .name = NULL};
+    tferrortrap *old = setErrorTrap(&trap);
+    tfobj *volatile program = NULL;
+    int status = TF_OK;
+    if (setjmp(trap.jump) == 0) {
+        // The parser never writes to the text
+        program = compile((char *)src, len);
+        runProgram(vm->ctx, program, &vm->opt);
+        vm->error[0] = '\0';
+    } else {
+        status = trap.error;
+        memcpy(vm->error, trap.message, sizeof(vm->error));
+        resetContext(vm->ctx);
+    }
+    flushOutput(&vm->ctx->out);
+    setErrorTrap(old);
+    if (program) {
+        decRef(program);
+    }
+    poolSwap(vm->pool);
+    return status;
+}
+
+/* ===================== Stack access =================== */
+
+size_t tf_depth(const tfvm *vm) {
+    return vm->ctx->sp;
+}
+
+int tf_push_int(tfvm *vm, int64_t value) {
+    poolSwap(vm->pool);
+    tferrortrap trap = {.out = NULL, .name = NULL};
+    tferrortrap *old = setErrorTrap(&trap);
+    if (setjmp(trap.jump) != 0) {
+        setErrorTrap(old);
+        poolSwap(vm->pool);
+        memcpy(vm->error, trap.message, sizeof(vm->error));
+        return trap.error;
+    }
+    stackPushOwned(vm->ctx, createIntObject(value));
+    setErrorTrap(old);
+    poolSwap(vm->pool);
+    return TF_OK;
+}
+
+int tf_pop_int(tfvm *vm, int64_t *value) {
+    tfctx *ctx = vm->ctx;
+    if (ctx->sp == 0) {
+        snprintf(vm->error, sizeof(vm->error), "tf_pop_int: the stack is empty");
+        return TF_ERR_RUNTIME;
+    }
+    tfobj *o = stackPeek(ctx, 0);
+    int type = objType(o);
+    if (type != TFOBJ_TYPE_INT && type != TFOBJ_TYPE_BOOL) {
+        snprintf(vm->error, sizeof(vm->error),
+                 "tf_pop_int: the top of the stack is not an integer");
+        return TF_ERR_RUNTIME;
+    }
+    *value = objInt(o);
+    poolSwap(vm->pool);   // A heap integer goes back to the instance's pool
+    stackDrop(ctx, 1);
+    poolSwap(vm->pool);
+    return TF_OK;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file toyforth.h
+ * @brief Embedding API: the interpreter as a library (libtoyforth)
+ *
+ * A tfvm is an interpreter instance: a stack, a dictionary and the
+ * options of the passes. Code evaluated with tf_eval() runs against it,
+ * so definitions and values left on the stack carry over from one call
+ * to the next. Errors never exit the process: tf_eval() returns a status
+ * and the message is kept for tf_error().
+ *
+ * Instances share no mutable state, so one process can run many of them
+ * at once on different threads. Each one must only be used by one thread
+ * at a time, but any thread may use it: its objects come from its own
+ * pool, which every call swaps in for the calling thread, and
+ * tf_vm_destroy() gives the whole pool back. The memory counters that
+ * '.stats' prints (memoryStats()) are kept per thread, not per instance,
+ * so they add up the instances a thread has run. The one process-wide
+ * structure is the table of interned names, which is thread-safe and
+ * lives until the process exits.
+ *
+ * This header is self-contained: it is all an embedding program needs,
+ * with libtoyforth.a or libtoyforth.so (make lib) and -pthread.
+ */
+
+#ifndef TOYFORTH_H
+#define TOYFORTH_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#if defined(__GNUC__)
+#define TF_API __attribute__((visibility("default")))
+#else
+#define TF_API
+#endif
+
+/** @brief Status: success */
+#define TF_OK 0
+
+/** @brief Status: the code can't be parsed or uses an unknown word */
+#define TF_ERR_COMPILE 1
+
+/** @brief Status: the code stopped with a runtime error */
+#define TF_ERR_RUNTIME 2
+
+/** @brief Status: an allocation failed */
+#define TF_ERR_MEMORY 3
+
+/** @brief An interpreter instance */
+typedef struct tfvm tfvm;
+
+/**
+ * @brief Create an interpreter instance
+ * @return New instance with an empty stack and the primitives, or NULL
+ *         if out of memory. Free it with tf_vm_destroy().
+ *
+ * Programs run on the threaded bytecode VM with every optimization pass,
+ * and print to stdout (see tf_vm_set_output()).
+ */
+TF_API tfvm *tf_vm_create(void);
+
+/**
+ * @brief Free an instance, its stack and its definitions
+ */
+TF_API void tf_vm_destroy(tfvm *vm);
+
+/**
+ * @brief Compile and run code on an instance
+ * @param vm Instance
+ * @param src Source text (need not be null-terminated, not retained)
+ * @param len Length of the text in bytes
+ * @return TF_OK, or the TF_ERR_* status of the error that stopped it
+ *
+ * On an error the message is available from tf_error() and the stack is
+ * emptied; the definitions made so far are kept.
+ */
+TF_API int tf_eval(tfvm *vm, const char *src, size_t len);
+
+/**
+ * @brief Get the message of the last error
+ * @return Message of the last failed tf_eval() (possibly several lines),
+ *         or "" if the last call succeeded. Valid until the next call.
+ */
+TF_API const char *tf_error(const tfvm *vm);
+
+/**
+ * @brief Choose where '.' and '.stats' print
+ * @param out Open stream, stdout by default (not closed by the instance)
+ */
+TF_API void tf_vm_set_output(tfvm *vm, FILE *out);
+
+/**
+ * @brief Get the number of values on the stack
+ */
+TF_API size_t tf_depth(const tfvm *vm);
+
+/**
+ * @brief Push an integer
+ * @return TF_OK, or TF_ERR_MEMORY
+ */
+TF_API int tf_push_int(tfvm *vm, int64_t value);
+
+/**
+ * @brief Pop an integer
+ * @param value Receives the integer (booleans give 0 or 1)
+ * @return TF_OK, or TF_ERR_RUNTIME (with a message for tf_error()) if
+ *         the stack is empty or the top value is not an integer that
+ *         fits in 64 bits; the stack is left unchanged then
+ */
+TF_API int tf_pop_int(tfvm *vm, int64_t *value);
+
+#endif
@@ -0,0 +1,259 @@
+/**
+ * @file vector.c
+ * @brief Implementation of the integer vector kernels
+ *
+ * Each SIMD kernel keeps one partial result per lane and finishes the
+ * elements that don't fill a whole register with the scalar code.
+ * Overflow is detected the same way in every lane: a + b overflowed iff
+ * the result's sign differs from the signs of both operands, that is
+ * iff ((r ^ a) & (r ^ b)) is negative. The kernels OR those values
+ * together and look at the sign bits once, after the loop.
+ *
+ * A reduction that overflows in some lane may still have a sum that fits
+ * in 64 bits; reporting it anyway is fine, since the caller's fallback
+ * computes the exact result.
+ */
+
+#include <stdint.h>
+
+#include "vector.h"
+#include "bigint.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && \
+    !defined(TF_NO_SIMD)
+#define VEC_X86 1
+#include <immintrin.h>
+#endif
+
+/* ===================== Scalar kernels =================== */
+
+#ifndef VEC_X86
+static int sumScalar(const int64_t *a, size_t n, int64_t *sum) {
+    int64_t s = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (addOverflow(s, a[i], &s)) return 1;
+    }
+    *sum = s;
+    return 0;
+}
+#endif
+
+static int addScalar(int64_t *r, const int64_t *a, const int64_t *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (addOverflow(a[i], b[i], &r[i])) return 1;
+    }
+    return 0;
+}
+
+static int64_t minScalar(const int64_t *a, size_t n) {
+    int64_t m = a[0];
+    for (size_t i = 1; i < n; i++) {
+        if (a[i] < m) m = a[i];
+    }
+    return m;
+}
+
+static int64_t maxScalar(const int64_t *a, size_t n) {
+    int64_t m = a[0];
+    for (size_t i = 1; i < n; i++) {
+        if (a[i] > m) m = a[i];
+    }
+    return m;
+}
+
+/* ===================== SSE2 kernels =================== */
+
+#ifdef VEC_X86
+
+/*
+ * SSE2 is part of x86-64, so these need no check. It has 64-bit adds but
+ * no 64-bit compare, so min and max only have an AVX2 version.
+ */
+
+static int sumSSE2(const int64_t *a, size_t n, int64_t *sum) {
+    __m128i acc = _mm_setzero_si128();
+    __m128i ovf = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i r = _mm_add_epi64(acc, x);
+        ovf = _mm_or_si128(ovf, _mm_and_si128(_mm_xor_si128(r, acc), _mm_xor_si128(r, x)));
+        acc = r;
+    }
+    if (_mm_movemask_pd(_mm_castsi128_pd(ovf))) return 1;
+
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    int64_t s;
+    if (addOverflow(lanes[0], lanes[1], &s)) return 1;
+    for (; i < n; i++) {
+        if (addOverflow(s, a[i], &s)) return 1;
+    }
+    *sum = s;
+    return 0;
+}
+
+static int addSSE2(int64_t *r, const int64_t *a, const int64_t *b, size_t n) {
+    __m128i ovf = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i s = _mm_add_epi64(x, y);
+        ovf = _mm_or_si128(ovf, _mm_and_si128(_mm_xor_si128(s, x), _mm_xor_si128(s, y)));
+        _mm_storeu_si128((__m128i *)(r + i), s);
+    }
+    if (_mm_movemask_pd(_mm_castsi128_pd(ovf))) return 1;
+    return addScalar(r + i, a + i, b + i, n - i);
+}
+
+/* ===================== AVX2 kernels =================== */
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static int sumAVX2(const int64_t *a, size_t n, int64_t *sum) {
+    __m256i acc = _mm256_setzero_si256();
+    __m256i ovf = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i r = _mm256_add_epi64(acc, x);
+        ovf = _mm256_or_si256(ovf, _mm256_and_si256(_mm256_xor_si256(r, acc),
+                                                    _mm256_xor_si256(r, x)));
+        acc = r;
+    }
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(ovf))) return 1;
+
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    int64_t s = lanes[0];
+    for (int l = 1; l < 4; l++) {
+        if (addOverflow(s, lanes[l], &s)) return 1;
+    }
+    for (; i < n; i++) {
+        if (addOverflow(s, a[i], &s)) return 1;
+    }
+    *sum = s;
+    return 0;
+}
+
+AVX2 static int addAVX2(int64_t *r, const int64_t *a, const int64_t *b, size_t n) {
+    __m256i ovf = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i s = _mm256_add_epi64(x, y);
+        ovf = _mm256_or_si256(ovf, _mm256_and_si256(_mm256_xor_si256(s, x),
+                                                    _mm256_xor_si256(s, y)));
+        _mm256_storeu_si256((__m256i *)(r + i), s);
+    }
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(ovf))) return 1;
+    return addScalar(r + i, a + i, b + i, n - i);
+}
+
+/**
+ * @brief Min or max of n > 0 elements, selecting with 64-bit compares
+ * @param max Nonzero for the maximum
+ */
+AVX2 static int64_t extremeAVX2(const int64_t *a, size_t n, int max) {
+    if (n < 4) {
+        return max ? maxScalar(a, n) : minScalar(a, n);
+    }
+    __m256i m = _mm256_loadu_si256((const __m256i *)a);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        // Take x where it beats the current lane
+        __m256i better = max ? _mm256_cmpgt_epi64(x, m) : _mm256_cmpgt_epi64(m, x);
+        m = _mm256_blendv_epi8(m, x, better);
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, m);
+    int64_t r = max ? maxScalar(lanes, 4) : minScalar(lanes, 4);
+    for (; i < n; i++) {
+        if (max ? a[i] > r : a[i] < r) r = a[i];
+    }
+    return r;
+}
+
+/**
+ * @brief Check whether the CPU (and OS) support AVX2
+ *
+ * A load and a test once the compiler runtime has read CPUID at startup,
+ * cheap next to a bulk operation.
+ */
+static int haveAVX2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+/* ===================== Dispatch =================== */
+
+int vecSum(const int64_t *a, size_t n, int64_t *sum) {
+#ifdef VEC_X86
+    if (haveAVX2()) return sumAVX2(a, n, sum);
+    return sumSSE2(a, n, sum);
+#else
+    return sumScalar(a, n, sum);
+#endif
+}
+
+int vecAdd(int64_t *r, const int64_t *a, const int64_t *b, size_t n) {
+#ifdef VEC_X86
+    if (haveAVX2()) return addAVX2(r, a, b, n);
+    return addSSE2(r, a, b, n);
+#else
+    return addScalar(r, a, b, n);
+#endif
+}
+
+int64_t vecMin(const int64_t *a, size_t n) {
+#ifdef VEC_X86
+    if (haveAVX2()) return extremeAVX2(a, n, 0);
+#endif
+    return minScalar(a, n);
+}
+
+int64_t vecMax(const int64_t *a, size_t n) {
+#ifdef VEC_X86
+    if (haveAVX2()) return extremeAVX2(a, n, 1);
+#endif
+    return maxScalar(a, n);
+}
+
+/*
+ * No 64-bit SIMD multiply: plain loops. The overflow builtins compile to
+ * a multiply and a jump each, which is still far from an interpreted '*'.
+ */
+
+int vecMul(int64_t *r, const int64_t *a, const int64_t *b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (mulOverflow(a[i], b[i], &r[i])) return 1;
+    }
+    return 0;
+}
+
+int vecScale(int64_t *r, const int64_t *a, int64_t k, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (mulOverflow(a[i], k, &r[i])) return 1;
+    }
+    return 0;
+}
+
+int vecDot(const int64_t *a, const int64_t *b, size_t n, int64_t *dot) {
+    int64_t s = 0;
+    for (size_t i = 0; i < n; i++) {
+        int64_t p;
+        if (mulOverflow(a[i], b[i], &p) || addOverflow(s, p, &s)) return 1;
+    }
+    *dot = s;
+    return 0;
+}
+
+void vecIota(int64_t *r, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        r[i] = (int64_t)i;
+    }
+}
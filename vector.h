@@ -0,0 +1,78 @@
+/**
+ * @file vector.h
+ * @brief Bulk integer kernels for packed vectors (TFOBJ_TYPE_INTVEC)
+ *
+ * An INTVEC holds its elements as one contiguous int64_t array rather
+ * than as tfobj pointers, so a single word like 'vsum' or 'vadd' works
+ * through millions of elements in a tight loop instead of millions of
+ * interpreted dispatches.
+ *
+ * The kernels below do the arithmetic. On x86-64 the additive ones and
+ * min/max are written with SSE2 (always available there) and AVX2, picked
+ * at run time from what the CPU supports; elsewhere, or in a TF_NO_SIMD
+ * build ('make SIMD=0'), they are plain loops. The multiplicative ones
+ * are plain loops everywhere: neither SSE2 nor AVX2 has a 64-bit
+ * multiply, let alone one that reports overflow.
+ *
+ * Integers never wrap in ToyForth, so every kernel that can overflow
+ * says so instead of returning a wrong result, and the caller decides
+ * (a reduction retries with big integers, an element-wise word reports
+ * an error, since a vector only holds 64-bit values).
+ */
+
+#ifndef VECTOR_H
+#define VECTOR_H
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Sum of n elements
+ * @param sum Receives the sum
+ * @return 1 if the sum (or a partial sum) doesn't fit in 64 bits, else 0
+ */
+int vecSum(const int64_t *a, size_t n, int64_t *sum);
+
+/**
+ * @brief Element-wise sum r[i] = a[i] + b[i]
+ * @param r Result, may be a or b
+ * @return 1 if an element overflowed (r is then unspecified), else 0
+ */
+int vecAdd(int64_t *r, const int64_t *a, const int64_t *b, size_t n);
+
+/**
+ * @brief Element-wise product r[i] = a[i] * b[i]
+ * @param r Result, may be a or b
+ * @return 1 if an element overflowed (r is then unspecified), else 0
+ */
+int vecMul(int64_t *r, const int64_t *a, const int64_t *b, size_t n);
+
+/**
+ * @brief Product by a scalar r[i] = a[i] * k
+ * @param r Result, may be a
+ * @return 1 if an element overflowed (r is then unspecified), else 0
+ */
+int vecScale(int64_t *r, const int64_t *a, int64_t k, size_t n);
+
+/**
+ * @brief Dot product, the sum of a[i] * b[i]
+ * @param dot Receives the result
+ * @return 1 if a product or partial sum doesn't fit in 64 bits, else 0
+ */
+int vecDot(const int64_t *a, const int64_t *b, size_t n, int64_t *dot);
+
+/**
+ * @brief Smallest of n elements, n > 0
+ */
+int64_t vecMin(const int64_t *a, size_t n);
+
+/**
+ * @brief Largest of n elements, n > 0
+ */
+int64_t vecMax(const int64_t *a, size_t n);
+
+/**
+ * @brief Fill r with 0, 1, ... n-1
+ */
+void vecIota(int64_t *r, size_t n);
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file vm.c
+ * @brief The reference VM loop and the pipeline that runs a program
+ *
+ * exec() walks the object list directly. It is the simplest of the VMs,
+ * so it serves as the reference for the bytecode interpreter (bytecode.c)
+ * and the profiler (profile.c), which must behave exactly like it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vm.h"
+#include "tf.h"
+#include "mem.h"
+#include "stack.h"
+#include "dict.h"
+#include "bytecode.h"
+#include "fuse.h"
+#include "analyze.h"
+#include "profile.h"
+#include "control.h"
+
+/* ===================== Virtual Machine =================== */
+
+void exec(tfctx *ctx, tfobj *program) {
+  size_t base = ctx->rsp;   // Frames below belong to whoever called exec()
+  tfobj *list = program;
+  size_t i = 0;
+  for (;;) {
+    if (i == list->list.len) {
+      if (ctx->rsp == base) return;
+      tfframe *f = &ctx->rstack[--ctx->rsp];
+      list = f->list;
+      i = f->index;
+      continue;
+    }
+    tfobj *o = list->list.ele[i++];
+    if (ctx->pairs) {
+      pairProfileObserve(ctx->pairs, o);
+    }
+    switch (objType(o)) {
+      case TFOBJ_TYPE_INT:
+      case TFOBJ_TYPE_BIGINT:
+      case TFOBJ_TYPE_BOOL:
+      case TFOBJ_TYPE_LIST:
+        // It's just data (usually an immediate, no refcount
+        // traffic) so we can push it to the stack
+        stackPush(ctx, o);
+        break;
+      case TFOBJ_TYPE_SYMBOL: {
+        /* The linker already bound the symbol to its
+        * word, we just call through the pointer */
+        ctx->current_object = o;
+        if (ctx->sp < (size_t)o->sym.need) {
+          stackUnderflowError(ctx, o);
+        }
+        if (o->sym.fn) {
+          o->sym.fn(ctx);
+        } else if (o->sym.word) {
+          if (!o->sym.tail) {
+            tfframe *f = returnPush(ctx);
+            f->list = list;
+            f->index = i;
+          }
+          list = o->sym.word->word.body;
+          i = 0;
+        } else if (o->sym.control) {
+          i = runControl(ctx, o, i);
+        } else {
+          char error_msg[256];
+          snprintf(error_msg, sizeof(error_msg), "Unresolved word '%s'", o->sym.ptr);
+          runtimeError(ctx, error_msg);
+        }
+        break;
+      }
+      case TFOBJ_TYPE_WORD:
+        break;
+      default:
+        runtimeError(ctx, "Found an unknown keyword while executing the program");
+        break;
+    }
+  }
+}
+
+
+/* ===================== Pipeline =================== */
+
+void runProgram(tfctx *ctx, tfobj *program, const runOptions *opt) {
+  resolveSymbols(ctx->dict, program);
+  if (opt->use_fold) {
+    foldConstants(program);
+  }
+  if (opt->use_fuse) {
+    fuseProgram(program);
+  }
+  if (opt->use_fold) {
+    analyzeStack(program);
+  }
+  // Quotations run on the same VM as the program (the profiler's on exec)
+  ctx->run_quotation = (opt->use_list || ctx->profile) ? exec : execQuotation;
+  if (ctx->profile) {
+    execProfile(ctx, program);
+  } else if (opt->use_list) {
+    exec(ctx, program);
+  } else {
+    // The code is kept on the program list, which frees it even if the
+    // run stops at an error trap
+    execQuotation(ctx, program);
+  }
+  ctx->current_object = NULL;   // The program may be freed now, see resetContext()
+}
+
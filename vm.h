@@ -0,0 +1,60 @@
+/**
+ * @file vm.h
+ * @brief Running compiled programs: the reference VM and the pipeline
+ *
+ * runProgram() takes a program from the parser to its last instruction:
+ * it links it, runs the optional optimization passes and executes it on
+ * the VM selected by the options. Everything that runs programs (the
+ * command line, stream and batch modes) goes through it.
+ */
+
+#ifndef VM_H
+#define VM_H
+#include "tf.h"
+
+/**
+ * @brief Options that select the passes and the VM
+ */
+typedef struct runOptions {
+  int use_list;      /**< Run on the reference list VM */
+  int use_fuse;      /**< Fuse word sequences into superinstructions */
+  int use_fold;      /**< Fold constants and remove proven depth checks */
+} runOptions;
+
+/**
+ * @brief Execute a compiled program by walking its object list
+ * @param ctx Execution context (contains the stack)
+ * @param program List object containing the compiled program
+ *
+ * This is the reference VM loop, selected with --list. The default engine
+ * is the threaded bytecode interpreter (execCode), and both must produce
+ * the same results. It iterates through the program list:
+ * - Data objects (integers, booleans, quotations) are pushed onto the stack
+ * - Symbol objects are executed through the word cached on them by
+ *   resolveSymbols(), so no name lookup happens at run time. Primitives
+ *   are called directly. Colon definitions run in this same loop: the
+ *   caller's place is pushed on ctx->rstack and the loop moves on to the
+ *   body, except for tail calls (sym.tail), which push nothing. Deep
+ *   recursion therefore uses no C stack.
+ *   The stack depth is checked first, unless analyzeStack() proved it
+ * - Control symbols (if, loop...) move i to their linked jump target
+ * - Word objects (definitions) were installed by the linker, nothing to do
+ *
+ * The symbol being executed is tracked in ctx->current_object for error
+ * reporting, and pairs of executed words are recorded in ctx->pairs when
+ * a profile is attached (--pairs).
+ * The program must have been resolved; an unbound symbol is a runtime error.
+ */
+void exec(tfctx *ctx, tfobj *program);
+
+/**
+ * @brief Link, optimize and execute a compiled program (or batch)
+ * @param ctx Execution context
+ * @param program List object returned by compile() or compileBatch()
+ * @param opt Options selecting the passes and the VM
+ *
+ * Runs on the profiling VM instead when ctx->profile is set.
+ */
+void runProgram(tfctx *ctx, tfobj *program, const runOptions *opt);
+
+#endif